@@ -0,0 +1,287 @@
+// arcLength.cpp
+//
+// Headless benchmark of Spline::paramAtArcLength: looks up the params
+// at random arc lengths on a closed spline through random control
+// points, and checks the error of each lookup against a reference arc
+// length from composite Simpson integration in double precision.  The
+// table that spline.cpp used to have (OldTable below), with
+// DIVS_PER_SEG chords per segment and linear interpolation, is timed
+// and checked the same way.
+//
+// The error of a lookup is |L(t) - s| for the param t returned at arc
+// length s, in world units.  It must be within the spline's tolerance
+// plus what rounding s and t to float can cost, FLT_EPSILON * (s + t
+// |C'(t)|), which dominates on long tracks.
+//
+// The cost of dragging a control point is timed too: each edit moves
+// a point, calls pointMoved() and brings the table up to date.  The
+// lookups are then timed again, through the tree the edits leave
+// them to until the frames are rebuilt.
+//
+// Usage: arcLength [numPoints [numLookups [reps]]]
+
+
+#include "headers.h"
+#include "spline.h"
+
+#include <chrono>
+#include <cfloat>
+
+
+#define OLD_DIVS_PER_SEG  20    // chords per segment in the old table
+#define REF_STEPS        4000   // Simpson steps per segment for the reference
+#define NUM_EDITS        2000   // control point moves timed
+
+
+double now()
+
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+// The old arc-length table: chord lengths at DIVS_PER_SEG params per
+// segment, searched by bisection and linearly interpolated
+
+class OldTable {
+
+  float *arcLength;
+  int n;
+
+public:
+
+  OldTable( Spline &spline ) {
+
+    n = spline.data.size();
+    arcLength = new float[ n * OLD_DIVS_PER_SEG + 1 ];
+
+    arcLength[0] = 0;
+    vec3 prev = spline.value(0);
+
+    for (int k=1; k<=n*OLD_DIVS_PER_SEG; k++) {
+      vec3 next = spline.value( k / (float) OLD_DIVS_PER_SEG );
+      arcLength[k] = arcLength[k-1] + (next-prev).length();
+      prev = next;
+    }
+  }
+
+  ~OldTable() {
+    delete [] arcLength;
+  }
+
+  OldTable( const OldTable & ) = delete;
+  OldTable & operator = ( const OldTable & ) = delete;
+
+  float total() {
+    return arcLength[ n * OLD_DIVS_PER_SEG ];
+  }
+
+  float paramAtArcLength( float s ) {
+
+    if (s < 0)
+      s += arcLength[ n * OLD_DIVS_PER_SEG ];
+
+    int l = 0;
+    int r = n*OLD_DIVS_PER_SEG;
+
+    while (r-l > 1) {
+      int m = (l+r)/2;
+      if (arcLength[m] <= s)
+        l = m;
+      else
+        r = m;
+    }
+
+    if (arcLength[l] > s || arcLength[l+1] <= s)
+      return (l + 0.5) / (float) OLD_DIVS_PER_SEG;
+
+    float p = (s - arcLength[l]) / (arcLength[l+1] - arcLength[l]);
+
+    return (l+p) / (float) OLD_DIVS_PER_SEG;
+  }
+};
+
+
+// Reference arc length, with segStart[i] the length up to param i
+
+class Reference {
+
+  Spline &spline;
+  double *segStart;
+
+public:
+
+  Reference( Spline &s ) : spline( s ) {
+
+    int n = spline.data.size();
+    segStart = new double[ n+1 ];
+
+    segStart[0] = 0;
+    for (int i=0; i<n; i++)
+      segStart[i+1] = segStart[i] + length( i, 1 );
+  }
+
+  ~Reference() {
+    delete [] segStart;
+  }
+
+  Reference( const Reference & ) = delete;
+  Reference & operator = ( const Reference & ) = delete;
+
+  double total() {
+    return segStart[ spline.data.size() ];
+  }
+
+  // Length of segment i over params [i, i+u]
+
+  double length( int i, double u ) {
+
+    if (u <= 0)
+      return 0;
+
+    int steps = 2 * (int) ceil( 0.5 * REF_STEPS * u );
+    double h = u / steps;
+    double sum = 0;
+
+    for (int k=0; k<=steps; k++) {
+      double w = (k == 0 || k == steps ? 1 : (k % 2 == 1 ? 4 : 2));
+      sum += w * spline.tangent( i + k*h ).length();
+    }
+
+    return sum * h / 3;
+  }
+
+  double at( float t ) {
+    int i = (int) floor( t );
+    return segStart[i] + length( i, t - i );
+  }
+};
+
+
+// Best of 'reps' times of fn(), in ms
+
+template <class F>
+double timeIt( int reps, F fn )
+
+{
+  double best = MAXFLOAT;
+
+  for (int r=0; r<reps; r++) {
+    double t0 = now();
+    fn();
+    best = fmin( best, now() - t0 );
+  }
+
+  return best * 1000;
+}
+
+
+int main( int argc, char **argv )
+
+{
+  int numPoints = 50;
+  int numLookups = 1000000;
+  int reps = 5;
+  int numChecked = 2000;
+
+  if (argc > 1) numPoints = atoi( argv[1] );
+  if (argc > 2) numLookups = atoi( argv[2] );
+  if (argc > 3) reps = atoi( argv[3] );
+
+  // A closed Catmull-Rom spline through random points over a 200x200
+  // terrain
+
+  srand( 12345 );
+
+  Spline spline;
+
+  for (int i=0; i<numPoints; i++)
+    spline.data.add( vec3( 200 * (rand() / (float) RAND_MAX),
+                           200 * (rand() / (float) RAND_MAX),
+                           10 + 40 * (rand() / (float) RAND_MAX) ) );
+  spline.nextCOB();
+  spline.invalidate();
+
+  OldTable oldTable( spline );
+  Reference ref( spline );
+
+  float total = spline.totalArcLength();
+
+  printf( "%s spline, %d control points, length %.3f (reference %.3f, old table %.3f)\n",
+          spline.name(), numPoints, total, ref.total(), oldTable.total() );
+
+  float *s = new float[ numLookups ];
+
+  for (int i=0; i<numLookups; i++)
+    s[i] = total * (rand() / ((float) RAND_MAX + 1));
+
+  // Check the first lookups against the reference
+
+  double maxErr = 0, maxOldErr = 0;
+  double sumErr = 0, sumOldErr = 0;
+  int numOver = 0;
+
+  for (int i=0; i<numChecked && i<numLookups; i++) {
+    float t = spline.paramAtArcLength( s[i] );
+    double err = fabs( ref.at( t ) - s[i] );
+    if (err > spline.arcLengthTolerance() + FLT_EPSILON * (s[i] + t * spline.tangent( t ).length()))
+      numOver++;
+    double oldErr = fabs( ref.at( oldTable.paramAtArcLength( s[i] ) ) - s[i] );
+    maxErr = fmax( maxErr, err );
+    maxOldErr = fmax( maxOldErr, oldErr );
+    sumErr += err;
+    sumOldErr += oldErr;
+  }
+
+  int nc = (numChecked < numLookups ? numChecked : numLookups);
+
+  // Time
+
+  float sink = 0;
+
+  double tOld = timeIt( reps, [&]() {
+    for (int i=0; i<numLookups; i++)
+      sink += oldTable.paramAtArcLength( s[i] );
+  } );
+
+  double tNew = timeIt( reps, [&]() {
+    for (int i=0; i<numLookups; i++)
+      sink += spline.paramAtArcLength( s[i] );
+  } );
+
+  printf( "\n                ns/lookup   max error   mean error   (tolerance %g, %d checked)\n",
+          spline.arcLengthTolerance(), nc );
+  printf( "old table       %8.1f   %9.2g   %9.2g\n", tOld * 1e6 / numLookups, maxOldErr, sumOldErr / nc );
+  printf( "Spline          %8.1f   %9.2g   %9.2g\n", tNew * 1e6 / numLookups, maxErr, sumErr / nc );
+
+  // Time dragging each point in turn up and back down
+
+  double tEdit = timeIt( reps, [&]() {
+    for (int e=0; e<NUM_EDITS; e++) {
+      int j = (e/2) % numPoints;
+      spline.data[j].z += (e & 1 ? -0.5 : 0.5);
+      spline.pointMoved( j );
+      sink += spline.totalArcLength();
+    }
+  } );
+
+  double tDrag = timeIt( reps, [&]() {
+    for (int i=0; i<numLookups; i++)
+      sink += spline.paramAtArcLength( s[i] );
+  } );
+
+  printf( "Spline, edited  %8.1f\n", tDrag * 1e6 / numLookups );
+  printf( "\nedit            %8.1f us per pointMoved() and update\n", tEdit * 1e3 / NUM_EDITS );
+
+  if (sink == 12345)            // keep the loops
+    printf( " " );
+
+  delete [] s;
+
+  bool ok = (numOver == 0);
+
+  if (!ok)
+    printf( "\n%d lookups above the tolerance\n", numOver );
+
+  return !ok;
+}
@@ -0,0 +1,256 @@
+// cull.cpp
+//
+// Headless benchmark of view frustum culling: scatters random spheres
+// and boxes through a cube of the world and times ViewFrustum's
+// cullSpheres() and cullBoxes(), which test four objects at a time,
+// against testing each object with sphereVisible() and boxVisibility(),
+// from a few fixed eyes.  The four-at-a-time results are checked
+// against the one-at-a-time ones.
+//
+// The two sum a plane's terms in different orders, so they may differ
+// for an object that just touches a plane.  An object that is kept by
+// one and not the other fails the check only if it is farther than
+// CULL_TOLERANCE from the plane.
+//
+// The one-at-a-time tests are in viewFrustum.cpp, like the others, so
+// both are timed at the optimisation of the objects linked: build this
+// with 'make buildBench', which links the -O2 objects of bin/opt.
+//
+// Usage: cull [numObjects [reps]]
+
+
+#include "headers.h"
+#include "viewFrustum.h"
+
+#include <chrono>
+
+
+#define WORLD_SIZE      1000    // objects are in [0,WORLD_SIZE]^3
+#define MAX_SIZE        10      // largest radius or box half-size
+#define CULL_TOLERANCE  1e-3    // world units
+
+
+double now()
+
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+// Best of 'reps' times of fn(), in ms
+
+template <class F>
+double timeIt( int reps, F fn )
+
+{
+  double best = MAXFLOAT;
+
+  for (int r=0; r<reps; r++) {
+    double t0 = now();
+    fn();
+    best = fmin( best, now() - t0 );
+  }
+
+  return best * 1000;
+}
+
+
+// The world-to-eye transform of an eye at 'eye' looking at 'target',
+// with z up
+
+mat4 viewFrom( vec3 eye, vec3 target )
+
+{
+  vec3 ahead = (target - eye).normalize();
+  vec3 right = (ahead ^ vec3(0,0,1)).normalize();
+  vec3 up    = right ^ ahead;
+
+  mat4 V = identity4();
+
+  V.rows[0] = vec4(  right.x,  right.y,  right.z, -(right * eye) );
+  V.rows[1] = vec4(     up.x,     up.y,     up.z,    -(up * eye) );
+  V.rows[2] = vec4( -ahead.x, -ahead.y, -ahead.z,  (ahead * eye) );
+
+  return V;
+}
+
+
+// Distance of a sphere or box outside the frustum's nearest plane
+// (negative if it is inside all of them)
+
+float sphereOutside( ViewFrustum &frustum, vec3 centre, float radius )
+
+{
+  float outside = -MAXFLOAT;
+
+  for (int p=0; p<6; p++) {
+    vec4 &n = frustum.planes[p];
+    outside = fmax( outside, -(n.x*centre.x + n.y*centre.y + n.z*centre.z + n.w) - radius );
+  }
+
+  return outside;
+}
+
+
+float boxOutside( ViewFrustum &frustum, vec3 boxMin, vec3 boxMax )
+
+{
+  float outside = -MAXFLOAT;
+
+  for (int p=0; p<6; p++) {
+    vec4 &n = frustum.planes[p];
+    vec3 outer( n.x > 0 ? boxMax.x : boxMin.x, n.y > 0 ? boxMax.y : boxMin.y, n.z > 0 ? boxMax.z : boxMin.z );
+    outside = fmax( outside, -(n.x*outer.x + n.y*outer.y + n.z*outer.z + n.w) );
+  }
+
+  return outside;
+}
+
+
+// Compare two increasing lists of indices.  'outside' gives the
+// distance of object i outside the frustum.  Returns the number of
+// objects in one list and not the other that are not near a plane.
+
+template <class F>
+int compare( seq<int> &a, seq<int> &b, F outside )
+
+{
+  int nFailed = 0;
+  int i = 0, j = 0;
+
+  while (i < a.size() || j < b.size()) {
+
+    if (i < a.size() && j < b.size() && a[i] == b[j]) {
+      i++;
+      j++;
+      continue;
+    }
+
+    int k;
+
+    if (j == b.size() || (i < a.size() && a[i] < b[j]))
+      k = a[i++];
+    else
+      k = b[j++];
+
+    if (fabs( outside( k ) ) > CULL_TOLERANCE)
+      nFailed++;
+  }
+
+  return nFailed;
+}
+
+
+float randIn( float lo, float hi )
+
+{
+  return lo + (hi - lo) * (rand() / (float) RAND_MAX);
+}
+
+
+int main( int argc, char **argv )
+
+{
+  int numObjects = 100000;
+  int reps = 20;
+
+  if (argc > 1) numObjects = atoi( argv[1] );
+  if (argc > 2) reps = atoi( argv[2] );
+
+  srand( 12345 );
+
+  vec3SoA centres( numObjects );
+  float *radii = new float[ numObjects ];
+
+  vec3SoA mins( numObjects );
+  vec3SoA maxs( numObjects );
+
+  for (int i=0; i<numObjects; i++) {
+
+    vec3 c( randIn( 0, WORLD_SIZE ), randIn( 0, WORLD_SIZE ), randIn( 0, WORLD_SIZE ) );
+
+    centres.set( i, c );
+    radii[i] = randIn( 0.1, MAX_SIZE );
+
+    vec3 h( randIn( 0.1, MAX_SIZE ), randIn( 0.1, MAX_SIZE ), randIn( 0.1, MAX_SIZE ) );
+
+    mins.set( i, c - h );
+    maxs.set( i, c + h );
+  }
+
+  vec3 centre( 0.5*WORLD_SIZE, 0.5*WORLD_SIZE, 0.5*WORLD_SIZE );
+
+  struct View {
+    const char *name;
+    vec3 eye, target;
+  } views[] = {
+    { "inside",  centre,                                       centre + vec3( 1, 0.3, 0.1 ) },
+    { "corner",  vec3( 0, 0, 0 ),                              centre },
+    { "outside", centre + WORLD_SIZE * vec3( -1.5, -1.5, 1 ),   centre }
+  };
+
+  int nViews = sizeof(views) / sizeof(views[0]);
+
+  mat4 P = perspective( 45 * M_PI / 180, 4/3.0, 1, 2*WORLD_SIZE );
+
+  seq<int> visible, expected;
+
+  int nFailed = 0;
+
+  printf( "%d spheres and %d boxes in a %d^3 world, best of %d (ms)\n\n", numObjects, numObjects, WORLD_SIZE, reps );
+  printf( "             visible  cullSpheres  sphereVisible         visible  cullBoxes  boxVisibility\n" );
+
+  for (int v=0; v<nViews; v++) {
+
+    ViewFrustum frustum( P * viewFrom( views[v].eye, views[v].target ) );
+
+    // Spheres
+
+    double tSpheres = timeIt( reps, [&]() {
+      frustum.cullSpheres( centres, radii, visible );
+    } );
+
+    double tSphere = timeIt( reps, [&]() {
+      expected.clear();
+      for (int i=0; i<numObjects; i++)
+        if (frustum.sphereVisible( centres[i], radii[i] ))
+          expected.add( i );
+    } );
+
+    int nSpheres = visible.size();
+    int sphereFailed = compare( visible, expected, [&]( int i ) {
+      return sphereOutside( frustum, centres[i], radii[i] );
+    } );
+
+    // Boxes
+
+    double tBoxes = timeIt( reps, [&]() {
+      frustum.cullBoxes( mins, maxs, visible );
+    } );
+
+    double tBox = timeIt( reps, [&]() {
+      expected.clear();
+      for (int i=0; i<numObjects; i++)
+        if (frustum.boxVisibility( mins[i], maxs[i] ) != FRUSTUM_OUTSIDE)
+          expected.add( i );
+    } );
+
+    int nBoxes = visible.size();
+    int boxFailed = compare( visible, expected, [&]( int i ) {
+      return boxOutside( frustum, mins[i], maxs[i] );
+    } );
+
+    printf( "%-10s %8d  %9.3f    %9.3f %5.2fx   %8d  %9.3f    %9.3f %5.2fx\n",
+            views[v].name, nSpheres, tSpheres, tSphere, tSphere / tSpheres,
+            nBoxes, tBoxes, tBox, tBox / tBoxes );
+
+    if (sphereFailed > 0 || boxFailed > 0) {
+      printf( "  %d spheres and %d boxes culled differently\n", sphereFailed, boxFailed );
+      nFailed++;
+    }
+  }
+
+  delete [] radii;
+
+  return (nFailed > 0);
+}
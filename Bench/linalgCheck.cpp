@@ -0,0 +1,418 @@
+// linalgCheck.cpp
+//
+// Checks the mat4 kernels of linalg.cpp against the scalar code that
+// they replaced, and times both.  mat4 * mat4 and mat4 * vec4 must
+// match the old loops exactly.  mat4::inverse() must be within
+// INVERSE_TOLERANCE of an inverse in double precision, as the old
+// Mesa inverse is.
+//
+// The Makefile builds this twice, as linalgCheck with the SIMD
+// backend of simd.h and as linalgCheckScalar with LINALG_NO_SIMD, so
+// that both paths are checked and the speedup of the SIMD one can be
+// read off.  Every backend adds in the same order, so the two print
+// the same checksum of the inverses.
+//
+// Usage: linalgCheck [numMatrices [reps]]
+
+
+#include "headers.h"
+#include "linalg.h"
+#include "simd.h"
+
+#include <chrono>
+
+
+#define INVERSE_TOLERANCE 1e-4  // max error relative to the largest entry of the inverse
+
+
+double now()
+
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+// The scalar code that linalg.cpp had before simd.h
+
+
+mat4 oldProduct( mat4 const& m, mat4 const& n )
+
+{
+  mat4 out;
+
+  for (int i=0; i<4; i++)
+    for (int j=0; j<4; j++) {
+
+      float sum=0;
+
+      for (int k=0; k<4; k++)
+        sum += m[i][k] * n[k][j];
+
+      out[i][j] = sum;
+    }
+
+  return out;
+}
+
+
+vec4 oldTimesVec( mat4 const& m, vec4 const& v )
+
+{
+  vec4 out;
+
+  out[0] = m.rows[0] * v;
+  out[1] = m.rows[1] * v;
+  out[2] = m.rows[2] * v;
+  out[3] = m.rows[3] * v;
+
+  return out;
+}
+
+
+// The inverse by cofactors, from the Mesa OpenGL library, as
+// linalg.cpp had it
+
+
+mat4 oldInverse( mat4 const& M )
+
+{
+  float m[16], invOut[16];
+
+  m[ 0] = M.rows[0].x;
+  m[ 1] = M.rows[1].x;
+  m[ 2] = M.rows[2].x;
+  m[ 3] = M.rows[3].x;
+  m[ 4] = M.rows[0].y;
+  m[ 5] = M.rows[1].y;
+  m[ 6] = M.rows[2].y;
+  m[ 7] = M.rows[3].y;
+  m[ 8] = M.rows[0].z;
+  m[ 9] = M.rows[1].z;
+  m[10] = M.rows[2].z;
+  m[11] = M.rows[3].z;
+  m[12] = M.rows[0].w;
+  m[13] = M.rows[1].w;
+  m[14] = M.rows[2].w;
+  m[15] = M.rows[3].w;
+
+  float inv[16], det;
+  int i;
+
+  inv[0] = m[5]  * m[10] * m[15] -
+    m[5]  * m[11] * m[14] -
+    m[9]  * m[6]  * m[15] +
+    m[9]  * m[7]  * m[14] +
+    m[13] * m[6]  * m[11] -
+    m[13] * m[7]  * m[10];
+
+  inv[4] = -m[4]  * m[10] * m[15] +
+    m[4]  * m[11] * m[14] +
+    m[8]  * m[6]  * m[15] -
+    m[8]  * m[7]  * m[14] -
+    m[12] * m[6]  * m[11] +
+    m[12] * m[7]  * m[10];
+
+  inv[8] = m[4]  * m[9] * m[15] -
+    m[4]  * m[11] * m[13] -
+    m[8]  * m[5] * m[15] +
+    m[8]  * m[7] * m[13] +
+    m[12] * m[5] * m[11] -
+    m[12] * m[7] * m[9];
+
+  inv[12] = -m[4]  * m[9] * m[14] +
+    m[4]  * m[10] * m[13] +
+    m[8]  * m[5] * m[14] -
+    m[8]  * m[6] * m[13] -
+    m[12] * m[5] * m[10] +
+    m[12] * m[6] * m[9];
+
+  inv[1] = -m[1]  * m[10] * m[15] +
+    m[1]  * m[11] * m[14] +
+    m[9]  * m[2] * m[15] -
+    m[9]  * m[3] * m[14] -
+    m[13] * m[2] * m[11] +
+    m[13] * m[3] * m[10];
+
+  inv[5] = m[0]  * m[10] * m[15] -
+    m[0]  * m[11] * m[14] -
+    m[8]  * m[2] * m[15] +
+    m[8]  * m[3] * m[14] +
+    m[12] * m[2] * m[11] -
+    m[12] * m[3] * m[10];
+
+  inv[9] = -m[0]  * m[9] * m[15] +
+    m[0]  * m[11] * m[13] +
+    m[8]  * m[1] * m[15] -
+    m[8]  * m[3] * m[13] -
+    m[12] * m[1] * m[11] +
+    m[12] * m[3] * m[9];
+
+  inv[13] = m[0]  * m[9] * m[14] -
+    m[0]  * m[10] * m[13] -
+    m[8]  * m[1] * m[14] +
+    m[8]  * m[2] * m[13] +
+    m[12] * m[1] * m[10] -
+    m[12] * m[2] * m[9];
+
+  inv[2] = m[1]  * m[6] * m[15] -
+    m[1]  * m[7] * m[14] -
+    m[5]  * m[2] * m[15] +
+    m[5]  * m[3] * m[14] +
+    m[13] * m[2] * m[7] -
+    m[13] * m[3] * m[6];
+
+  inv[6] = -m[0]  * m[6] * m[15] +
+    m[0]  * m[7] * m[14] +
+    m[4]  * m[2] * m[15] -
+    m[4]  * m[3] * m[14] -
+    m[12] * m[2] * m[7] +
+    m[12] * m[3] * m[6];
+
+  inv[10] = m[0]  * m[5] * m[15] -
+    m[0]  * m[7] * m[13] -
+    m[4]  * m[1] * m[15] +
+    m[4]  * m[3] * m[13] +
+    m[12] * m[1] * m[7] -
+    m[12] * m[3] * m[5];
+
+  inv[14] = -m[0]  * m[5] * m[14] +
+    m[0]  * m[6] * m[13] +
+    m[4]  * m[1] * m[14] -
+    m[4]  * m[2] * m[13] -
+    m[12] * m[1] * m[6] +
+    m[12] * m[2] * m[5];
+
+  inv[3] = -m[1] * m[6] * m[11] +
+    m[1] * m[7] * m[10] +
+    m[5] * m[2] * m[11] -
+    m[5] * m[3] * m[10] -
+    m[9] * m[2] * m[7] +
+    m[9] * m[3] * m[6];
+
+  inv[7] = m[0] * m[6] * m[11] -
+    m[0] * m[7] * m[10] -
+    m[4] * m[2] * m[11] +
+    m[4] * m[3] * m[10] +
+    m[8] * m[2] * m[7] -
+    m[8] * m[3] * m[6];
+
+  inv[11] = -m[0] * m[5] * m[11] +
+    m[0] * m[7] * m[9] +
+    m[4] * m[1] * m[11] -
+    m[4] * m[3] * m[9] -
+    m[8] * m[1] * m[7] +
+    m[8] * m[3] * m[5];
+
+  inv[15] = m[0] * m[5] * m[10] -
+    m[0] * m[6] * m[9] -
+    m[4] * m[1] * m[10] +
+    m[4] * m[2] * m[9] +
+    m[8] * m[1] * m[6] -
+    m[8] * m[2] * m[5];
+
+  det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+
+  det = 1.0 / det;
+
+  for (i = 0; i < 16; i++)
+    invOut[i] = inv[i] * det;
+
+  mat4 r;
+
+  r.rows[0] = vec4( invOut[0], invOut[4], invOut[ 8], invOut[12] );
+  r.rows[1] = vec4( invOut[1], invOut[5], invOut[ 9], invOut[13] );
+  r.rows[2] = vec4( invOut[2], invOut[6], invOut[10], invOut[14] );
+  r.rows[3] = vec4( invOut[3], invOut[7], invOut[11], invOut[15] );
+
+  return r;
+}
+
+
+// Inverse in double by Gauss-Jordan elimination with partial pivoting,
+// as the reference for both inverses
+
+
+void doubleInverse( mat4 const& m, double inv[4][4] )
+
+{
+  double a[4][8];
+
+  for (int i=0; i<4; i++)
+    for (int j=0; j<4; j++) {
+      a[i][j] = m[i][j];
+      a[i][j+4] = (i == j);
+    }
+
+  for (int c=0; c<4; c++) {
+
+    int p = c;
+    for (int r=c+1; r<4; r++)
+      if (fabs( a[r][c] ) > fabs( a[p][c] ))
+        p = r;
+
+    for (int j=0; j<8; j++) {
+      double t = a[c][j];
+      a[c][j] = a[p][j];
+      a[p][j] = t;
+    }
+
+    double d = a[c][c];
+    for (int j=0; j<8; j++)
+      a[c][j] /= d;
+
+    for (int r=0; r<4; r++)
+      if (r != c) {
+        double f = a[r][c];
+        for (int j=0; j<8; j++)
+          a[r][j] -= f * a[c][j];
+      }
+  }
+
+  for (int i=0; i<4; i++)
+    for (int j=0; j<4; j++)
+      inv[i][j] = a[i][j+4];
+}
+
+
+// Largest difference from the reference, relative to the reference's
+// largest entry
+
+double inverseError( mat4 const& inv, double ref[4][4] )
+
+{
+  double maxDiff = 0, maxRef = 0;
+
+  for (int i=0; i<4; i++)
+    for (int j=0; j<4; j++) {
+      maxDiff = fmax( maxDiff, fabs( inv[i][j] - ref[i][j] ) );
+      maxRef = fmax( maxRef, fabs( ref[i][j] ) );
+    }
+
+  return maxDiff / maxRef;
+}
+
+
+// A random, well-conditioned matrix: half are rigid transforms with a
+// scale, as a scene graph makes them, and half are random entries
+// plus a multiple of the identity
+
+mat4 randomMatrix( int i )
+
+{
+  if (i % 2 == 0)
+    return translate( 200*randIn01()-100, 200*randIn01()-100, 200*randIn01()-100 )
+         * rotate( 2*M_PI*randIn01(), vec3( randIn01()-0.5, randIn01()-0.5, randIn01()-0.5 ).normalize() )
+         * scale( 0.5+2*randIn01(), 0.5+2*randIn01(), 0.5+2*randIn01() );
+
+  mat4 M;
+  for (int r=0; r<4; r++)
+    for (int c=0; c<4; c++)
+      M[r][c] = 2*randIn01()-1 + (r == c ? 4 : 0);
+
+  return M;
+}
+
+
+// Best of 'reps' times of fn(), in ns per matrix
+
+template <class F>
+double timeIt( int reps, int n, F fn )
+
+{
+  double best = MAXFLOAT;
+
+  for (int r=0; r<reps; r++) {
+    double t0 = now();
+    fn();
+    best = fmin( best, now() - t0 );
+  }
+
+  return best / n * 1e9;
+}
+
+
+int main( int argc, char **argv )
+
+{
+  int n = 100000;
+  int reps = 10;
+
+  if (argc > 1) n = atoi( argv[1] );
+  if (argc > 2) reps = atoi( argv[2] );
+
+  srand( 1 );
+
+  mat4 *A   = new mat4[ n ];
+  mat4 *B   = new mat4[ n ];
+  vec4 *v   = new vec4[ n ];
+  mat4 *out = new mat4[ n ];
+  vec4 *outV = new vec4[ n ];
+
+  for (int i=0; i<n; i++) {
+    A[i] = randomMatrix( i );
+    B[i] = randomMatrix( i+1 );
+    v[i] = vec4( 200*randIn01()-100, 200*randIn01()-100, 200*randIn01()-100, 1 );
+  }
+
+  printf( "%s backend, %d matrices\n\n", LINALG_SIMD_NAME, n );
+
+  // Check
+
+  int productDiffs = 0, vecDiffs = 0, inverseFails = 0;
+  double maxErr = 0, maxOldErr = 0;
+  unsigned int hash = 2166136261u;  // FNV-1a of the inverses' bits
+
+  for (int i=0; i<n; i++) {
+
+    mat4 P = A[i] * B[i];
+    mat4 oldP = oldProduct( A[i], B[i] );
+    if (memcmp( &P, &oldP, sizeof(mat4) ) != 0)
+      productDiffs++;
+
+    vec4 Mv = A[i] * v[i];
+    vec4 oldMv = oldTimesVec( A[i], v[i] );
+    if (memcmp( &Mv, &oldMv, sizeof(vec4) ) != 0)
+      vecDiffs++;
+
+    double ref[4][4];
+    doubleInverse( A[i], ref );
+
+    mat4 inv = A[i].inverse();
+    const unsigned char *bytes = (const unsigned char *) &inv;
+    for (unsigned int k=0; k<sizeof(mat4); k++)
+      hash = (hash ^ bytes[k]) * 16777619u;
+
+    double err = inverseError( inv, ref );
+    maxErr = fmax( maxErr, err );
+    maxOldErr = fmax( maxOldErr, inverseError( oldInverse( A[i] ), ref ) );
+
+    if (!(err <= INVERSE_TOLERANCE))
+      inverseFails++;
+  }
+
+  printf( "mat4 * mat4  %d of %d differ from the old loop\n", productDiffs, n );
+  printf( "mat4 * vec4  %d of %d differ from the old loop\n", vecDiffs, n );
+  printf( "inverse      max error %.2e (old %.2e), %d over %.0e, checksum %08x\n\n", maxErr, maxOldErr, inverseFails, INVERSE_TOLERANCE, hash );
+
+  // Time
+
+  double tOldP = timeIt( reps, n, [&]() { for (int i=0; i<n; i++) out[i] = oldProduct( A[i], B[i] ); } );
+  double tP    = timeIt( reps, n, [&]() { for (int i=0; i<n; i++) out[i] = A[i] * B[i]; } );
+  double tOldV = timeIt( reps, n, [&]() { for (int i=0; i<n; i++) outV[i] = oldTimesVec( A[i], v[i] ); } );
+  double tV    = timeIt( reps, n, [&]() { for (int i=0; i<n; i++) outV[i] = A[i] * v[i]; } );
+  double tOldI = timeIt( reps, n, [&]() { for (int i=0; i<n; i++) out[i] = oldInverse( A[i] ); } );
+  double tI    = timeIt( reps, n, [&]() { for (int i=0; i<n; i++) out[i] = A[i].inverse(); } );
+
+  printf( "               old      now  (ns, best of %d)\n", reps );
+  printf( "mat4 * mat4  %6.1f   %6.1f   %4.2fx\n", tOldP, tP, tOldP / tP );
+  printf( "mat4 * vec4  %6.1f   %6.1f   %4.2fx\n", tOldV, tV, tOldV / tV );
+  printf( "inverse      %6.1f   %6.1f   %4.2fx\n", tOldI, tI, tOldI / tI );
+
+  delete[] A;
+  delete[] B;
+  delete[] v;
+  delete[] out;
+  delete[] outV;
+
+  return (productDiffs + vecDiffs + inverseFails > 0);
+}
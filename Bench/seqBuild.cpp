@@ -0,0 +1,286 @@
+// seqBuild.cpp
+//
+// Headless benchmark of seq<T>: builds the vertices and faces of a
+// Sphere(6) and a Cylinder(2000) with the seq of seq.h and with the
+// seq that it replaced (OldSeq below), and checks that both build the
+// same thing.  The build loops are those of the Sphere and Cylinder
+// constructors, written once for either sequence: the old seq is
+// filled with no reserve(), as it had none, and the new one reserves
+// the final sizes first, as the constructors now do.  The real
+// constructors are timed too, without OpenGL.
+//
+// Usage: seqBuild [sphereLevels [cylinderSlices [reps]]]
+
+
+#include "headers.h"
+#include "seq.h"
+#include "sphere.h"
+#include "cylinder.h"
+
+#include <chrono>
+
+
+double now()
+
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+// The seq that seq.h had before: default-constructed storage, copied
+// element by element when it doubles, and a range check on every
+// access
+
+
+template<class T> class OldSeq {
+
+  int storageSize;
+  int numElements;
+  T  *data;
+
+public:
+
+  OldSeq() {
+    storageSize = 2;
+    numElements = 0;
+    data = new T[ storageSize ];
+  }
+
+  ~OldSeq() {
+    delete [] data;
+  }
+
+  OldSeq( const OldSeq<T> & ) = delete;
+  OldSeq<T> & operator = ( const OldSeq<T> & ) = delete;
+
+  void reserve( int n ) {}      // not in the old seq
+
+  int size() const {
+    return numElements;
+  }
+
+  T & operator [] ( int i ) const {
+    if (i >= numElements || i < 0) {
+      cerr << "element: Tried to access an element beyond the range of the sequence: "
+           << i << "(numElements = " << numElements << ")\n";
+      exit(-1);
+    }
+    return data[ i ];
+  }
+
+  void add( const T &x ) {
+
+    if (numElements == storageSize) {
+      T *newData = new T[ storageSize * 2 ];
+      for (int i=0; i<storageSize; i++)
+        newData[i] = data[i];
+      storageSize = storageSize * 2;
+      delete [] data;
+      data = newData;
+    }
+
+    data[ numElements ] = x;
+    numElements++;
+  }
+};
+
+
+struct Face {
+  unsigned int v[3];
+  Face() {}
+  Face( int v0, int v1, int v2 ) { v[0] = v0; v[1] = v1; v[2] = v2; }
+};
+
+
+// The build of Sphere( numLevels ), with tau and one from sphere.h
+
+template<template<class> class S>
+void buildSphere( int numLevels, S<vec3> &verts, S<Face> &faces )
+
+{
+  static const vec3 icoVerts[12] = {
+    vec3(  tau,  one,    0 ), vec3( -tau,  one,    0 ), vec3( -tau, -one,    0 ), vec3(  tau, -one,    0 ),
+    vec3(  one,    0,  tau ), vec3(  one,    0, -tau ), vec3( -one,    0, -tau ), vec3( -one,    0,  tau ),
+    vec3(    0,  tau,  one ), vec3(    0, -tau,  one ), vec3(    0, -tau, -one ), vec3(    0,  tau, -one )
+  };
+
+  static const int icoFaces[20][3] = {
+    { 4, 8, 7 }, { 4, 7, 9 }, { 5, 6, 11 }, { 5, 10, 6 }, { 0, 4, 3 }, { 0, 3, 5 }, { 2, 7, 1 }, { 2, 1, 6 },
+    { 8, 0, 11 }, { 8, 11, 1 }, { 9, 10, 3 }, { 9, 2, 10 }, { 8, 4, 0 }, { 11, 0, 5 }, { 4, 9, 3 }, { 5, 3, 10 },
+    { 7, 8, 1 }, { 6, 1, 11 }, { 7, 2, 9 }, { 6, 10, 2 }
+  };
+
+  int finalFaces = 20 << (2*numLevels);
+
+  faces.reserve( finalFaces );
+  verts.reserve( 12 + (finalFaces - 20) );
+
+  for (int i=0; i<12; i++)
+    verts.add( icoVerts[i].normalize() );
+
+  for (int i=0; i<20; i++)
+    faces.add( Face( icoFaces[i][0], icoFaces[i][1], icoFaces[i][2] ) );
+
+  for (int l=0; l<numLevels; l++) {
+
+    int n = faces.size();
+
+    for (int i=0; i<n; i++) {
+
+      Face f = faces[i];
+
+      verts.add( (verts[ f.v[0] ] + verts[ f.v[1] ]).normalize() );
+      verts.add( (verts[ f.v[1] ] + verts[ f.v[2] ]).normalize() );
+      verts.add( (verts[ f.v[2] ] + verts[ f.v[0] ]).normalize() );
+
+      int v01 = verts.size() - 3;
+      int v12 = verts.size() - 2;
+      int v20 = verts.size() - 1;
+
+      faces.add( Face( f.v[0], v01, v20 ) );
+      faces.add( Face( f.v[1], v12, v01 ) );
+      faces.add( Face( f.v[2], v20, v12 ) );
+
+      faces[i].v[0] = v01;
+      faces[i].v[1] = v12;
+      faces[i].v[2] = v20;
+    }
+  }
+}
+
+
+// The build of Cylinder( numSlices )
+
+template<template<class> class S>
+void buildCylinder( int numSlices, S<vec3> &verts, S<vec3> &normals, S<Face> &faces )
+
+{
+  verts.reserve( 4*numSlices + 2 );
+  normals.reserve( 4*numSlices + 2 );
+  faces.reserve( 4*numSlices );
+
+  for (int end=0; end<2; end++) {
+
+    float z = (end == 0 ? -0.5 : 0.5);
+    int base = end * (numSlices+1);
+
+    verts.add( vec3( 0, 0, z ) );
+    normals.add( vec3( 0, 0, 2*z ) );
+    for (int i=0; i<numSlices; i++) {
+      float theta = i/(float)numSlices*2*M_PI;
+      verts.add( vec3( cos(theta), sin(theta), z ) );
+      normals.add( vec3( 0, 0, 2*z ) );
+    }
+
+    for (int i=0; i<numSlices; i++)
+      if (end == 0)
+        faces.add( Face( (i+1) % numSlices, i, 0 ) );
+      else
+        faces.add( Face( i + base, (i+1) % base + base, base ) );
+  }
+
+  int baseIndex = 2*(numSlices+1);
+
+  for (int end=0; end<2; end++)
+    for (int i=0; i<numSlices; i++) {
+      float theta = i/(float)numSlices*2*M_PI;
+      verts.add( vec3( cos(theta), sin(theta), (end == 0 ? -0.5 : 0.5) ) );
+      normals.add( vec3( cos(theta), sin(theta), 0 ) );
+    }
+
+  for (int i=0; i<numSlices; i++) {
+    faces.add( Face( baseIndex + i, baseIndex + (i+1) % numSlices, baseIndex + (i+1) % numSlices + numSlices ) );
+    faces.add( Face( baseIndex + (i+1) % numSlices + numSlices, baseIndex + i + numSlices, baseIndex + i ) );
+  }
+}
+
+
+template<template<class> class A, template<class> class B, class T>
+bool same( A<T> const& a, B<T> const& b )
+
+{
+  if (a.size() != b.size())
+    return false;
+
+  for (int i=0; i<a.size(); i++)
+    if (memcmp( &a[i], &b[i], sizeof(T) ) != 0)
+      return false;
+
+  return true;
+}
+
+
+// Best of 'reps' times of fn(), in ms
+
+template <class F>
+double timeIt( int reps, F fn )
+
+{
+  double best = MAXFLOAT;
+
+  for (int r=0; r<reps; r++) {
+    double t0 = now();
+    fn();
+    best = fmin( best, now() - t0 );
+  }
+
+  return best * 1000;
+}
+
+
+int main( int argc, char **argv )
+
+{
+  int levels = 6;
+  int slices = 2000;
+  int reps = 10;
+
+  if (argc > 1) levels = atoi( argv[1] );
+  if (argc > 2) slices = atoi( argv[2] );
+  if (argc > 3) reps = atoi( argv[3] );
+
+  // Check
+
+  bool ok = true;
+
+  {
+    OldSeq<vec3> oldVerts;  OldSeq<Face> oldFaces;
+    seq<vec3>    verts;     seq<Face>    faces;
+
+    buildSphere( levels, oldVerts, oldFaces );
+    buildSphere( levels, verts, faces );
+
+    bool sameSphere = same( oldVerts, verts ) && same( oldFaces, faces );
+    printf( "Sphere(%d): %d vertices, %d faces, %s\n", levels, verts.size(), faces.size(), (sameSphere ? "same" : "DIFFERENT") );
+    ok = ok && sameSphere;
+  }
+
+  {
+    OldSeq<vec3> oldVerts, oldNormals;  OldSeq<Face> oldFaces;
+    seq<vec3>    verts,    normals;     seq<Face>    faces;
+
+    buildCylinder( slices, oldVerts, oldNormals, oldFaces );
+    buildCylinder( slices, verts, normals, faces );
+
+    bool sameCylinder = same( oldVerts, verts ) && same( oldNormals, normals ) && same( oldFaces, faces );
+    printf( "Cylinder(%d): %d vertices, %d faces, %s\n\n", slices, verts.size(), faces.size(), (sameCylinder ? "same" : "DIFFERENT") );
+    ok = ok && sameCylinder;
+  }
+
+  // Time
+
+  double tOld   = timeIt( reps, [&]() { OldSeq<vec3> v; OldSeq<Face> f; buildSphere( levels, v, f ); } );
+  double tNew   = timeIt( reps, [&]() { seq<vec3> v; seq<Face> f; buildSphere( levels, v, f ); } );
+  double tClass = timeIt( reps, [&]() { Sphere s( levels, false ); } );
+
+  printf( "                old seq      seq           Sphere/Cylinder   (ms, best of %d)\n", reps );
+  printf( "Sphere(%d)     %8.3f %8.3f   %5.2fx   %8.3f\n", levels, tOld, tNew, tOld / tNew, tClass );
+
+  tOld   = timeIt( reps, [&]() { OldSeq<vec3> v, n; OldSeq<Face> f; buildCylinder( slices, v, n, f ); } );
+  tNew   = timeIt( reps, [&]() { seq<vec3> v, n; seq<Face> f; buildCylinder( slices, v, n, f ); } );
+  tClass = timeIt( reps, [&]() { Cylinder c( slices, false ); } );
+
+  printf( "Cylinder(%-4d) %8.3f %8.3f   %5.2fx   %8.3f\n", slices, tOld, tNew, tOld / tNew, tClass );
+
+  return !ok;
+}
@@ -0,0 +1,153 @@
+// softRender.cpp
+//
+// Headless benchmark of the software rasterizer (see softRaster.h),
+// which also writes the reference image of a fixed view: the terrain,
+// looked at from above one corner, with a cylinder, a sphere and a cube
+// standing on it.  Nothing is given to OpenGL.  The frame is drawn with
+// thread pools of 1, 2, 4, ... up to the number of cores (or
+// maxThreads), and every frame is checked to be the same as the first.
+//
+// Usage: softRender [out.png [WxH [maxThreads [reps]]]]
+
+
+#include "headers.h"
+#include "threadPool.h"
+#include "softRaster.h"
+#include "terrain.h"
+#include "cylinder.h"
+#include "sphere.h"
+#include "cube.h"
+
+#include <chrono>
+#include <vector>
+
+
+double now()
+
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+// The world-to-eye transform of an eye at 'eye' looking at 'target',
+// with z up
+
+mat4 viewFrom( vec3 eye, vec3 target )
+
+{
+  vec3 ahead = (target - eye).normalize();
+  vec3 right = (ahead ^ vec3(0,0,1)).normalize();
+  vec3 up    = right ^ ahead;
+
+  mat4 V = identity4();
+
+  V.rows[0] = vec4(  right.x,  right.y,  right.z, -(right * eye) );
+  V.rows[1] = vec4(     up.x,     up.y,     up.z,    -(up * eye) );
+  V.rows[2] = vec4( -ahead.x, -ahead.y, -ahead.z,  (ahead * eye) );
+
+  return V;
+}
+
+
+int main( int argc, char **argv )
+
+{
+  const char *outFilename = "softRender.png";
+  int width = 800, height = 600;
+  int maxThreads = std::thread::hardware_concurrency();
+  int reps = 5;
+
+  if (argc > 1) outFilename = argv[1];
+  if (argc > 2 && sscanf( argv[2], "%dx%d", &width, &height ) != 2) {
+    cerr << "Usage: " << argv[0] << " [out.png [WxH [maxThreads [reps]]]]" << endl;
+    exit(1);
+  }
+  if (argc > 3) maxThreads = atoi( argv[3] );
+  if (argc > 4) reps = atoi( argv[4] );
+
+  if (maxThreads < 1)
+    maxThreads = 1;
+
+  // The scene, without OpenGL
+
+  Terrain  terrain( "Rollercoaster/Textures", "hills-heights.png", "hills-texture.png", false );
+  Cylinder cylinder( 200, false );
+  Sphere   sphere( 4, false );
+  Cube     cube( false );
+
+  int w = terrain.heightfield->width;
+  int h = terrain.heightfield->height;
+
+  vec3 centre( (w-1)/2.0, (h-1)/2.0, 0 );
+  centre.z = terrain.heightAt( centre.x, centre.y );
+
+  mat4 V = viewFrom( centre + vec3( -60, -60, 50 ), centre + vec3( 0, 0, 15 ) );
+  mat4 P = perspective( 45 * M_PI / 180, width / (float) height, 1, 3*w );
+
+  mat4 cylinderM = translate( centre + vec3(  0,  0, 15 ) ) * scale( 8, 8, 20 );
+  mat4 sphereM   = translate( centre + vec3( 15,  5, 20 ) ) * scale( 6, 6, 6 );
+  mat4 cubeM     = translate( centre + vec3( -5, 15, 20 ) ) * scale( 10, 10, 10 );
+
+  vec3 lightDir = vec3( 1, 1, 2 ).normalize();
+
+  printf( "%dx%d, best of %d, %d cores\n\n", width, height, reps, (int) std::thread::hardware_concurrency() );
+
+  // Thread counts 1, 2, 4, ... and maxThreads
+
+  std::vector<int> counts;
+  for (int t=1; t<maxThreads; t*=2)
+    counts.push_back( t );
+  counts.push_back( maxThreads );
+
+  std::vector<unsigned char> reference;
+  double base = 0;
+  int failures = 0;
+
+  for (unsigned int c=0; c<counts.size(); c++) {
+
+    ThreadPool pool( counts[c] );
+    SoftRaster raster( width, height, pool );
+
+    double best = MAXFLOAT;
+
+    for (int r=0; r<reps; r++) {
+
+      double t0 = now();
+
+      raster.clear( vec3( 0.2, 0.3, 0.5 ) );
+
+      mat4 VP = P * V;
+      terrain.drawSoft( raster, V, VP, lightDir, false );
+
+      mat4 MV = V * cylinderM;
+      mat4 MVP = P * MV;
+      cylinder.drawSoft( raster, MV, MVP, lightDir, vec3( 0.9, 0.2, 0.1 ) );
+
+      MV = V * sphereM;
+      MVP = P * MV;
+      sphere.drawSoft( raster, MV, MVP, lightDir, vec3( 0.2, 0.9, 0.1 ) );
+
+      MV = V * cubeM;
+      MVP = P * MV;
+      cube.drawSoft( raster, MV, MVP, lightDir, vec3( 0.2, 0.2, 0.9 ) );
+
+      best = fmin( best, now() - t0 );
+    }
+
+    if (c == 0) {
+      base = best;
+      reference.assign( raster.pixels(), raster.pixels() + width*height*4 );
+      raster.writePNG( outFilename );
+    }
+
+    bool same = (memcmp( reference.data(), raster.pixels(), width*height*4 ) == 0);
+    if (!same)
+      failures++;
+
+    printf( "%2d threads %9.1f ms %5.2fx   %s\n", counts[c], best*1000, base / best, (same ? "same" : "DIFFERS") );
+  }
+
+  printf( "\nwrote %s\n", outFilename );
+
+  return (failures > 0);
+}
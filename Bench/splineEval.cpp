@@ -0,0 +1,223 @@
+// splineEval.cpp
+//
+// Headless benchmark of Spline::eval: evaluates a closed spline through
+// random control points at 1M random parameters, with value() and
+// tangent() and with evalBatch() over the sorted parameters, in each of
+// the three bases.  Every value and tangent is checked against the
+// eval that spline.cpp used to have (oldEval below), which rebuilt the
+// basis and control-point matrices and called pow() for every sample.
+//
+// Usage: splineEval [numPoints [numParams [reps]]]
+
+
+#include "headers.h"
+#include "spline.h"
+
+#include <chrono>
+#include <algorithm>
+
+
+#define MAX_EVAL_ERROR 5e-5     // relative to 1 + |old value|
+
+
+double now()
+
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+// The change-of-basis matrices of spline.cpp, in the same order
+
+float basis[][4][4] = {
+
+  { { 0, 0, 0, 0},              // Linear
+    { 0, 0, 0, 0},
+    { 0,-1, 1, 0},
+    { 0, 1, 0, 0}, },
+
+  { { -0.5,  1.5, -1.5,  0.5 }, // Catmull-Rom
+    {  1.0, -2.5,  2.0, -0.5 },
+    { -0.5,  0.0,  0.5,  0.0 },
+    {  0.0,  1.0,  0.0,  0.0 } },
+
+  { { -0.1667, 0.5,   -0.5,    0.1667 }, // B-spline
+    {  0.5,   -1.0,    0.5,    0.0    },
+    { -0.5,    0.0,    0.5,    0.0    },
+    {  0.1667, 0.6667, 0.1667, 0.0    } }
+};
+
+
+// Spline::eval as it was before the coefficients were cached
+
+vec3 oldEval( seq<vec3> &data, float (*M)[4], float t, evalType type )
+
+{
+  if (t >= data.size())
+    t = t - data.size();
+  if (t < 0)
+    t = t + data.size();
+  float u = t - floor(t);
+
+  vec3 qim1;
+  if (floor(t) == 0)
+    qim1 = data[data.size() - 1];
+  else
+    qim1 = data[floor(t) - 1];
+  vec3 qi = data[floor(t)];
+  vec3 qip1 = data[(int(floor(t)) + 1) % data.size()];
+  vec3 qip2 = data[(int(floor(t)) + 2) % data.size()];
+
+  mat4 v;
+  v.rows[0] = vec4(qim1, 0);
+  v.rows[1] = vec4(qi, 0);
+  v.rows[2] = vec4(qip1, 0);
+  v.rows[3] = vec4(qip2, 0);
+
+  mat4 M2;
+  M2.rows[0] = vec4(M[0][0], M[0][1], M[0][2], M[0][3]);
+  M2.rows[1] = vec4(M[1][0], M[1][1], M[1][2], M[1][3]);
+  M2.rows[2] = vec4(M[2][0], M[2][1], M[2][2], M[2][3]);
+  M2.rows[3] = vec4(M[3][0], M[3][1], M[3][2], M[3][3]);
+
+  mat4 Mv = M2 * v;
+  vec4 T = vec4(pow(u, 3), pow(u, 2), u, 1);
+  vec4 Tprime = vec4(3 * pow(u, 2), 2 * u, 1, 0);
+  vec3 result;
+
+  if (type == VALUE) {
+    result.x = T.x * Mv[0][0] + T.y * Mv[1][0] + T.z * Mv[2][0] + T.w * Mv[3][0];
+    result.y = T.x * Mv[0][1] + T.y * Mv[1][1] + T.z * Mv[2][1] + T.w * Mv[3][1];
+    result.z = T.x * Mv[0][2] + T.y * Mv[1][2] + T.z * Mv[2][2] + T.w * Mv[3][2];
+  }
+
+  if (type == TANGENT) {
+    result.x = Tprime.x * Mv[0][0] + Tprime.y * Mv[1][0] + Tprime.z * Mv[2][0] + Tprime.w * Mv[3][0];
+    result.y = Tprime.x * Mv[0][1] + Tprime.y * Mv[1][1] + Tprime.z * Mv[2][1] + Tprime.w * Mv[3][1];
+    result.z = Tprime.x * Mv[0][2] + Tprime.y * Mv[1][2] + Tprime.z * Mv[2][2] + Tprime.w * Mv[3][2];
+  }
+
+  return result;
+}
+
+
+float relError( vec3 a, vec3 ref )
+
+{
+  return (a - ref).length() / (1 + ref.length());
+}
+
+
+// Best of 'reps' times of fn(), in ms
+
+template <class F>
+double timeIt( int reps, F fn )
+
+{
+  double best = MAXFLOAT;
+
+  for (int r=0; r<reps; r++) {
+    double t0 = now();
+    fn();
+    best = fmin( best, now() - t0 );
+  }
+
+  return best * 1000;
+}
+
+
+int main( int argc, char **argv )
+
+{
+  int numPoints = 50;
+  int numParams = 1000000;
+  int reps = 5;
+
+  if (argc > 1) numPoints = atoi( argv[1] );
+  if (argc > 2) numParams = atoi( argv[2] );
+  if (argc > 3) reps = atoi( argv[3] );
+
+  // A closed spline through random points over a 200x200 terrain
+
+  srand( 12345 );
+
+  Spline spline;
+
+  for (int i=0; i<numPoints; i++)
+    spline.data.add( vec3( 200 * (rand() / (float) RAND_MAX),
+                           200 * (rand() / (float) RAND_MAX),
+                           10 + 40 * (rand() / (float) RAND_MAX) ) );
+  spline.invalidate();
+
+  float *t = new float[ numParams ];
+  float *sorted = new float[ numParams ];
+  vec3 *values = new vec3[ numParams ];
+  vec3 *tangents = new vec3[ numParams ];
+
+  for (int i=0; i<numParams; i++)
+    t[i] = numPoints * (rand() / ((float) RAND_MAX + 1));
+
+  for (int i=0; i<numParams; i++)
+    sorted[i] = t[i];
+  std::sort( sorted, sorted + numParams );
+
+  printf( "%d control points, %d params, best of %d (ms)\n\n", numPoints, numParams, reps );
+  printf( "                old eval    value()  tangent()  evalBatch   max error\n" );
+
+  bool ok = true;
+  vec3 sink(0,0,0);
+
+  for (int b=0; b<3; b++) {
+
+    // Check
+
+    float maxErr = 0;
+
+    spline.evalBatch( sorted, numParams, values, tangents );
+
+    for (int i=0; i<numParams; i++) {
+      maxErr = fmax( maxErr, relError( spline.value( t[i] ), oldEval( spline.data, basis[b], t[i], VALUE ) ) );
+      maxErr = fmax( maxErr, relError( spline.tangent( t[i] ), oldEval( spline.data, basis[b], t[i], TANGENT ) ) );
+      maxErr = fmax( maxErr, relError( values[i], oldEval( spline.data, basis[b], sorted[i], VALUE ) ) );
+      maxErr = fmax( maxErr, relError( tangents[i], oldEval( spline.data, basis[b], sorted[i], TANGENT ) ) );
+    }
+
+    // Time
+
+    double tOld = timeIt( reps, [&]() {
+      for (int i=0; i<numParams; i++)
+        sink = sink + oldEval( spline.data, basis[b], t[i], VALUE );
+    } );
+
+    double tValue = timeIt( reps, [&]() {
+      for (int i=0; i<numParams; i++)
+        sink = sink + spline.value( t[i] );
+    } );
+
+    double tTangent = timeIt( reps, [&]() {
+      for (int i=0; i<numParams; i++)
+        sink = sink + spline.tangent( t[i] );
+    } );
+
+    double tBatch = timeIt( reps, [&]() {
+      spline.evalBatch( sorted, numParams, values, tangents );
+    } );
+
+    printf( "%-12s   %9.2f  %9.2f  %9.2f  %9.2f   %.2g %s\n",
+            spline.name(), tOld, tValue, tTangent, tBatch, maxErr, (maxErr <= MAX_EVAL_ERROR ? "" : "TOO LARGE") );
+
+    ok = ok && (maxErr <= MAX_EVAL_ERROR);
+
+    spline.nextCOB();
+  }
+
+  if (sink.x == 12345)          // keep the loops
+    printf( " " );
+
+  delete [] t;
+  delete [] sorted;
+  delete [] values;
+  delete [] tangents;
+
+  return !ok;
+}
@@ -0,0 +1,140 @@
+// terrainLoad.cpp
+//
+// Headless benchmark of the CPU half of loading the terrain: decoding
+// the two images, building the heights and normals, cutting the chunks,
+// and filling the vertex buffer.  Each phase is timed with thread pools
+// of 1, 2, 4, ... up to the number of cores (or maxThreads), and the
+// speedup over one thread is reported.
+//
+// Usage: terrainLoad [heightfield.png [texture.png [maxThreads [reps]]]]
+
+
+#include "headers.h"
+#include "lodepng.h"
+#include "threadPool.h"
+#include "heightMap.h"
+#include "terrainChunks.h"
+
+#include <chrono>
+#include <vector>
+
+
+#define NUM_PHASES 5
+
+const char *phaseNames[NUM_PHASES] = { "decode", "heights+normals", "chunks", "vertices", "total" };
+
+
+double now()
+
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+// Time each phase once with 'pool', in seconds
+
+void loadOnce( ThreadPool &pool, const char *filenames[2], double times[NUM_PHASES] )
+
+{
+  double t0 = now();
+
+  std::vector<unsigned char> images[2];
+  unsigned int widths[2], heights[2];
+
+  pool.parallelFor( 0, 2, 1, [&]( int i0, int i1 ) {
+    for (int i=i0; i<i1; i++) {
+      unsigned error = lodepng::decode( images[i], widths[i], heights[i], filenames[i] );
+      if (error) {
+        cerr << "Error loading '" << filenames[i] << "': " << lodepng_error_text(error) << endl;
+        exit(1);
+      }
+    }
+  } );
+
+  double t1 = now();
+
+  HeightMap map;
+  map.build( images[0].data(), 4, widths[0], heights[0], 0.1*widths[0], pool );
+
+  double t2 = now();
+
+  TerrainChunks chunks;
+  chunks.build( map.width, map.height, map.heights, pool );
+
+  double t3 = now();
+
+  float *vertices = new float[ chunks.chunks.size() * TerrainChunks::vertsPerChunk() * 8 ];
+  chunks.buildVertices( map.heights, map.normals, vertices, pool );
+
+  double t4 = now();
+
+  delete[] vertices;
+
+  times[0] = t1-t0;
+  times[1] = t2-t1;
+  times[2] = t3-t2;
+  times[3] = t4-t3;
+  times[4] = t4-t0;
+}
+
+
+int main( int argc, char **argv )
+
+{
+  const char *filenames[2] = { "Rollercoaster/Textures/hills-heights.png",
+                               "Rollercoaster/Textures/hills-texture.png" };
+
+  int maxThreads = std::thread::hardware_concurrency();
+  int reps = 5;
+
+  if (argc > 1) filenames[0] = argv[1];
+  if (argc > 2) filenames[1] = argv[2];
+  if (argc > 3) maxThreads = atoi( argv[3] );
+  if (argc > 4) reps = atoi( argv[4] );
+
+  if (maxThreads < 1)
+    maxThreads = 1;
+
+  // Thread counts 1, 2, 4, ... and maxThreads
+
+  std::vector<int> counts;
+  for (int t=1; t<maxThreads; t*=2)
+    counts.push_back( t );
+  counts.push_back( maxThreads );
+
+  printf( "%s and %s, best of %d, %d cores\n\n", filenames[0], filenames[1], reps, (int) std::thread::hardware_concurrency() );
+
+  printf( "%-8s", "threads" );
+  for (int p=0; p<NUM_PHASES; p++)
+    printf( " %17s", phaseNames[p] );
+  printf( "\n" );
+
+  double base[NUM_PHASES];
+
+  for (unsigned int c=0; c<counts.size(); c++) {
+
+    ThreadPool pool( counts[c] );
+
+    double best[NUM_PHASES];
+    for (int p=0; p<NUM_PHASES; p++)
+      best[p] = MAXFLOAT;
+
+    for (int r=0; r<reps; r++) {
+      double times[NUM_PHASES];
+      loadOnce( pool, filenames, times );
+      for (int p=0; p<NUM_PHASES; p++)
+        best[p] = fmin( best[p], times[p] );
+    }
+
+    if (c == 0)
+      for (int p=0; p<NUM_PHASES; p++)
+        base[p] = best[p];
+
+    printf( "%-8d", counts[c] );
+    for (int p=0; p<NUM_PHASES; p++)
+      printf( " %9.1f ms %4.2fx", best[p]*1000, base[p] / best[p] );
+    printf( "\n" );
+  }
+
+  return 0;
+}
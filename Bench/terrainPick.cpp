@@ -0,0 +1,159 @@
+// terrainPick.cpp
+//
+// Headless benchmark of picking on the terrain: casts random rays, as
+// from a mouse, at the heightfield with HeightMap::intersectRay() and
+// reports rays per second.  Rays come from eyes scattered over a
+// hemisphere around the terrain and aim at random points on it.  The
+// first few rays are checked against a brute-force test of every quad.
+//
+// Usage: terrainPick [heightfield.png [numRays [numChecked]]]
+
+
+#include "headers.h"
+#include "lodepng.h"
+#include "heightMap.h"
+
+#include <chrono>
+#include <vector>
+
+
+double now()
+
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+// Nearest hit of a ray over all triangles, by the ray/plane and
+// barycentric test that the terrain used to have
+
+bool bruteForce( HeightMap &map, vec3 start, vec3 dir, float &nearest )
+
+{
+  nearest = MAXFLOAT;
+
+  for (int y=0; y<map.height-1; y++)
+    for (int x=0; x<map.width-1; x++) {
+
+      vec3 ll = map.point( x, y ),   lr = map.point( x+1, y );
+      vec3 ul = map.point( x, y+1 ), ur = map.point( x+1, y+1 );
+
+      vec3 tris[2][3] = { { ll, lr, ul }, { ul, lr, ur } };
+
+      for (int k=0; k<2; k++) {
+
+        vec3 v0 = tris[k][0], v1 = tris[k][1], v2 = tris[k][2];
+        vec3 normal = (v1-v0) ^ (v2-v0);
+
+        float dn = dir * normal;
+        if (dn == 0)
+          continue;
+
+        float t = (v0*normal - start*normal) / dn;
+        if (t < 0 || t >= nearest)
+          continue;
+
+        vec3 p = start + t * dir;
+        float area = normal * normal;
+        float u = (((v2-v1) ^ (p-v1)) * normal) / area;
+        float v = (((v0-v2) ^ (p-v2)) * normal) / area;
+
+        if (u >= -1e-5 && v >= -1e-5 && u+v <= 1+1e-5)
+          nearest = t;
+      }
+    }
+
+  return nearest < MAXFLOAT;
+}
+
+
+int main( int argc, char **argv )
+
+{
+  const char *filename = "Rollercoaster/Textures/hills-heights.png";
+  int nRays = 1000000;
+  int nChecked = 200;
+
+  if (argc > 1) filename = argv[1];
+  if (argc > 2) nRays = atoi( argv[2] );
+  if (argc > 3) nChecked = atoi( argv[3] );
+
+  std::vector<unsigned char> image;
+  unsigned int w, h;
+
+  unsigned error = lodepng::decode( image, w, h, filename );
+  if (error) {
+    cerr << "Error loading '" << filename << "': " << lodepng_error_text(error) << endl;
+    exit(1);
+  }
+
+  HeightMap map;
+  map.build( image.data(), 4, w, h, 0.1*w );
+
+  // Random picking rays
+
+  srand( 1 );
+
+  vec3 *starts = new vec3[ nRays ];
+  vec3 *dirs   = new vec3[ nRays ];
+
+  vec3 centre( (w-1)/2.0, (h-1)/2.0, 0 );
+
+  for (int i=0; i<nRays; i++) {
+
+    float azimuth   = 2 * M_PI * randIn01();
+    float elevation = (15 + 65 * randIn01()) * M_PI / 180;
+    float dist      = (0.8 + 1.2 * randIn01()) * w;
+
+    starts[i] = centre + dist * vec3( cos(elevation)*cos(azimuth), cos(elevation)*sin(azimuth), sin(elevation) );
+
+    vec3 target( randIn01() * (w-1), randIn01() * (h-1), 0 );
+    target.z = map.point( rint( target.x ), rint( target.y ) ).z;
+
+    dirs[i] = (target - starts[i]).normalize();
+  }
+
+  // Time the rays
+
+  int nHits = 0;
+  double sumT = 0;
+
+  double t0 = now();
+
+  for (int i=0; i<nRays; i++) {
+    vec3 hit;
+    float t;
+    if (map.intersectRay( starts[i], dirs[i], hit, t )) {
+      nHits++;
+      sumT += t;
+    }
+  }
+
+  double elapsed = now() - t0;
+
+  printf( "%s (%dx%d): %d rays in %.1f ms, %.2f Mrays/s, %.0f ns/ray, %d hits (mean distance %.1f)\n",
+          filename, w, h, nRays, elapsed*1000, nRays / elapsed / 1e6, elapsed / nRays * 1e9, nHits, sumT / nHits );
+
+  // Check the first rays
+
+  int mismatches = 0;
+
+  for (int i=0; i<nChecked && i<nRays; i++) {
+
+    vec3 hit;
+    float t, nearest;
+
+    bool found = map.intersectRay( starts[i], dirs[i], hit, t );
+    bool expected = bruteForce( map, starts[i], dirs[i], nearest );
+
+    if (found != expected || (found && fabs( t - nearest ) > 1e-3 * nearest))
+      mismatches++;
+  }
+
+  printf( "%d of %d rays differ from brute force\n", mismatches, nChecked );
+
+  delete[] starts;
+  delete[] dirs;
+
+  return (mismatches > 0);
+}
@@ -0,0 +1,195 @@
+// terrainRays.cpp
+//
+// Headless throughput benchmark of casting many rays at the terrain:
+// HeightMap::intersectRay() one ray at a time, against
+// HeightMap::intersectRays() in SIMD packets with thread pools of 1, 2,
+// 4, ... up to the number of cores (or maxThreads).  There are two sets
+// of rays: the random picking rays of terrainPick, and the coherent rays
+// of a view from a single eye, one per pixel.  Every packet result is
+// checked against the single-ray one.
+//
+// Usage: terrainRays [heightfield.png [numRays [maxThreads [reps]]]]
+
+
+#include "headers.h"
+#include "lodepng.h"
+#include "threadPool.h"
+#include "heightMap.h"
+
+#include <chrono>
+#include <vector>
+
+
+double now()
+
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+// Time both paths on one set of rays and return the number of packet
+// results that differ from the single-ray ones
+
+int timeRays( HeightMap &map, const char *name, vec3 *starts, vec3 *dirs, int nRays, int maxThreads, int reps )
+
+{
+  vec3  *hits     = new vec3[ nRays ];
+  vec3  *normals  = new vec3[ nRays ];
+  float *dists    = new float[ nRays ];
+  float *expected = new float[ nRays ];
+
+  printf( "%s: %d rays\n", name, nRays );
+
+  // One ray at a time
+
+  double best = MAXFLOAT;
+  int nHits = 0;
+
+  for (int r=0; r<reps; r++) {
+
+    nHits = 0;
+    double t0 = now();
+
+    for (int i=0; i<nRays; i++) {
+      vec3 hit;
+      float t;
+      if (map.intersectRay( starts[i], dirs[i], hit, t )) {
+        expected[i] = t;
+        nHits++;
+      } else
+        expected[i] = MAXFLOAT;
+    }
+
+    best = fmin( best, now() - t0 );
+  }
+
+  double base = best;
+
+  printf( "  %-16s %9.1f ms %7.2f Mrays/s %5.2fx   %d hits\n", "intersectRay", best*1000, nRays / best / 1e6, 1.0, nHits );
+
+  // Packets, with 1, 2, 4, ... and maxThreads
+
+  std::vector<int> counts;
+  for (int t=1; t<maxThreads; t*=2)
+    counts.push_back( t );
+  counts.push_back( maxThreads );
+
+  int failures = 0;
+
+  for (unsigned int c=0; c<counts.size(); c++) {
+
+    ThreadPool pool( counts[c] );
+
+    best = MAXFLOAT;
+
+    for (int r=0; r<reps; r++) {
+      double t0 = now();
+      nHits = map.intersectRays( starts, dirs, nRays, hits, normals, dists, pool );
+      best = fmin( best, now() - t0 );
+    }
+
+    int mismatches = 0;
+    for (int i=0; i<nRays; i++)
+      if (dists[i] != expected[i])
+        mismatches++;
+
+    failures += mismatches;
+
+    char label[32];
+    sprintf( label, "intersectRays/%d", counts[c] );
+
+    printf( "  %-16s %9.1f ms %7.2f Mrays/s %5.2fx   %d hits, %d differ\n", label, best*1000, nRays / best / 1e6, base / best, nHits, mismatches );
+  }
+
+  printf( "\n" );
+
+  delete[] hits;
+  delete[] normals;
+  delete[] dists;
+  delete[] expected;
+
+  return failures;
+}
+
+
+int main( int argc, char **argv )
+
+{
+  const char *filename = "Rollercoaster/Textures/hills-heights.png";
+  int nRays = 1000000;
+  int maxThreads = std::thread::hardware_concurrency();
+  int reps = 3;
+
+  if (argc > 1) filename = argv[1];
+  if (argc > 2) nRays = atoi( argv[2] );
+  if (argc > 3) maxThreads = atoi( argv[3] );
+  if (argc > 4) reps = atoi( argv[4] );
+
+  if (maxThreads < 1)
+    maxThreads = 1;
+
+  std::vector<unsigned char> image;
+  unsigned int w, h;
+
+  unsigned error = lodepng::decode( image, w, h, filename );
+  if (error) {
+    cerr << "Error loading '" << filename << "': " << lodepng_error_text(error) << endl;
+    exit(1);
+  }
+
+  HeightMap map;
+  map.build( image.data(), 4, w, h, 0.1*w );
+
+  printf( "%s (%dx%d), best of %d, %d cores\n\n", filename, w, h, reps, (int) std::thread::hardware_concurrency() );
+
+  vec3 *starts = new vec3[ nRays ];
+  vec3 *dirs   = new vec3[ nRays ];
+
+  vec3 centre( (w-1)/2.0, (h-1)/2.0, 0 );
+
+  // Random picking rays
+
+  srand( 1 );
+
+  for (int i=0; i<nRays; i++) {
+
+    float azimuth   = 2 * M_PI * randIn01();
+    float elevation = (15 + 65 * randIn01()) * M_PI / 180;
+    float dist      = (0.8 + 1.2 * randIn01()) * w;
+
+    starts[i] = centre + dist * vec3( cos(elevation)*cos(azimuth), cos(elevation)*sin(azimuth), sin(elevation) );
+
+    vec3 target( randIn01() * (w-1), randIn01() * (h-1), 0 );
+    target.z = map.point( rint( target.x ), rint( target.y ) ).z;
+
+    dirs[i] = (target - starts[i]).normalize();
+  }
+
+  int failures = timeRays( map, "picking rays", starts, dirs, nRays, maxThreads, reps );
+
+  // A view from one eye, looking down at the centre with a 60 degree
+  // field of view, one ray per pixel of a square image
+
+  int side = (int) sqrt( (float) nRays );
+
+  vec3 eye    = centre + vec3( -0.6*w, -0.6*h, 0.5*w );
+  vec3 ahead  = (centre - eye).normalize();
+  vec3 right  = (ahead ^ vec3(0,0,1)).normalize();
+  vec3 up     = right ^ ahead;
+  float scale = tan( 30 * M_PI / 180 );
+
+  for (int y=0; y<side; y++)
+    for (int x=0; x<side; x++) {
+      float u = ((x + 0.5) / side * 2 - 1) * scale;
+      float v = ((y + 0.5) / side * 2 - 1) * scale;
+      starts[y*side+x] = eye;
+      dirs[y*side+x] = (ahead + u * right + v * up).normalize();
+    }
+
+  failures += timeRays( map, "view rays", starts, dirs, side*side, maxThreads, reps );
+
+  delete[] starts;
+  delete[] dirs;
+
+  return (failures > 0);
+}
@@ -0,0 +1,198 @@
+// terrainSelect.cpp
+//
+// Headless benchmark of choosing the terrain's level of detail: builds
+// the TerrainChunks of a heightfield and times TerrainChunks::select()
+// from a few fixed eyes, with the projection and pixel error that the
+// roller uses.  Each selection is checked against a brute-force one,
+// which tests every chunk's box against the frustum and picks its
+// level by the same rule, and which is timed too.
+//
+// Usage: terrainSelect [heightfield.png [WxH [reps]]]
+
+
+#include "headers.h"
+#include "lodepng.h"
+#include "heightMap.h"
+#include "terrainChunks.h"
+#include "terrain.h"
+
+#include <chrono>
+#include <vector>
+
+
+double now()
+
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+// The world-to-eye transform of an eye at 'eye' looking at 'target',
+// with z up
+
+mat4 viewFrom( vec3 eye, vec3 target )
+
+{
+  vec3 ahead = (target - eye).normalize();
+  vec3 right = (ahead ^ vec3(0,0,1)).normalize();
+  vec3 up    = right ^ ahead;
+
+  mat4 V = identity4();
+
+  V.rows[0] = vec4(  right.x,  right.y,  right.z, -(right * eye) );
+  V.rows[1] = vec4(     up.x,     up.y,     up.z,    -(up * eye) );
+  V.rows[2] = vec4( -ahead.x, -ahead.y, -ahead.z,  (ahead * eye) );
+
+  return V;
+}
+
+
+// Level of every chunk (-1 if culled) by testing each chunk on its own
+
+void bruteForce( TerrainChunks &chunks, vec3 eye, float errorScale, float maxPixelError, mat4 &MVP, int *levels )
+
+{
+  ViewFrustum frustum( MVP );
+
+  for (int c=0; c<chunks.chunks.size(); c++) {
+
+    TerrainChunks::Chunk &chunk = chunks.chunks[c];
+
+    if (frustum.boxVisibility( chunk.boxMin, chunk.boxMax ) == FRUSTUM_OUTSIDE) {
+      levels[c] = -1;
+      continue;
+    }
+
+    vec3 d( fmax( 0, fmax( chunk.boxMin.x - eye.x, eye.x - chunk.boxMax.x ) ),
+            fmax( 0, fmax( chunk.boxMin.y - eye.y, eye.y - chunk.boxMax.y ) ),
+            fmax( 0, fmax( chunk.boxMin.z - eye.z, eye.z - chunk.boxMax.z ) ) );
+
+    float allowed = maxPixelError * d.length() / errorScale;
+
+    int l = TERRAIN_LOD_LEVELS-1;
+    while (l > 0 && chunk.error[l] > allowed)
+      l--;
+
+    levels[c] = l;
+  }
+}
+
+
+int main( int argc, char **argv )
+
+{
+  const char *filename = "Rollercoaster/Textures/hills-heights.png";
+  int width = 800, height = 600;
+  int reps = 1000;
+
+  if (argc > 1) filename = argv[1];
+  if (argc > 2 && sscanf( argv[2], "%dx%d", &width, &height ) != 2) {
+    cerr << "Usage: " << argv[0] << " [heightfield.png [WxH [reps]]]" << endl;
+    exit(1);
+  }
+  if (argc > 3) reps = atoi( argv[3] );
+
+  std::vector<unsigned char> image;
+  unsigned int w, h;
+
+  unsigned error = lodepng::decode( image, w, h, filename );
+  if (error) {
+    cerr << "Error loading '" << filename << "': " << lodepng_error_text(error) << endl;
+    exit(1);
+  }
+
+  HeightMap map;
+  map.build( image.data(), 4, w, h, 0.1*w );
+
+  TerrainChunks chunks;
+  chunks.build( map.width, map.height, map.heights );
+
+  int nChunks = chunks.chunks.size();
+
+  printf( "%dx%d heightfield, %d chunks of %d quads, %dx%d viewport, best of %d\n\n",
+          w, h, nChunks, TERRAIN_CHUNK_QUADS * TERRAIN_CHUNK_QUADS, width, height, reps );
+
+  // The eyes, over the heightfield's centre, corner and middle
+
+  vec3 centre( (w-1)/2.0, (h-1)/2.0, 0 );
+  centre.z = map.heights[ (int) centre.y * w + (int) centre.x ];
+
+  struct View {
+    const char *name;
+    vec3 eye, target;
+  } views[] = {
+    { "overview",   centre + vec3( -0.7*w, -0.7*h, 0.5*w ), centre },
+    { "from above", centre + vec3( -0.1*w, 0, 1.5*w ),      centre },
+    { "corner",     vec3( 5, 5, centre.z + 30 ),            centre },
+    { "ground",     centre + vec3( 0, 0, 5 ),               centre + vec3( 100, 20, 0 ) }
+  };
+
+  int nViews = sizeof(views) / sizeof(views[0]);
+
+  mat4 P = perspective( 45 * M_PI / 180, width / (float) height, 1, 3*w );
+  float errorScale = P[1][1] * height / 2.0;
+  float maxPixelError = TERRAIN_MAX_PIXEL_ERROR;
+
+  seq<TerrainChunks::Selection> selected;
+
+  int *expected = new int[ nChunks ];
+  int *got = new int[ nChunks ];
+
+  int nFailed = 0;
+
+  printf( "              chunks   triangles    us/select  brute force\n" );
+
+  for (int v=0; v<nViews; v++) {
+
+    mat4 MVP = P * viewFrom( views[v].eye, views[v].target );
+
+    // Time
+
+    double best = MAXFLOAT;
+
+    for (int r=0; r<reps; r++) {
+      double t0 = now();
+      chunks.select( views[v].eye, errorScale, maxPixelError, MVP, selected );
+      best = fmin( best, now() - t0 );
+    }
+
+    double bestBrute = MAXFLOAT;
+
+    for (int r=0; r<reps; r++) {
+      double t0 = now();
+      bruteForce( chunks, views[v].eye, errorScale, maxPixelError, MVP, expected );
+      bestBrute = fmin( bestBrute, now() - t0 );
+    }
+
+    // Check
+
+    for (int c=0; c<nChunks; c++)
+      got[c] = -1;
+
+    bool same = true;
+    int nTriangles = 0;
+
+    for (int i=0; i<selected.size(); i++) {
+      int c = selected[i].chunk;
+      if (got[c] != -1)
+        same = false;           // selected twice
+      got[c] = selected[i].level;
+      nTriangles += chunks.levelCount[ selected[i].level ] / 3;
+    }
+
+    for (int c=0; c<nChunks; c++)
+      if (got[c] != expected[c])
+        same = false;
+
+    printf( "%-12s  %6d  %10d  %10.2f   %10.2f   %s\n", views[v].name, selected.size(), nTriangles,
+            best * 1e6, bestBrute * 1e6, (same ? "same" : "DIFFERENT") );
+
+    if (!same)
+      nFailed++;
+  }
+
+  delete [] expected;
+  delete [] got;
+
+  return (nFailed > 0);
+}
@@ -0,0 +1,226 @@
+// trackMesh.cpp
+//
+// Headless benchmark of TrackMesh: builds the swept track along a fixed
+// closed spline, checks the mesh, and times a full build and the
+// updates while a control point is dragged and when it is released.
+//
+// The checks are that the vertex and index counts match the cross-
+// sections (per ring, 2 rails x 4 sides x 2 corners, and a tie of 6
+// faces x 4 corners), that every index is in range, that each
+// segment's box is the tight box of its vertices, that every vertex is
+// within TRACK_REACH of the curve over its segment, and that the
+// bounds of the whole mesh are within TRACK_REACH of the curve's.
+//
+// Usage: trackMesh [numPoints [reps]]
+
+
+#include "headers.h"
+#include "spline.h"
+#include "trackMesh.h"
+
+#include <chrono>
+
+
+#define TRACK_REACH  2.63       // farthest tie corner from the curve, sqrt(2^2 + 1.625^2 + 0.5^2)
+
+
+double now()
+
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+// Best of 'reps' times of fn(), in ms
+
+template <class F>
+double timeIt( int reps, F fn )
+
+{
+  double best = MAXFLOAT;
+
+  for (int r=0; r<reps; r++) {
+    double t0 = now();
+    fn();
+    best = fmin( best, now() - t0 );
+  }
+
+  return best * 1000;
+}
+
+
+// A closed track around a hilly ellipse
+
+void makeTrack( Spline &spline, int numPoints )
+
+{
+  spline.clear();
+
+  for (int i=0; i<numPoints; i++) {
+    float a = 2 * M_PI * i / numPoints;
+    spline.data.add( vec3( 100 + 80 * cos(a), 100 + 60 * sin(a), 25 + 15 * sin(3*a) ) );
+  }
+
+  spline.nextCOB();             // Catmull-Rom
+  spline.invalidate();
+}
+
+
+// Check the mesh against the spline.  Returns the number of failures.
+
+int check( TrackMesh &mesh, Spline &spline )
+
+{
+  const int R = TRACK_RINGS_PER_SEG;
+
+  int n = spline.data.size();
+  int V = mesh.vertsPerSegment();
+  int nFailed = 0;
+
+  // Counts
+
+  int railVerts = (R+1) * 2 * 4 * 2;
+  int tieVerts  = R * 6 * 4;
+  int railIndices = R * 2 * 4 * 2 * 3;
+  int tieIndices  = R * 6 * 2 * 3;
+
+  if (mesh.numSegments() != n || V != railVerts + tieVerts ||
+      mesh.positions.size() != n * V || mesh.normals.size() != n * V ||
+      mesh.railIndexCount() != n * railIndices || mesh.tieIndexCount() != n * tieIndices ||
+      mesh.indices.size() != n * (railIndices + tieIndices)) {
+    printf( "wrong counts: %d segments, %d vertices, %d + %d indices (expected %d, %d, %d + %d)\n",
+            mesh.numSegments(), mesh.positions.size(), mesh.railIndexCount(), mesh.tieIndexCount(),
+            n, n * (railVerts + tieVerts), n * railIndices, n * tieIndices );
+    return 1;
+  }
+
+  for (int k=0; k<mesh.indices.size(); k++)
+    if (mesh.indices[k] >= (unsigned int) (n * V)) {
+      printf( "index %d out of range: %d\n", k, mesh.indices[k] );
+      return 1;
+    }
+
+  // Bounds
+
+  for (int i=0; i<n; i++) {
+
+    vec3 *P = &mesh.positions[ i * V ];
+
+    vec3 boxMin = P[0];
+    vec3 boxMax = P[0];
+
+    for (int k=0; k<V; k++) {
+      boxMin = vec3( fmin( boxMin.x, P[k].x ), fmin( boxMin.y, P[k].y ), fmin( boxMin.z, P[k].z ) );
+      boxMax = vec3( fmax( boxMax.x, P[k].x ), fmax( boxMax.y, P[k].y ), fmax( boxMax.z, P[k].z ) );
+    }
+
+    if ((boxMin - mesh.boxMins[i]).length() != 0 || (boxMax - mesh.boxMaxs[i]).length() != 0) {
+      printf( "segment %d: box is not the box of its vertices\n", i );
+      nFailed++;
+    }
+
+    vec3 curve[R+1];
+
+    for (int k=0; k<=R; k++)
+      curve[k] = spline.value( spline.paramInSegment( i, k * spline.segmentArcLength( i ) / R ) );
+
+    float farthest = 0;
+
+    for (int k=0; k<V; k++) {
+      float d = MAXFLOAT;
+      for (int j=0; j<=R; j++)
+        d = fmin( d, (P[k] - curve[j]).length() );
+      farthest = fmax( farthest, d );
+    }
+
+    if (farthest > TRACK_REACH + 1e-3) {
+      printf( "segment %d: a vertex is %.3f from the curve\n", i, farthest );
+      nFailed++;
+    }
+  }
+
+  return nFailed;
+}
+
+
+int main( int argc, char **argv )
+
+{
+  int numPoints = 20;
+  int reps = 20;
+
+  if (argc > 1) numPoints = atoi( argv[1] );
+  if (argc > 2) reps = atoi( argv[2] );
+
+  Spline spline;
+  makeTrack( spline, numPoints );
+
+  TrackMesh mesh;
+  mesh.update( &spline );
+
+  vec3 lo = mesh.boxMins[0], hi = mesh.boxMaxs[0];
+
+  for (int i=1; i<mesh.numSegments(); i++) {
+    vec3 a = mesh.boxMins[i], b = mesh.boxMaxs[i];
+    lo = vec3( fmin( lo.x, a.x ), fmin( lo.y, a.y ), fmin( lo.z, a.z ) );
+    hi = vec3( fmax( hi.x, b.x ), fmax( hi.y, b.y ), fmax( hi.z, b.z ) );
+  }
+
+  printf( "%d segments, %d vertices, %d rail + %d tie indices\n",
+          mesh.numSegments(), mesh.positions.size(), mesh.railIndexCount(), mesh.tieIndexCount() );
+  printf( "bounds (%.2f %.2f %.2f) - (%.2f %.2f %.2f)\n", lo.x, lo.y, lo.z, hi.x, hi.y, hi.z );
+
+  int nFailed = check( mesh, spline );
+
+  vec3 curveLo = spline.value( 0 ), curveHi = curveLo;
+
+  for (float t=0; t<numPoints; t+=0.01) {
+    vec3 p = spline.value( t );
+    curveLo = vec3( fmin( curveLo.x, p.x ), fmin( curveLo.y, p.y ), fmin( curveLo.z, p.z ) );
+    curveHi = vec3( fmax( curveHi.x, p.x ), fmax( curveHi.y, p.y ), fmax( curveHi.z, p.z ) );
+  }
+
+  for (int c=0; c<3; c++)
+    if (fabs( lo[c] - curveLo[c] ) > TRACK_REACH || fabs( hi[c] - curveHi[c] ) > TRACK_REACH) {
+      printf( "bounds are more than %g from the curve's\n", TRACK_REACH );
+      nFailed++;
+      break;
+    }
+
+  // Time a full build, with the spline's tables already built, and
+  // the updates while one control point is dragged (with the frames
+  // held, as World does) and when it is released
+
+  double tBuild = timeIt( reps, [&]() {
+    TrackMesh m;
+    m.update( &spline );
+  } );
+
+  int nChanged = 0;
+
+  spline.holdFrames( true );
+
+  double tMove = timeIt( reps, [&]() {
+    spline.data[1] = spline.data[1] + vec3( 0.1, 0, 0.05 );
+    spline.pointMoved( 1 );
+    mesh.update( &spline );
+    nChanged = (mesh.rebuilt ? mesh.numSegments() : mesh.changedSegs.size());
+  } );
+
+  spline.holdFrames( false );
+
+  double t0 = now();
+  mesh.update( &spline );
+  double tRelease = (now() - t0) * 1000;
+
+  nFailed += check( mesh, spline );
+
+  printf( "\nfull build     %8.3f ms (best of %d)\n", tBuild, reps );
+  printf( "drag a point   %8.3f ms (%d segments regenerated)\n", tMove, nChanged );
+  printf( "release        %8.3f ms (%s)\n", tRelease, (mesh.rebuilt ? "rebuilt" : "kept") );
+
+  if (nFailed > 0)
+    printf( "\n%d checks failed\n", nFailed );
+
+  return (nFailed > 0);
+}
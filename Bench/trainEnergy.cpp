@@ -0,0 +1,99 @@
+// trainEnergy.cpp
+//
+// Headless check of the train's integrator: rolls trains of a few
+// lengths around a closed hilly track with no friction, no drag and no
+// chain lift, in steps of one 60 Hz frame, and checks that the energy
+// per unit mass, Train::energy(), stays within MAX_ENERGY_DRIFT of
+// where it started.  The largest drift and the time per simulated
+// second are reported.
+//
+// Usage: trainEnergy [seconds]
+
+
+#include "headers.h"
+#include "spline.h"
+#include "train.h"
+
+#include <chrono>
+
+
+#define MAX_ENERGY_DRIFT  1e-4  // largest |E - E0| / E0
+#define FRAME_TIME        (1/60.0)
+
+
+double now()
+
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+// A closed track around a hilly ellipse
+
+void makeTrack( Spline &spline, int numPoints )
+
+{
+  spline.clear();
+
+  for (int i=0; i<numPoints; i++) {
+    float a = 2 * M_PI * i / numPoints;
+    spline.data.add( vec3( 100 + 80 * cos(a), 100 + 60 * sin(a), 25 + 15 * sin(3*a) ) );
+  }
+
+  spline.nextCOB();             // Catmull-Rom
+  spline.invalidate();
+}
+
+
+int main( int argc, char **argv )
+
+{
+  float seconds = 300;
+
+  if (argc > 1) seconds = atof( argv[1] );
+
+  Spline spline;
+  makeTrack( spline, 20 );
+
+  int numFrames = (int) ceil( seconds / FRAME_TIME );
+  int carCounts[] = { 1, TRAIN_CARS, 30 };  // 30 cars cover most of the track
+  int nCounts = sizeof(carCounts) / sizeof(carCounts[0]);
+
+  printf( "track length %.1f, %d frames of %.4f s, bound %g\n\n",
+          spline.totalArcLength(), numFrames, FRAME_TIME, MAX_ENERGY_DRIFT );
+  printf( "cars   energy     max drift   final drift   ms per simulated second\n" );
+
+  bool ok = true;
+
+  for (int c=0; c<nCounts; c++) {
+
+    Train train( &spline );
+
+    train.friction = 0;
+    train.drag = 0;
+    train.liftSpeed = 0;
+    train.setCars( carCounts[c], TRAIN_SPACING );
+
+    float E0 = train.energy();
+    float maxDrift = 0;
+    float drift = 0;
+    double time = 0;
+
+    for (int f=0; f<numFrames; f++) {
+
+      double t0 = now();
+      train.advance( FRAME_TIME );
+      time += now() - t0;
+
+      drift = fabs( train.energy() - E0 ) / E0;
+      maxDrift = fmax( maxDrift, drift );
+    }
+
+    printf( "%4d  %8.2f   %9.2g   %9.2g     %8.3f   %s\n", train.numCars(), E0, maxDrift, drift,
+            time * 1000 / seconds, (maxDrift <= MAX_ENERGY_DRIFT ? "" : "TOO LARGE") );
+
+    ok = ok && (maxDrift <= MAX_ENERGY_DRIFT);
+  }
+
+  return !ok;
+}
@@ -184,7 +184,7 @@ void display()
     myGPUProgram->activate();
 
     // Provide M to the vertex shader
-    glUniformMatrix4fv( glGetUniformLocation( myGPUProgram->id(), "M"), 1, GL_TRUE, &M[0][0] );
+    myGPUProgram->setMat4( "M", M );
 
     // Use the VAO that was set up above
     glBindVertexArray( squareVAO );
@@ -3,6 +3,7 @@
 
 #include "headers.h"
 #include "world.h"
+#include "headless.h"
 
 int windowWidth  = 800;
 int windowHeight = 600;
@@ -24,7 +25,28 @@ void framebufferReshapeCallback( GLFWwindow* window, int width, int height ) {
     glViewport( 0, 0, width, height );
 }
 
-int main() {
+int main( int argc, char **argv ) {
+
+  // Without a window, draw a fixed number of frames offscreen and time
+  // them (see headless.h)
+
+  Headless headless;
+
+  if (headless.parseArgs( argc, argv )) {
+
+    headless.init();
+
+    windowWidth  = headless.width;
+    windowHeight = headless.height;
+
+    std::shared_ptr<World> world(new World( NULL, windowWidth, windowHeight ));
+
+    headless.replay( [&]( float elapsedSeconds ) { world->update( elapsedSeconds ); },
+                     [&]() { world->draw(); } );
+
+    return 0;
+  }
+
   // Initialize the window
   glfwSetErrorCallback( errorCallback );
 
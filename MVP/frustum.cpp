@@ -1,4 +1,5 @@
 #include "frustum.h"
+#include "drawStats.h"
 
 static constexpr float MOVE_RATE = 0.01;
 static constexpr float ROT_RATE = 0.005; //radians
@@ -113,6 +114,7 @@ void Frustum::draw( mat4& MV, mat4& MVP, mat4& axesMVP) {
 
     glBindVertexArray(VAO);
     glDrawArrays(GL_LINE_STRIP, 0, FRUSTUM_VERTICES); // used GL_TRIANGLE_STRIP so that only 4 verticies needed to be defined per face instead of 6 (GL_TRIANGLE_STRIP draws triangles using v0, v1, v2 and v2, v1, v3)
+    drawStats.drawCalls++;
     glBindVertexArray(0);
 
     gpu.deactivate();
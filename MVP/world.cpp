@@ -19,29 +19,34 @@ World::World( GLFWwindow *w, int windowWidth, int windowHeight ) {
     insideTransition = false;
     outsideTransition = false;
 
-    glfwSetWindowUserPointer( window, this );
+    // No callbacks when headless (with no window)
 
-    // Key handler
+    if (window != NULL) {
 
-    auto static_keyCallback = [](GLFWwindow* ww, int key, int scancode, int action, int mods ) {
-        static_cast<World*>(glfwGetWindowUserPointer(ww))->keyCallback( ww, key, scancode, action, mods );
-    };
+        glfwSetWindowUserPointer( window, this );
 
-    glfwSetKeyCallback( window, static_keyCallback );
+        // Key handler
 
-    // mouse handler
+        auto static_keyCallback = [](GLFWwindow* ww, int key, int scancode, int action, int mods ) {
+            static_cast<World*>(glfwGetWindowUserPointer(ww))->keyCallback( ww, key, scancode, action, mods );
+        };
+
+        glfwSetKeyCallback( window, static_keyCallback );
+
+        // mouse handler
 
-    auto static_mouseButtonCallback = [](GLFWwindow* ww, int button, int action, int keyModifiers ) {
-        static_cast<World*>(glfwGetWindowUserPointer(ww))->mouseButtonCallback( ww, button, action, keyModifiers );
-    };
+        auto static_mouseButtonCallback = [](GLFWwindow* ww, int button, int action, int keyModifiers ) {
+            static_cast<World*>(glfwGetWindowUserPointer(ww))->mouseButtonCallback( ww, button, action, keyModifiers );
+        };
 
-    glfwSetMouseButtonCallback( window, static_mouseButtonCallback );
+        glfwSetMouseButtonCallback( window, static_mouseButtonCallback );
 
-    auto static_mouseScrollCallback = [](GLFWwindow* ww, double xoffset, double yoffset ) {
-        static_cast<World*>(glfwGetWindowUserPointer(ww))->mouseScrollCallback( ww, xoffset, yoffset );
-    };
+        auto static_mouseScrollCallback = [](GLFWwindow* ww, double xoffset, double yoffset ) {
+            static_cast<World*>(glfwGetWindowUserPointer(ww))->mouseScrollCallback( ww, xoffset, yoffset );
+        };
 
-    glfwSetScrollCallback( window, static_mouseScrollCallback );
+        glfwSetScrollCallback( window, static_mouseScrollCallback );
+    }
 
     // Set up camera interface
 
@@ -170,7 +175,8 @@ void World::draw() {
         skybox->draw(V, P); // (cubemap shaders take only V and P)
     }
 
-    glfwSwapBuffers( window );
+    if (window != NULL)
+        glfwSwapBuffers( window );
 }
 
 mat4 World::gradientM(mat4& M1, mat4& M2) {
@@ -22,7 +22,7 @@ struct cubeM {
 
 class World {
 public:
-    World( GLFWwindow *w, int windowWidth, int windowHeight );
+    World( GLFWwindow *w, int windowWidth, int windowHeight ); // w is NULL when headless
 
     ~World() {
         delete gpu;
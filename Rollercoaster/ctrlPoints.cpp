@@ -2,6 +2,7 @@
 
 #include "ctrlPoints.h"
 #include "shMem.h"
+#include "drawStats.h"
 
 
 #define POST_RADIUS 2.0
@@ -15,7 +16,23 @@ void CtrlPoints::draw( bool drawPostsOnly, mat4 &WCStoVCS, mat4 &WCStoCCS, vec3
 {
   mat4 M, MV, MVP;
 
+  // Cull with a sphere around each base, top, and post
+
+  cullCentres.resize( points.size() );
+  cullRadii.clear();
+
   for (int i=0; i<points.size(); i++) {
+    cullCentres.set( i, 0.5 * (points[i] + bases[i]) );
+    cullRadii.add( 0.5 * (points[i] - bases[i]).length() + POINT_RADIUS );
+  }
+
+  ViewFrustum( WCStoCCS ).cullSpheres( cullCentres, cullRadii.array(), visible );
+
+  drawStats.objectsCulled += points.size() - visible.size();
+
+  for (int j=0; j<visible.size(); j++) {
+
+    int i = visible[j];
 
     if (!drawPostsOnly) {
 
@@ -95,7 +112,7 @@ void CtrlPoints::addPoint( vec3 pt )
     spline->data.add( points[edgeIndex] );
   }
 
-  spline->mustRecomputeArcLength = true;
+  spline->invalidate();
 }
 
 
@@ -105,7 +122,7 @@ void CtrlPoints::addPointWithHeight( vec3 v, float height )
   bases.add( v );
   points.add( v + vec3(0,0,height) );
   spline->data.add( points[points.size()-1] );
-  spline->mustRecomputeArcLength = true;
+  spline->invalidate();
 }
 
 
@@ -115,7 +132,7 @@ void CtrlPoints::deletePoint( int index )
   bases.remove(index);
   points.remove(index);
   spline->data.remove(index);
-  spline->mustRecomputeArcLength = true;
+  spline->invalidate();
 }
 
 
@@ -129,7 +146,7 @@ void CtrlPoints::moveBase( int index, vec3 newPos )
   newPos.z = z;                 // keep the original height
   points[index] = newPos;
   spline->data[index] = newPos;
-  spline->mustRecomputeArcLength = true;
+  spline->pointMoved( index );
 }
 
 
@@ -138,7 +155,7 @@ void CtrlPoints::setHeight( int index, float height )
 {
   points[index].z = bases[index].z + height;
   spline->data[index] = points[index];
-  spline->mustRecomputeArcLength = true;
+  spline->pointMoved( index );
 }
 
 
@@ -154,16 +171,26 @@ int CtrlPoints::findSelectedPoint( vec3 start, vec3 dir, mat4 &M )
   int   minIndex = -1;
   float minZDist = MAXFLOAT;
 
+  // Move all bases and tops into the world in one batch
+
+  vec3SoA b, p;
+
+  b.gather( bases );
+  p.gather( points );
+
+  transformPoints( M, b, b );
+  transformPoints( M, p, p );
+
   for (int i=0; i<points.size(); i++) {
 
     // base i
 
-    vec3 p = (M * vec4( bases[i], 1 )).toVec3();
+    vec3 q = b[i];
 
-    float distToLine = p.distanceToLine( start, dir );
+    float distToLine = q.distanceToLine( start, dir );
 
     if (distToLine < POINT_RADIUS) {
-      float zdist = (p - start)*dir;
+      float zdist = (q - start)*dir;
       if (zdist < minZDist) {
         minZDist = zdist;
         minIndex = 2*i + 0;  // ID of base of i is 2i
@@ -172,12 +199,12 @@ int CtrlPoints::findSelectedPoint( vec3 start, vec3 dir, mat4 &M )
 
     // top i
 
-    p = (M * vec4( points[i], 1 )).toVec3();
+    q = p[i];
 
-    distToLine = p.distanceToLine( start, dir );
+    distToLine = q.distanceToLine( start, dir );
 
     if (distToLine < POINT_RADIUS) {
-      float zdist = (p - start)*dir;
+      float zdist = (q - start)*dir;
       if (zdist < minZDist) {
         minZDist = zdist;
         minIndex = 2*i + 1;  // ID of base of i is 2i+1
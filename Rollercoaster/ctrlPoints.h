@@ -7,6 +7,7 @@
 #include "headers.h"
 #include "seq.h"
 #include "spline.h"
+#include "viewFrustum.h"
 
 
 class CtrlPoints {
@@ -20,6 +21,10 @@ class CtrlPoints {
 
   GLFWwindow *window;
 
+  vec3SoA    cullCentres;       // bounding spheres, for culling in draw()
+  seq<float> cullRadii;
+  seq<int>   visible;
+
   CtrlPoints( Spline *s, GLFWwindow *w ) {
     spline = s;
     window = w;
@@ -2,6 +2,7 @@
 
 
 #include "cylinder.h"
+#include "drawStats.h"
 
 
 void Cylinder::setupVAO()
@@ -88,21 +89,30 @@ void Cylinder::draw( mat4 &MV, mat4 &MVP, vec3 lightDir, vec3 colour )
 {
   gpu.activate();
 
-  gpu.setMat4( "MV", MV );
-  gpu.setMat4( "MVP", MVP );
-  gpu.setVec3( "colour", colour );
-  gpu.setVec3( "lightDir", lightDir );
+  MVUniform.set( MV );
+  MVPUniform.set( MVP );
+  colourUniform.set( colour );
+  lightDirUniform.set( lightDir );
 
   // Draw using element array
 
   glBindVertexArray( VAO );
   glDrawElements( GL_TRIANGLES, faces.size()*3, GL_UNSIGNED_INT, 0 );
+  drawStats.drawCalls++;
   glBindVertexArray( 0 );
 
   gpu.deactivate();
 }
 
 
+void Cylinder::drawSoft( SoftRaster &raster, const mat4 &MV, const mat4 &MVP, vec3 lightDir, vec3 colour )
+
+{
+  raster.drawTriangles( &verts[0].x, &normals[0].x, NULL, 3, verts.size(),
+                        faces[0].v, faces.size()*3, MV, MVP, lightDir, colour );
+}
+
+
 const char *Cylinder::vertShader = R"(
 
   #version 330 es
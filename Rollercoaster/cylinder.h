@@ -10,6 +10,7 @@
 #include "linalg.h"
 #include "seq.h"
 #include "gpuProgram.h"
+#include "softRaster.h"
 
 
 class CylinderFace {
@@ -26,7 +27,14 @@ class Cylinder {
 
  public:
 
-  Cylinder( int numSlices ) {
+  // With useGL false, no OpenGL calls are made and the cylinder can
+  // only be drawn with drawSoft().
+
+  Cylinder( int numSlices, bool useGL = true ) {
+
+    verts.reserve( 4*numSlices + 2 );
+    normals.reserve( 4*numSlices + 2 );
+    faces.reserve( 4*numSlices );
 
     // bottom vertices
     
@@ -87,8 +95,16 @@ class Cylinder {
                                baseIndex + i ) );
     }
 
+    if (!useGL)
+      return;
+
     gpu.init( vertShader, fragShader, "in cylinder.cpp" );
 
+    MVUniform       = gpu.uniform<mat4>( "MV" );
+    MVPUniform      = gpu.uniform<mat4>( "MVP" );
+    colourUniform   = gpu.uniform<vec3>( "colour" );
+    lightDirUniform = gpu.uniform<vec3>( "lightDir" );
+
     setupVAO();
   };
 
@@ -104,6 +120,10 @@ class Cylinder {
   
   void draw( mat4 &MV, mat4 &MVP, vec3 lightDir, vec3 colour );
 
+  // The same, in software (see softRaster.h)
+
+  void drawSoft( SoftRaster &raster, const mat4 &MV, const mat4 &MVP, vec3 lightDir, vec3 colour );
+
  private:
 
   seq<vec3>         verts;
@@ -113,6 +133,9 @@ class Cylinder {
 
   GPUProgram        gpu;
 
+  UniformHandle<mat4> MVUniform, MVPUniform;
+  UniformHandle<vec3> colourUniform, lightDirUniform;
+
   static const char *vertShader;
   static const char *fragShader;
 
@@ -9,44 +9,105 @@
 
 #include "headers.h"
 #include "drawSegs.h"
+#include "drawStats.h"
 
 
-// 'nSegs' is the number of segments.
-// 'segs' is an array of nSegs vertices.
+#define SEGS_BUFFER_VERTS 16384  // initial capacity of the streaming buffer
+#define SEGS_VERTEX_FLOATS 9     // position, colour, normal
 
-void Segs::drawSegs( GLuint primitiveType, vec3 *pts, vec3 *colours, vec3 *norms, int nPts, mat4 &MV, mat4 &MVP, vec3 lightDir )
+
+void Segs::setupVAO()
 
 {
-  GLuint VAO;
+  capacity = SEGS_BUFFER_VERTS;
+  used = 0;
 
   glGenVertexArrays( 1, &VAO );
   glBindVertexArray( VAO );
 
-  GLuint VBO0, VBO1, VBO2;
+  glGenBuffers( 1, &VBO );
+  glBindBuffer( GL_ARRAY_BUFFER, VBO );
+  glBufferData( GL_ARRAY_BUFFER, capacity * SEGS_VERTEX_FLOATS * sizeof(float), NULL, GL_STREAM_DRAW );
+
+  GLsizei stride = SEGS_VERTEX_FLOATS * sizeof(float);
+
+  // attribute 0 = position, 1 = colour, 2 = normal
+
+  for (int i=0; i<3; i++) {
+    glVertexAttribPointer( i, 3, GL_FLOAT, GL_FALSE, stride, (void *) (3*i * sizeof(float)) );
+    glEnableVertexAttribArray( i );
+  }
+
+  glBindVertexArray( 0 );
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+  drawStats.glObjectsCreated += 2;
+}
+
+
+// Append nPts vertices to the streaming buffer and return the index of
+// the first.  The range written has not been used since the buffer was
+// last orphaned, so it can be mapped without waiting for the GPU.
+// Expects VBO to be bound.
+
+int Segs::stream( vec3 *pts, vec3 *colours, vec3 *norms, int nPts )
+
+{
+  GLsizei stride = SEGS_VERTEX_FLOATS * sizeof(float);
+
+  if (used + nPts > capacity) {
+
+    while (capacity < nPts)
+      capacity *= 2;
+
+    glBufferData( GL_ARRAY_BUFFER, capacity * stride, NULL, GL_STREAM_DRAW ); // orphan
+    used = 0;
+    drawStats.bufferOrphans++;
+  }
+
+  float *p = (float *) glMapBufferRange( GL_ARRAY_BUFFER, used * stride, nPts * stride,
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
 
-  // Set up points
+  if (p == NULL) {
+    cerr << "Segs::stream: could not map the vertex buffer" << endl;
+    exit(1);
+  }
+
+  // Copy normals from points if normals are not provided, just to have
+  // some data there
+
+  vec3 *n = (norms != NULL ? norms : pts);
+
+  for (int i=0; i<nPts; i++) {
+    *p++ = pts[i].x;     *p++ = pts[i].y;     *p++ = pts[i].z;
+    *p++ = colours[i].x; *p++ = colours[i].y; *p++ = colours[i].z;
+    *p++ = n[i].x;       *p++ = n[i].y;       *p++ = n[i].z;
+  }
+
+  glUnmapBuffer( GL_ARRAY_BUFFER );
 
-  glGenBuffers( 1, &VBO0 );
-  glBindBuffer( GL_ARRAY_BUFFER, VBO0 );
-  glBufferData( GL_ARRAY_BUFFER, nPts * sizeof(vec3), pts, GL_STATIC_DRAW );
-  glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 0, 0 );
-  glEnableVertexAttribArray( 0 );
+  drawStats.streamedBytes += nPts * stride;
 
-  // Set up colours
+  int first = used;
+  used += nPts;
+
+  return first;
+}
 
-  glGenBuffers( 1, &VBO1 );
-  glBindBuffer( GL_ARRAY_BUFFER, VBO1 );
-  glBufferData( GL_ARRAY_BUFFER, nPts * sizeof(vec3), colours, GL_STATIC_DRAW );
-  glVertexAttribPointer( 1, 3, GL_FLOAT, GL_FALSE, 0, 0 );
-  glEnableVertexAttribArray( 1 );
 
-  // Set up normals (or copy points to normals if normals are not provided, just to have some data there)
+// 'nSegs' is the number of segments.
+// 'segs' is an array of nSegs vertices.
 
-  glGenBuffers( 1, &VBO2 );
-  glBindBuffer( GL_ARRAY_BUFFER, VBO2 );
-  glBufferData( GL_ARRAY_BUFFER, nPts * sizeof(vec3), (norms != NULL ? norms : pts), GL_STATIC_DRAW );
-  glVertexAttribPointer( 2, 3, GL_FLOAT, GL_FALSE, 0, 0 );
-  glEnableVertexAttribArray( 2 );
+void Segs::drawSegs( GLuint primitiveType, vec3 *pts, vec3 *colours, vec3 *norms, int nPts, mat4 &MV, mat4 &MVP, vec3 lightDir )
+
+{
+  if (nPts == 0)
+    return;
+
+  glBindVertexArray( VAO );
+  glBindBuffer( GL_ARRAY_BUFFER, VBO );
+
+  int first = stream( pts, colours, norms, nPts );
 
   // Draw
 
@@ -55,32 +116,20 @@ void Segs::drawSegs( GLuint primitiveType, vec3 *pts, vec3 *colours, vec3 *norms
 
   gpuProg->activate();
 
-  gpuProg->setMat4( "MV",  MV  );
-  gpuProg->setMat4( "MVP", MVP );
-  gpuProg->setVec3( "lightDir", lightDir );
-
-  gpuProg->setInt( "useNormals", (norms != NULL) );
+  MVUniform.set( MV );
+  MVPUniform.set( MVP );
+  lightDirUniform.set( lightDir );
+  useNormalsUniform.set( norms != NULL );
 
-  glDrawArrays( primitiveType, 0, nPts );
+  glDrawArrays( primitiveType, first, nPts );
+  drawStats.drawCalls++;
 
   gpuProg->deactivate();
 
   glUseProgram( id ); // restore previously-active GPU program
 
-  // Clean up
-
-  glDeleteBuffers( 1, &VBO0 );
-  glDeleteBuffers( 1, &VBO1 );
-  glDeleteBuffers( 1, &VBO2 );
-
-  glDisableVertexAttribArray( 0 );
-  glDisableVertexAttribArray( 1 );
-  glDisableVertexAttribArray( 2 );
-
   glBindBuffer( GL_ARRAY_BUFFER, 0 );
-
   glBindVertexArray( 0 );
-  glDeleteVertexArrays( 1, &VAO );
 }
 
 
@@ -102,6 +151,12 @@ GPUProgram *Segs::setupShaders()
 {
   GPUProgram *gpuProg = new GPUProgram();
   gpuProg->init( vertexShader, fragmentShader, "in drawSegs.cpp" );
+
+  MVUniform         = gpuProg->uniform<mat4>( "MV" );
+  MVPUniform        = gpuProg->uniform<mat4>( "MVP" );
+  lightDirUniform   = gpuProg->uniform<vec3>( "lightDir" );
+  useNormalsUniform = gpuProg->uniform<int>( "useNormals" );
+
   return gpuProg;
 }
 
@@ -24,12 +24,35 @@ class Segs {
   GPUProgram *setupShaders();
 
   GPUProgram *gpuProg;
+
+  UniformHandle<mat4> MVUniform, MVPUniform;
+  UniformHandle<vec3> lightDirUniform;
+  UniformHandle<int>  useNormalsUniform;
+
+  // One long-lived VAO over a streaming buffer of interleaved
+  // (position, colour, normal) vertices.  Each call appends its
+  // vertices after those of earlier calls; when the buffer is full it
+  // is orphaned and filling starts again at the front.
+
+  GLuint VAO;
+  GLuint VBO;
+  int    capacity;              // vertices that fit in VBO
+  int    used;                  // vertices written since VBO was last orphaned
+
+  void setupVAO();
+  int stream( vec3 *pts, vec3 *colours, vec3 *norms, int nPts );
   
  public:
 
   Segs() { 
     gpuProg = setupShaders();
+    setupVAO();
   };
+
+  ~Segs() {
+    glDeleteBuffers( 1, &VBO );
+    glDeleteVertexArrays( 1, &VAO );
+  }
   
   void drawSegs( GLuint primitiveType, vec3 *pts, vec3 *colours, vec3 *norms, int nPts, mat4 &MV, mat4 &MVP, vec3 lightDir );
 
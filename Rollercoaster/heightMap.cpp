@@ -0,0 +1,1034 @@
+// heightMap.cpp
+
+
+#include "heightMap.h"
+#include "simd.h"
+
+#include <new>
+#include <atomic>
+
+
+#define ROWS_PER_TASK 16
+
+#define RAY_STEP 0.004   // distance (in x and y) by which a ray is pushed past each cell boundary
+#define EDGE_EPS 1e-5    // barycentric tolerance, so that rays through edges and vertices don't slip through
+
+#define RAYS_PER_TASK 1024
+
+#define RAY_START_LEVEL 4  // pyramid level at which rays start (they go up from there over open ground)
+
+#define SAMPLES_PER_TASK 4096
+
+
+void HeightMap::release()
+
+{
+  if (heights != NULL)
+    ::operator delete( heights, std::align_val_t( 64 ) );
+
+  delete[] normals;
+
+  heights = NULL;
+  normals = NULL;
+}
+
+
+void HeightMap::build( const unsigned char *texels, int bytesPerTexel, int w, int h, double maxHeight, ThreadPool &pool )
+
+{
+  release();
+
+  width  = w;
+  height = h;
+
+  int n = width * height;
+
+  heights = (float *) ::operator new( n * sizeof(float), std::align_val_t( 64 ) );
+
+  // One extra normal, since computeNormals() writes four floats at a
+  // time
+
+  normals = new vec3[ n + 1 ];
+
+  pool.parallelFor( 0, height, ROWS_PER_TASK, [&]( int y0, int y1 ) {
+    for (int i=y0*width; i<y1*width; i++)
+      heights[i] = (texels[i*bytesPerTexel] / 255.0f) * maxHeight;
+  } );
+
+  computeNormals( pool );
+  buildMaxPyramid( pool );
+}
+
+
+// The normal at each vertex, from central differences of the heights
+// (or one-sided differences at the edges)
+
+
+static inline vec3 differenceNormal( const float *heights, int width, int height, int x, int y )
+
+{
+  int x0 = (x > 0 ? x-1 : x), x1 = (x < width-1  ? x+1 : x);
+  int y0 = (y > 0 ? y-1 : y), y1 = (y < height-1 ? y+1 : y);
+
+  float dx = (x1 > x0 ? (heights[ y*width + x1 ] - heights[ y*width + x0 ]) / (x1-x0) : 0);
+  float dy = (y1 > y0 ? (heights[ y1*width + x ] - heights[ y0*width + x ]) / (y1-y0) : 0);
+
+  return vec3( -dx, -dy, 1 ).normalize();
+}
+
+
+void HeightMap::computeNormals( ThreadPool &pool )
+
+{
+  pool.parallelFor( 0, height, ROWS_PER_TASK, [this]( int y0, int y1 ) {
+    normalRows( y0, y1 );
+  } );
+}
+
+
+void HeightMap::normalRows( int y0, int y1 )
+
+{
+  const f4 half = f4splat( 0.5 );
+  const f4 unit = f4splat( 1 );
+  const f4 zero = f4splat( 0 );
+
+  for (int y=y0; y<y1; y++) {
+
+    int x = 1;
+
+    // Four interior vertices at a time.  Each normal is stored as four
+    // floats, the last of which is overwritten by the next normal.
+    // Stores stay within the row, so rows can be done in parallel.
+
+    if (y > 0 && y < height-1) {
+
+      const float *row = heights + y*width;
+
+      for ( ; x+4 <= width-1; x+=4) {
+
+        f4 dx = f4mul( f4sub( f4load( row+x+1 ), f4load( row+x-1 ) ), half );
+        f4 dy = f4mul( f4sub( f4load( row+x+width ), f4load( row+x-width ) ), half );
+
+        f4 invLen = f4div( unit, f4sqrt( f4madd( dx, dx, f4madd( dy, dy, unit ) ) ) );
+
+        f4 nx = f4mul( f4sub( zero, dx ), invLen );
+        f4 ny = f4mul( f4sub( zero, dy ), invLen );
+        f4 nz = invLen;
+        f4 nw = zero;
+
+        f4transpose( nx, ny, nz, nw );
+
+        float *out = &normals[ y*width + x ].x;
+
+        f4store( out,   nx );
+        f4store( out+3, ny );
+        f4store( out+6, nz );
+        f4store( out+9, nw );
+      }
+    }
+
+    // The rest of the row, and the edges
+
+    for ( ; x<width; x++)
+      normals[ y*width + x ] = differenceNormal( heights, width, height, x, y );
+
+    normals[ y*width ] = differenceNormal( heights, width, height, 0, y );
+  }
+}
+
+
+// The pyramid of maximum heights.  Level 0 has one cell per quad.
+
+
+void HeightMap::buildMaxPyramid( ThreadPool &pool )
+
+{
+  maxPyramid.clear();
+  pyramidX.clear();
+  pyramidY.clear();
+
+  int nx = width-1;
+  int ny = height-1;
+
+  if (nx < 1 || ny < 1)
+    return;
+
+  seq<float> level( nx * ny );
+
+  for (int i=0; i<nx*ny; i++)
+    level.add( 0 );
+
+  float *out = level.array();
+
+  pool.parallelFor( 0, ny, ROWS_PER_TASK, [&]( int y0, int y1 ) {
+
+    for (int y=y0; y<y1; y++) {
+
+      const float *row0 = heights + y*width;
+      const float *row1 = row0 + width;
+      float *o = out + y*nx;
+
+      int x = 0;
+
+      for ( ; x+5 <= width; x+=4) {
+        f4 m = f4max( f4max( f4load( row0+x ), f4load( row0+x+1 ) ),
+                      f4max( f4load( row1+x ), f4load( row1+x+1 ) ) );
+        f4store( o+x, m );
+      }
+
+      for ( ; x<nx; x++)
+        o[x] = fmax( fmax( row0[x], row0[x+1] ), fmax( row1[x], row1[x+1] ) );
+    }
+  } );
+
+  maxPyramid.add( std::move( level ) );
+  pyramidX.add( nx );
+  pyramidY.add( ny );
+
+  while (nx > 1 || ny > 1) {
+
+    seq<float> &below = maxPyramid[ maxPyramid.size()-1 ];
+
+    int px = (nx+1) / 2;
+    int py = (ny+1) / 2;
+
+    seq<float> parents( px * py );
+
+    for (int j=0; j<py; j++)
+      for (int i=0; i<px; i++) {
+
+        int i1 = (2*i+1 < nx ? 2*i+1 : 2*i);
+        int j1 = (2*j+1 < ny ? 2*j+1 : 2*j);
+
+        parents.add( fmax( fmax( below[ (2*j)*nx + 2*i ], below[ (2*j)*nx + i1 ] ),
+                           fmax( below[ j1*nx + 2*i ],    below[ j1*nx + i1 ] ) ) );
+      }
+
+    nx = px;
+    ny = py;
+
+    maxPyramid.add( std::move( parents ) );
+    pyramidX.add( nx );
+    pyramidY.add( ny );
+  }
+}
+
+
+// Clip the parameter range [t0,t1] of a ray to the slab lo <= s + t*d
+// <= hi.  Returns false if nothing is left.
+
+
+static inline bool clipSlab( float s, float d, float lo, float hi, float &t0, float &t1 )
+
+{
+  if (d == 0)
+    return (s >= lo && s <= hi);
+
+  float ta = (lo - s) / d;
+  float tb = (hi - s) / d;
+
+  t0 = fmax( t0, fmin( ta, tb ) );
+  t1 = fmin( t1, fmax( ta, tb ) );
+
+  return t0 <= t1;
+}
+
+
+// Moller-Trumbore intersection of a ray with the triangle v0, v0+e1,
+// v0+e2 (from either side), with all of its rejection tests combined
+// into a single branch.  The triangle is grown by EDGE_EPS so that
+// neighbouring triangles overlap slightly.  Hits before tMin are
+// rejected.
+
+
+static inline bool rayTriangle( vec3 start, vec3 dir, vec3 v0, vec3 e1, vec3 e2, float tMin, float &t )
+
+{
+  vec3 p = dir ^ e2;
+  float det = e1 * p;
+  float inv = 1 / det;
+
+  vec3 s = start - v0;
+  float u = (s * p) * inv;
+
+  vec3 q = s ^ e1;
+  float v = (dir * q) * inv;
+
+  t = (e2 * q) * inv;
+
+  return (fabs(det) > 1e-12) & (u >= -EDGE_EPS) & (v >= -EDGE_EPS) & (u+v <= 1+EDGE_EPS) & (t >= tMin);
+}
+
+
+// Clip a ray to the heightfield's box, below the highest point
+
+
+bool HeightMap::clipRay( vec3 start, vec3 dir, float &tEnter, float &tLeave )
+
+{
+  if (maxPyramid.size() == 0)
+    return false;
+
+  tEnter = 0;
+  tLeave = MAXFLOAT;
+
+  return (clipSlab( start.x, dir.x, 0, width-1,  tEnter, tLeave ) &&
+          clipSlab( start.y, dir.y, 0, height-1, tEnter, tLeave ) &&
+          clipSlab( start.z, dir.z, -MAXFLOAT, maxPyramid[ maxPyramid.size()-1 ][0], tEnter, tLeave ));
+}
+
+
+// The parameter distance by which a ray is pushed past a cell boundary
+
+static inline float rayStep( vec3 dir )
+
+{
+  float horiz = fmax( fabs(dir.x), fabs(dir.y) );
+  return (horiz > 0 ? RAY_STEP / horiz : 0);
+}
+
+
+bool HeightMap::intersectRay( vec3 start, vec3 dir, vec3 &hit, float &hitT )
+
+{
+  float tEnter, tLeave;
+
+  if (!clipRay( start, dir, tEnter, tLeave ))
+    return false;
+
+  int top = maxPyramid.size()-1;
+
+  // Walk the cells along the ray, starting part way up the pyramid.
+  // At each boundary the ray is pushed 'step' into the next cell (a
+  // distance which is included when finding the ray's lowest point in
+  // that cell), so that t always increases.
+
+  float step = rayStep( dir );
+
+  float invX = 1 / dir.x;
+  float invY = 1 / dir.y;
+
+  int   level = (top < RAY_START_LEVEL ? top : RAY_START_LEVEL);
+  float t = tEnter;
+  float tFrom = tEnter;
+
+  while (t <= tLeave) {
+
+    int s = 1 << level;
+    int nx = pyramidX[level];
+    int ny = pyramidY[level];
+
+    // The cell containing the ray at t.  A ray on a boundary is in the
+    // cell that it is moving into.
+
+    vec3 p = start + t * dir;
+
+    float invS = 1.0f / s;
+
+    int cx = (int) (dir.x < 0 ? ceil( p.x * invS ) - 1 : floor( p.x * invS ));
+    int cy = (int) (dir.y < 0 ? ceil( p.y * invS ) - 1 : floor( p.y * invS ));
+
+    cx = (cx < 0 ? 0 : (cx > nx-1 ? nx-1 : cx));
+    cy = (cy < 0 ? 0 : (cy > ny-1 ? ny-1 : cy));
+
+    // Where the ray leaves the cell
+
+    float x0 = cx * s, x1 = fmin( x0 + s, width-1 );
+    float y0 = cy * s, y1 = fmin( y0 + s, height-1 );
+
+    float tx = (dir.x > 0 ? (x1 - start.x) * invX : (dir.x < 0 ? (x0 - start.x) * invX : MAXFLOAT));
+    float ty = (dir.y > 0 ? (y1 - start.y) * invY : (dir.y < 0 ? (y0 - start.y) * invY : MAXFLOAT));
+
+    float tExit = fmin( fmin( tx, ty ), tLeave );
+
+    float zLow = fmin( start.z + tFrom * dir.z, start.z + tExit * dir.z );
+
+    if (zLow <= maxPyramid[level][ cy*nx + cx ]) {
+
+      if (level > 0) {          // look at the cell's children
+        level--;
+        continue;
+      }
+
+      // Test the quad's two triangles, which are split along the same
+      // diagonal as the drawn surface.  The test starts from where the
+      // ray enters the cell, which is close to the triangles, for
+      // accuracy.
+
+      vec3 ll = point( cx,   cy   );
+      vec3 lr = point( cx+1, cy   );
+      vec3 ul = point( cx,   cy+1 );
+      vec3 ur = point( cx+1, cy+1 );
+
+      vec3 entry = start + tFrom * dir;
+
+      float t0, t1;
+
+      bool hit0 = rayTriangle( entry, dir, ll, lr-ll, ul-ll, -tFrom, t0 );
+      bool hit1 = rayTriangle( entry, dir, ur, ul-ur, lr-ur, -tFrom, t1 );
+
+      if (hit0 || hit1) {
+        hitT = tFrom + (hit0 && hit1 ? fmin( t0, t1 ) : (hit0 ? t0 : t1));
+        hit = start + hitT * dir;
+        return true;
+      }
+
+    } else if (level < top) {
+
+      // Passed above the cell.  If the ray is also leaving the cell's
+      // parent, go on in bigger steps.
+
+      bool leavesParent = (tx <= ty ? (cx & 1) == (dir.x > 0) : (cy & 1) == (dir.y > 0));
+
+      if (leavesParent)
+        level++;
+    }
+
+    if (tExit >= tLeave)
+      return false;
+
+    tFrom = tExit;
+    t = fmax( t, tExit ) + step;
+  }
+
+  return false;
+}
+
+
+// Rays in packets of four, one per SIMD lane.  Each lane walks the
+// pyramid exactly as intersectRay() does, and the lanes step together:
+// the cell arithmetic, the tests against the maximum heights, and the
+// triangle tests are done for all four lanes at once.  When a lane's
+// ray finishes, the lane takes the next ray, so lanes are kept busy
+// even though rays take different numbers of steps.
+
+
+struct f4vec3 {
+  f4 x, y, z;
+};
+
+static inline f4vec3 cross4( f4vec3 a, f4vec3 b )
+
+{
+  f4vec3 c;
+  c.x = f4sub( f4mul( a.y, b.z ), f4mul( a.z, b.y ) );
+  c.y = f4sub( f4mul( a.z, b.x ), f4mul( a.x, b.z ) );
+  c.z = f4sub( f4mul( a.x, b.y ), f4mul( a.y, b.x ) );
+  return c;
+}
+
+static inline f4 dot4( f4vec3 a, f4vec3 b )
+
+{
+  return f4madd( a.x, b.x, f4madd( a.y, b.y, f4mul( a.z, b.z ) ) );
+}
+
+
+// rayTriangle() for four rays and triangles.  Returns a mask of the
+// lanes that hit, with t, u and v in every lane.
+
+
+static inline f4 rayTriangle4( f4vec3 start, f4vec3 dir, f4vec3 v0, f4vec3 e1, f4vec3 e2, f4 tMin, f4 &t, f4 &u, f4 &v )
+
+{
+  const f4 zero = f4splat( 0 );
+
+  f4vec3 p = cross4( dir, e2 );
+  f4 det = dot4( e1, p );
+  f4 inv = f4div( f4splat( 1 ), det );
+
+  f4vec3 s = { f4sub( start.x, v0.x ), f4sub( start.y, v0.y ), f4sub( start.z, v0.z ) };
+  u = f4mul( dot4( s, p ), inv );
+
+  f4vec3 q = cross4( s, e1 );
+  v = f4mul( dot4( dir, q ), inv );
+
+  t = f4mul( dot4( e2, q ), inv );
+
+  f4 absDet = f4max( det, f4sub( zero, det ) );
+
+  f4 hit = f4cmplt( f4splat( 1e-12 ), absDet );
+  hit = f4and( hit, f4cmple( f4splat( -EDGE_EPS ), u ) );
+  hit = f4and( hit, f4cmple( f4splat( -EDGE_EPS ), v ) );
+  hit = f4and( hit, f4cmple( f4add( u, v ), f4splat( 1+EDGE_EPS ) ) );
+  hit = f4and( hit, f4cmple( tMin, t ) );
+
+  return hit;
+}
+
+
+// Record the hit of ray i in triangle 'tri' of quad (cx,cy) at
+// barycentric coordinates (u,v).  The normal is interpolated from the
+// triangle's vertex normals.
+
+
+void HeightMap::recordHit( int i, vec3 start, vec3 dir, float t, int cx, int cy, int tri, float u, float v,
+                           vec3 *hits, vec3 *hitNormals, float *dists )
+
+{
+  int k00 = cy*width + cx;
+  int k10 = k00 + 1;
+  int k01 = k00 + width;
+  int k11 = k01 + 1;
+
+  vec3 n;
+  if (tri == 0)
+    n = (1-u-v) * normals[k00] + u * normals[k10] + v * normals[k01];
+  else
+    n = (1-u-v) * normals[k11] + u * normals[k01] + v * normals[k10];
+
+  if (hits != NULL)
+    hits[i] = start + t * dir;
+  if (hitNormals != NULL)
+    hitNormals[i] = n.normalize();
+  dists[i] = t;
+}
+
+
+int HeightMap::intersectRays( const vec3 *starts, const vec3 *dirs, int n, vec3 *hits, vec3 *hitNormals, float *dists,
+                              ThreadPool &pool )
+
+{
+  std::atomic<int> nHits( 0 );
+
+  pool.parallelFor( 0, n, RAYS_PER_TASK, [&]( int begin, int end ) {
+    nHits += intersectRange( starts, dirs, begin, end, hits, hitNormals, dists );
+  } );
+
+  return nHits;
+}
+
+
+int HeightMap::intersectRange( const vec3 *starts, const vec3 *dirs, int begin, int end,
+                               vec3 *hits, vec3 *hitNormals, float *dists )
+
+{
+  int top = maxPyramid.size()-1;
+
+  // The state of each lane, as arrays that are loaded into f4s at each
+  // step.  An idle lane has tLeave < t.
+
+  float sx[4], sy[4], sz[4];          // ray start
+  float dx[4], dy[4], dz[4];          // ray direction
+  float invX[4], invY[4], step[4];
+  float t[4], tFrom[4], tLeave[4];
+
+  int ray[4];                         // index of the lane's ray, or -1
+  int level[4];
+
+  int next = begin;
+  int nHits = 0;
+
+  // Give a lane the next ray that reaches the heightfield's box
+
+  auto startLane = [&]( int lane ) {
+
+    ray[lane] = -1;
+
+    while (next < end) {
+
+      int i = next++;
+      float tEnter, tExit;
+
+      if (clipRay( starts[i], dirs[i], tEnter, tExit )) {
+        ray[lane] = i;
+        sx[lane] = starts[i].x; sy[lane] = starts[i].y; sz[lane] = starts[i].z;
+        dx[lane] = dirs[i].x;   dy[lane] = dirs[i].y;   dz[lane] = dirs[i].z;
+        invX[lane] = 1 / dirs[i].x;
+        invY[lane] = 1 / dirs[i].y;
+        step[lane] = rayStep( dirs[i] );
+        t[lane] = tFrom[lane] = tEnter;
+        tLeave[lane] = tExit;
+        level[lane] = (top < RAY_START_LEVEL ? top : RAY_START_LEVEL);
+        return;
+      }
+
+      dists[i] = MAXFLOAT;
+    }
+
+    sx[lane] = sy[lane] = sz[lane] = 0;
+    dx[lane] = dy[lane] = 1;
+    dz[lane] = 0;
+    invX[lane] = invY[lane] = 1;
+    step[lane] = 0;
+    t[lane] = tFrom[lane] = 0;
+    tLeave[lane] = -1;
+    level[lane] = 0;
+  };
+
+  // Move a lane past its current cell, which ended at tExit
+
+  auto advanceLane = [&]( int lane, float tExit ) {
+    if (tExit >= tLeave[lane] || fmax( t[lane], tExit ) + step[lane] > tLeave[lane]) {
+      dists[ ray[lane] ] = MAXFLOAT;
+      startLane( lane );
+    } else {
+      tFrom[lane] = tExit;
+      t[lane] = fmax( t[lane], tExit ) + step[lane];
+    }
+  };
+
+  for (int lane=0; lane<4; lane++)
+    startLane( lane );
+
+  const f4 zero = f4splat( 0 );
+  const f4 unit = f4splat( 1 );
+  const f4 big  = f4splat( MAXFLOAT );
+  const f4 maxX = f4splat( width-1 );
+  const f4 maxY = f4splat( height-1 );
+
+  while (ray[0] >= 0 || ray[1] >= 0 || ray[2] >= 0 || ray[3] >= 0) {
+
+    // Each lane's level
+
+    float sizeL[4], invSizeL[4], lastX[4], lastY[4];
+    const float *maxL[4];
+
+    for (int lane=0; lane<4; lane++) {
+      int l = level[lane];
+      sizeL[lane]    = 1 << l;
+      invSizeL[lane] = 1.0f / (1 << l);
+      lastX[lane]    = pyramidX[l] - 1;
+      lastY[lane]    = pyramidY[l] - 1;
+      maxL[lane]     = maxPyramid[l].array();
+    }
+
+    f4 S    = f4load( sizeL );
+    f4 invS = f4load( invSizeL );
+
+    f4 SX = f4load( sx ), SY = f4load( sy ), SZ = f4load( sz );
+    f4 DX = f4load( dx ), DY = f4load( dy ), DZ = f4load( dz );
+    f4 T = f4load( t ), TFROM = f4load( tFrom ), TLEAVE = f4load( tLeave );
+
+    // The cell containing each ray, as in intersectRay().  For a ray
+    // moving towards -x, ceil(u)-1 is computed as -floor(-u)-1.
+
+    f4 negX = f4cmplt( DX, zero );
+    f4 negY = f4cmplt( DY, zero );
+    f4 posX = f4cmplt( zero, DX );
+    f4 posY = f4cmplt( zero, DY );
+
+    f4 ux = f4mul( f4madd( T, DX, SX ), invS );
+    f4 uy = f4mul( f4madd( T, DY, SY ), invS );
+
+    f4 fx = f4floor( f4select( negX, f4sub( zero, ux ), ux ) );
+    f4 fy = f4floor( f4select( negY, f4sub( zero, uy ), uy ) );
+
+    f4 CX = f4select( negX, f4sub( f4sub( zero, fx ), unit ), fx );
+    f4 CY = f4select( negY, f4sub( f4sub( zero, fy ), unit ), fy );
+
+    CX = f4min( f4max( CX, zero ), f4load( lastX ) );
+    CY = f4min( f4max( CY, zero ), f4load( lastY ) );
+
+    // Where each ray leaves its cell, and its lowest point there
+
+    f4 X0 = f4mul( CX, S ), X1 = f4min( f4add( X0, S ), maxX );
+    f4 Y0 = f4mul( CY, S ), Y1 = f4min( f4add( Y0, S ), maxY );
+
+    f4 TX = f4select( posX, f4mul( f4sub( X1, SX ), f4load( invX ) ),
+            f4select( negX, f4mul( f4sub( X0, SX ), f4load( invX ) ), big ) );
+    f4 TY = f4select( posY, f4mul( f4sub( Y1, SY ), f4load( invY ) ),
+            f4select( negY, f4mul( f4sub( Y0, SY ), f4load( invY ) ), big ) );
+
+    f4 TEXIT = f4min( f4min( TX, TY ), TLEAVE );
+
+    f4 zLow = f4min( f4madd( TFROM, DZ, SZ ), f4madd( TEXIT, DZ, SZ ) );
+
+    // The cells' maximum heights
+
+    float cellX[4], cellY[4], tExit[4];
+
+    f4store( cellX, CX );
+    f4store( cellY, CY );
+    f4store( tExit, TEXIT );
+
+    int cell[4];
+    for (int lane=0; lane<4; lane++)
+      cell[lane] = (int) cellY[lane] * (lastX[lane]+1) + (int) cellX[lane];
+
+    f4 M = f4set( maxL[0][ cell[0] ], maxL[1][ cell[1] ], maxL[2][ cell[2] ], maxL[3][ cell[3] ] );
+
+    int below = f4movemask( f4cmple( zLow, M ) );
+    int exitX = f4movemask( f4cmple( TX, TY ) );
+
+    // Go down a level, or on to the next cell, or mark the lane for
+    // the triangle test
+
+    int testMask = 0;
+
+    for (int lane=0; lane<4; lane++) {
+
+      if (ray[lane] < 0)
+        continue;
+
+      if (below & (1 << lane)) {
+        if (level[lane] > 0)
+          level[lane]--;
+        else
+          testMask |= (1 << lane);
+      } else {
+        bool leavesParent = ((exitX & (1 << lane)) ? ((int) cellX[lane] & 1) == (dx[lane] > 0)
+                                                   : ((int) cellY[lane] & 1) == (dy[lane] > 0));
+        if (level[lane] < top && leavesParent)
+          level[lane]++;
+        advanceLane( lane, tExit[lane] );
+      }
+    }
+
+    if (testMask == 0)
+      continue;
+
+    // The two triangles of each lane's quad.  At level 0 a cell is a
+    // quad, and cells stop short of the last row and column, so all
+    // four corners are in the heightfield.
+
+    float hll[4], hlr[4], hul[4], hur[4];
+
+    for (int lane=0; lane<4; lane++) {
+      int k = (testMask & (1 << lane)) ? (int) cellY[lane] * width + (int) cellX[lane] : 0;
+      hll[lane] = heights[ k ];
+      hlr[lane] = heights[ k+1 ];
+      hul[lane] = heights[ k+width ];
+      hur[lane] = heights[ k+width+1 ];
+    }
+
+    f4 HLL = f4load( hll ), HLR = f4load( hlr ), HUL = f4load( hul ), HUR = f4load( hur );
+
+    f4vec3 entry = { f4madd( TFROM, DX, SX ), f4madd( TFROM, DY, SY ), f4madd( TFROM, DZ, SZ ) };
+    f4vec3 dir   = { DX, DY, DZ };
+    f4 tMin = f4sub( zero, TFROM );
+
+    f4 negUnit = f4splat( -1 );
+
+    f4vec3 ll  = { CX, CY, HLL };
+    f4vec3 e01 = { unit, zero, f4sub( HLR, HLL ) };            // lr - ll
+    f4vec3 e02 = { zero, unit, f4sub( HUL, HLL ) };            // ul - ll
+
+    f4vec3 ur  = { f4add( CX, unit ), f4add( CY, unit ), HUR };
+    f4vec3 e11 = { negUnit, zero, f4sub( HUL, HUR ) };         // ul - ur
+    f4vec3 e12 = { zero, negUnit, f4sub( HLR, HUR ) };         // lr - ur
+
+    f4 t0, u0, v0, t1, u1, v1;
+
+    f4 hit0 = rayTriangle4( entry, dir, ll, e01, e02, tMin, t0, u0, v0 );
+    f4 hit1 = rayTriangle4( entry, dir, ur, e11, e12, tMin, t1, u1, v1 );
+
+    // Take triangle 0 where it alone is hit or is hit first
+
+    f4 use0 = f4andnot( hit0, f4and( hit1, f4cmplt( t1, t0 ) ) );
+
+    int hitMask = f4movemask( f4or( hit0, hit1 ) );
+    int use0Mask = f4movemask( use0 );
+
+    float hitT[4], hitU[4], hitV[4];
+
+    f4store( hitT, f4add( TFROM, f4select( use0, t0, t1 ) ) );
+    f4store( hitU, f4select( use0, u0, u1 ) );
+    f4store( hitV, f4select( use0, v0, v1 ) );
+
+    for (int lane=0; lane<4; lane++) {
+
+      if (!(testMask & (1 << lane)))
+        continue;
+
+      if (hitMask & (1 << lane)) {
+        int i = ray[lane];
+        recordHit( i, starts[i], dirs[i], hitT[lane], (int) cellX[lane], (int) cellY[lane],
+                   (use0Mask & (1 << lane)) ? 0 : 1, hitU[lane], hitV[lane], hits, hitNormals, dists );
+        nHits++;
+        startLane( lane );
+      } else
+        advanceLane( lane, tExit[lane] );
+    }
+  }
+
+  return nHits;
+}
+
+
+// ---------------- sampling between the vertices ----------------
+
+
+// A vertex index, clamped to [0,n-1]
+
+static inline int clampIndex( int i, int n )
+
+{
+  return (i < 0 ? 0 : (i > n-1 ? n-1 : i));
+}
+
+
+// Catmull-Rom weights of the vertices at -1, 0, 1 and 2 for a point t
+// in [0,1] of the way from vertex 0 to vertex 1, and their derivatives.
+// The SIMD version in sampleRange() does the same operations in the
+// same order.
+
+static inline void cubicWeights( float t, float w[4], float dw[4] )
+
+{
+  float t2 = t*t;
+  float t3 = t2*t;
+
+  w[0] = 0.5f * (2*t2 - t3 - t);
+  w[1] = 0.5f * (3*t3 - 5*t2 + 2);
+  w[2] = 0.5f * (4*t2 - 3*t3 + t);
+  w[3] = 0.5f * (t3 - t2);
+
+  dw[0] = 0.5f * (4*t - 3*t2 - 1);
+  dw[1] = 0.5f * (9*t2 - 10*t);
+  dw[2] = 0.5f * (8*t - 9*t2 + 1);
+  dw[3] = 0.5f * (3*t2 - 2*t);
+}
+
+
+void HeightMap::sample( float x, float y, Filter filter, float &z, vec3 *normal )
+
+{
+  x = fmin( fmax( x, 0 ), width-1 );
+  y = fmin( fmax( y, 0 ), height-1 );
+
+  int ix = (int) x;
+  int iy = (int) y;
+
+  float fx = x - ix;
+  float fy = y - iy;
+
+  if (filter == BILINEAR) {
+
+    int k  = iy*width + ix;
+    int dx = (ix < width-1  ? 1 : 0);
+    int dy = (iy < height-1 ? width : 0);
+
+    float z0 = heights[k]    + fx * (heights[k+dx]    - heights[k]);
+    float z1 = heights[k+dy] + fx * (heights[k+dy+dx] - heights[k+dy]);
+
+    z = z0 + fy * (z1 - z0);
+
+    if (normal != NULL) {
+      vec3 n0 = normals[k]    + fx * (normals[k+dx]    - normals[k]);
+      vec3 n1 = normals[k+dy] + fx * (normals[k+dy+dx] - normals[k+dy]);
+      *normal = (n0 + fy * (n1 - n0)).normalize();
+    }
+
+  } else {
+
+    float wx[4], dwx[4], wy[4], dwy[4];
+
+    cubicWeights( fx, wx, dwx );
+    cubicWeights( fy, wy, dwy );
+
+    float dzdx = 0, dzdy = 0;
+
+    z = 0;
+
+    for (int j=0; j<4; j++) {
+
+      const float *row = heights + clampIndex( iy-1+j, height ) * width;
+
+      float r = 0, dr = 0;
+
+      for (int i=0; i<4; i++) {
+        float h = row[ clampIndex( ix-1+i, width ) ];
+        r  = wx[i] * h + r;
+        dr = dwx[i] * h + dr;
+      }
+
+      z    = wy[j] * r + z;
+      dzdx = wy[j] * dr + dzdx;
+      dzdy = dwy[j] * r + dzdy;
+    }
+
+    if (normal != NULL)
+      *normal = vec3( -dzdx, -dzdy, 1 ).normalize();
+  }
+}
+
+
+float HeightMap::heightAt( float x, float y, Filter filter )
+
+{
+  float z;
+  sample( x, y, filter, z, NULL );
+  return z;
+}
+
+
+vec3 HeightMap::normalAt( float x, float y, Filter filter )
+
+{
+  float z;
+  vec3 n;
+  sample( x, y, filter, z, &n );
+  return n;
+}
+
+
+void HeightMap::sampleAt( const float *xs, const float *ys, int n, float *zs, vec3 *normalsOut, Filter filter, ThreadPool &pool )
+
+{
+  pool.parallelFor( 0, n, SAMPLES_PER_TASK, [&]( int begin, int end ) {
+    sampleRange( xs, ys, begin, end, zs, normalsOut, filter );
+  } );
+}
+
+
+// Four positions at a time.  The weights are found in SIMD, and the
+// heights (and normals) of each lane gathered into SIMD registers.
+
+
+void HeightMap::sampleRange( const float *xs, const float *ys, int begin, int end, float *zs, vec3 *normalsOut, Filter filter )
+
+{
+  const f4 zero = f4splat( 0 );
+  const f4 unit = f4splat( 1 );
+  const f4 maxX = f4splat( width-1 );
+  const f4 maxY = f4splat( height-1 );
+
+  int i = begin;
+
+  for ( ; i+4 <= end; i+=4) {
+
+    // f4max() returns its second argument for a NaN, as fmax() does
+
+    f4 X = f4min( f4max( f4load( xs+i ), zero ), maxX );
+    f4 Y = f4min( f4max( f4load( ys+i ), zero ), maxY );
+
+    f4 IX = f4floor( X );
+    f4 IY = f4floor( Y );
+
+    f4 FX = f4sub( X, IX );
+    f4 FY = f4sub( Y, IY );
+
+    float fix[4], fiy[4];
+
+    f4store( fix, IX );
+    f4store( fiy, IY );
+
+    float out[4][4];            // x, y, z of the normals, and their inverse lengths
+
+    if (filter == BILINEAR) {
+
+      int k[4], dx[4], dy[4];
+
+      for (int lane=0; lane<4; lane++) {
+        int ix = (int) fix[lane];
+        int iy = (int) fiy[lane];
+        k[lane]  = iy*width + ix;
+        dx[lane] = (ix < width-1  ? 1 : 0);
+        dy[lane] = (iy < height-1 ? width : 0);
+      }
+
+      // Corners ll, lr, ul, ur of each lane's quad
+
+      auto lerp2 = [&]( const float *v, int stride, int c ) {
+
+        f4 ll = f4set( v[ k[0]*stride+c ], v[ k[1]*stride+c ], v[ k[2]*stride+c ], v[ k[3]*stride+c ] );
+        f4 lr = f4set( v[ (k[0]+dx[0])*stride+c ], v[ (k[1]+dx[1])*stride+c ], v[ (k[2]+dx[2])*stride+c ], v[ (k[3]+dx[3])*stride+c ] );
+        f4 ul = f4set( v[ (k[0]+dy[0])*stride+c ], v[ (k[1]+dy[1])*stride+c ], v[ (k[2]+dy[2])*stride+c ], v[ (k[3]+dy[3])*stride+c ] );
+        f4 ur = f4set( v[ (k[0]+dx[0]+dy[0])*stride+c ], v[ (k[1]+dx[1]+dy[1])*stride+c ],
+                       v[ (k[2]+dx[2]+dy[2])*stride+c ], v[ (k[3]+dx[3]+dy[3])*stride+c ] );
+
+        f4 v0 = f4add( ll, f4mul( FX, f4sub( lr, ll ) ) );
+        f4 v1 = f4add( ul, f4mul( FX, f4sub( ur, ul ) ) );
+
+        return f4add( v0, f4mul( FY, f4sub( v1, v0 ) ) );
+      };
+
+      f4store( zs+i, lerp2( heights, 1, 0 ) );
+
+      if (normalsOut == NULL)
+        continue;
+
+      const float *n = &normals[0].x;
+
+      f4 NX = lerp2( n, 3, 0 );
+      f4 NY = lerp2( n, 3, 1 );
+      f4 NZ = lerp2( n, 3, 2 );
+
+      f4store( out[0], NX );
+      f4store( out[1], NY );
+      f4store( out[2], NZ );
+      f4store( out[3], f4div( unit, f4sqrt( f4madd( NX, NX, f4madd( NY, NY, f4mul( NZ, NZ ) ) ) ) ) );
+
+    } else {
+
+      // Weights, as in cubicWeights()
+
+      const f4 half  = f4splat( 0.5 );
+      const f4 two   = f4splat( 2 );
+      const f4 three = f4splat( 3 );
+
+      f4 W[2][4], DW[2][4];
+      f4 T[2] = { FX, FY };
+
+      for (int a=0; a<2; a++) {
+
+        f4 t  = T[a];
+        f4 t2 = f4mul( t, t );
+        f4 t3 = f4mul( t2, t );
+
+        W[a][0] = f4mul( half, f4sub( f4sub( f4mul( two, t2 ), t3 ), t ) );
+        W[a][1] = f4mul( half, f4add( f4sub( f4mul( three, t3 ), f4mul( f4splat( 5 ), t2 ) ), two ) );
+        W[a][2] = f4mul( half, f4add( f4sub( f4mul( f4splat( 4 ), t2 ), f4mul( three, t3 ) ), t ) );
+        W[a][3] = f4mul( half, f4sub( t3, t2 ) );
+
+        DW[a][0] = f4mul( half, f4sub( f4sub( f4mul( f4splat( 4 ), t ), f4mul( three, t2 ) ), unit ) );
+        DW[a][1] = f4mul( half, f4sub( f4mul( f4splat( 9 ), t2 ), f4mul( f4splat( 10 ), t ) ) );
+        DW[a][2] = f4mul( half, f4add( f4sub( f4mul( f4splat( 8 ), t ), f4mul( f4splat( 9 ), t2 ) ), unit ) );
+        DW[a][3] = f4mul( half, f4sub( f4mul( three, t2 ), f4mul( two, t ) ) );
+      }
+
+      // The 4x4 vertices around each lane's position
+
+      int cols[4][4], rows[4][4];
+
+      for (int lane=0; lane<4; lane++) {
+        int ix = (int) fix[lane];
+        int iy = (int) fiy[lane];
+        for (int o=0; o<4; o++) {
+          cols[lane][o] = clampIndex( ix-1+o, width );
+          rows[lane][o] = clampIndex( iy-1+o, height ) * width;
+        }
+      }
+
+      f4 Z = zero, DZDX = zero, DZDY = zero;
+
+      for (int j=0; j<4; j++) {
+
+        f4 R = zero, DR = zero;
+
+        for (int o=0; o<4; o++) {
+
+          f4 H = f4set( heights[ rows[0][j] + cols[0][o] ], heights[ rows[1][j] + cols[1][o] ],
+                        heights[ rows[2][j] + cols[2][o] ], heights[ rows[3][j] + cols[3][o] ] );
+
+          R  = f4madd( W[0][o], H, R );
+          DR = f4madd( DW[0][o], H, DR );
+        }
+
+        Z    = f4madd( W[1][j], R, Z );
+        DZDX = f4madd( W[1][j], DR, DZDX );
+        DZDY = f4madd( DW[1][j], R, DZDY );
+      }
+
+      f4store( zs+i, Z );
+
+      if (normalsOut == NULL)
+        continue;
+
+      f4store( out[0], f4sub( zero, DZDX ) );
+      f4store( out[1], f4sub( zero, DZDY ) );
+      f4store( out[2], unit );
+      f4store( out[3], f4div( unit, f4sqrt( f4madd( DZDX, DZDX, f4madd( DZDY, DZDY, unit ) ) ) ) );
+    }
+
+    for (int lane=0; lane<4; lane++)
+      normalsOut[i+lane] = out[3][lane] * vec3( out[0][lane], out[1][lane], out[2][lane] );
+  }
+
+  // The rest
+
+  for ( ; i<end; i++)
+    sample( xs[i], ys[i], filter, zs[i], (normalsOut != NULL ? &normalsOut[i] : NULL) );
+}
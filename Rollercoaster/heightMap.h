@@ -0,0 +1,126 @@
+// heightMap.h
+//
+// The terrain's heightfield, without any OpenGL, so that it can be
+// built and timed without a GPU.
+//
+// The heights and normals are stored row by row: vertex (x,y) is at
+// (x, y, heights[y*width+x]) and has normal normals[y*width+x].
+// heights is 64-byte aligned.
+//
+//    HeightMap map;
+//    map.build( texels, bytesPerTexel, width, height, maxHeight );
+//
+// build() spreads its rows over a ThreadPool (by default the global
+// one).
+//
+// Rays are cast with intersectRay(), which walks a pyramid of maximum
+// heights: level 0 holds the highest corner of each quad and each later
+// level the maximum of 2x2 cells of the level before, up to a single
+// cell.  A ray skips any cell that it passes entirely above, and so
+// crosses open ground in large steps, and only the quads that it might
+// hit are tested against their two triangles.  intersectRays() casts
+// many rays through the same pyramid, four at a time in SIMD lanes and
+// in parallel over a ThreadPool.
+//
+// heightAt() and normalAt() sample the surface anywhere, bilinearly or
+// bicubically, and sampleAt() does so at many positions at once.
+
+
+#ifndef HEIGHT_MAP_H
+#define HEIGHT_MAP_H
+
+#include "linalg.h"
+#include "threadPool.h"
+#include "seq.h"
+
+
+class HeightMap {
+
+ public:
+
+  int    width, height;
+  float *heights;
+  vec3  *normals;
+
+  HeightMap() {
+    width = height = 0;
+    heights = NULL;
+    normals = NULL;
+  }
+
+  ~HeightMap() {
+    release();
+  }
+
+  HeightMap( const HeightMap & ) = delete;
+  HeightMap & operator = ( const HeightMap & ) = delete;
+
+  // Heights come from the first byte (red) of each texel, scaled from
+  // [0,255] to [0,maxHeight]
+
+  void build( const unsigned char *texels, int bytesPerTexel, int w, int h, double maxHeight,
+              ThreadPool &pool = ThreadPool::global() );
+
+  void computeNormals( ThreadPool &pool = ThreadPool::global() );
+
+  // The point of vertex (x,y), with x and y clamped to the heightfield
+
+  vec3 point( int x, int y ) {
+    x = (x < 0 ? 0 : (x > width-1  ? width-1  : x));
+    y = (y < 0 ? 0 : (y > height-1 ? height-1 : y));
+    return vec3( x, y, heights[ y*width + x ] );
+  }
+
+  // Find the first point at which start + t*dir (t >= 0) hits the
+  // surface.  t is returned in units of dir.
+
+  bool intersectRay( vec3 start, vec3 dir, vec3 &hit, float &t );
+
+  // Cast n rays in SIMD packets, spread over 'pool'.  For each ray i
+  // that hits, dists[i] is its t, hits[i] its hit point, and
+  // hitNormals[i] the surface normal there (interpolated from the
+  // vertex normals).  For a ray that misses, dists[i] is MAXFLOAT and
+  // the others are left alone.  hits and hitNormals may be NULL.
+  // Returns the number of hits.
+
+  int intersectRays( const vec3 *starts, const vec3 *dirs, int n, vec3 *hits, vec3 *hitNormals, float *dists,
+                     ThreadPool &pool = ThreadPool::global() );
+
+  // The surface between the vertices, at (x,y) clamped to the
+  // heightfield.  BILINEAR blends the heights of the four surrounding
+  // vertices and, for the normal, their normals (as the terrain is
+  // shaded).  BICUBIC passes a Catmull-Rom spline through the 4x4
+  // surrounding heights, which is smooth across quads, and takes the
+  // normal from its gradient.  Both go through the vertices.
+
+  enum Filter { BILINEAR, BICUBIC };
+
+  float heightAt( float x, float y, Filter filter = BILINEAR );
+  vec3  normalAt( float x, float y, Filter filter = BILINEAR );
+
+  // The same at n positions (xs[i],ys[i]), four at a time in SIMD
+  // lanes and spread over 'pool'.  normalsOut may be NULL.
+
+  void sampleAt( const float *xs, const float *ys, int n, float *zs, vec3 *normalsOut, Filter filter = BILINEAR,
+                 ThreadPool &pool = ThreadPool::global() );
+
+ private:
+
+  seq< seq<float> > maxPyramid;           // row by row at each level
+  seq<int> pyramidX, pyramidY;
+
+  void release();
+  void normalRows( int y0, int y1 );
+  void buildMaxPyramid( ThreadPool &pool );
+
+  bool clipRay( vec3 start, vec3 dir, float &tEnter, float &tLeave );
+  int  intersectRange( const vec3 *starts, const vec3 *dirs, int begin, int end,
+                       vec3 *hits, vec3 *hitNormals, float *dists );
+  void recordHit( int i, vec3 start, vec3 dir, float t, int cx, int cy, int tri, float u, float v,
+                  vec3 *hits, vec3 *hitNormals, float *dists );
+
+  void sample( float x, float y, Filter filter, float &z, vec3 *normal );
+  void sampleRange( const float *xs, const float *ys, int begin, int end, float *zs, vec3 *normalsOut, Filter filter );
+};
+
+#endif
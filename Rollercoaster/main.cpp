@@ -4,6 +4,9 @@
 #include "headers.h"
 #include "shMem.h"
 #include "world.h"
+#include "headless.h"
+
+#include <chrono>
 
 // Error callback
 void errorCallback( int error, const char* description ) {
@@ -22,7 +25,31 @@ void framebufferReshapeCallback( GLFWwindow* window, int width, int height ) {
     glViewport( 0, 0, width, height );
 }
 
-int main() {
+int main( int argc, char **argv ) {
+
+  // Without a window, draw a fixed number of frames offscreen and time
+  // them (see headless.h)
+
+  Headless headless;
+
+  if (headless.parseArgs( argc, argv )) {
+
+    headless.init();
+
+    windowWidth  = headless.width;
+    windowHeight = headless.height;
+
+    std::shared_ptr<World> world(new World( NULL ));
+    initSharedObjects();
+    world->addTestTrack( 12 );
+    world->setMaxStepsPerFrame( 0 ); // every step of every frame, so runs replay exactly
+
+    headless.replay( [&]( float elapsedSeconds ) { world->update( elapsedSeconds ); },
+                     [&]() { world->draw( false ); } );
+
+    return 0;
+  }
+
   // Initialize the window
 
   glfwSetErrorCallback( errorCallback );
@@ -63,17 +90,17 @@ int main() {
   // Some basic objects
   initSharedObjects();
 
-  // Main loop
+  // Main loop.  Frames are timed on a monotonic clock, and the world
+  // steps its simulation in fixed steps within them.
 
-  struct timeb prevTime, thisTime; // record the last rendering time
-  ftime( &prevTime );
+  auto prevTime = std::chrono::steady_clock::now(); // record the last rendering time
 
   while (!glfwWindowShouldClose( window )) {
 
     // Update the world state
 
-    ftime( &thisTime );
-    float elapsedSeconds = (thisTime.time + thisTime.millitm / 1000.0) - (prevTime.time + prevTime.millitm / 1000.0);
+    auto thisTime = std::chrono::steady_clock::now();
+    double elapsedSeconds = std::chrono::duration<double>( thisTime - prevTime ).count();
     prevTime = thisTime;
 
     world->update( elapsedSeconds );
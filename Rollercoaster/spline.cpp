@@ -4,9 +4,10 @@
 
 #include "spline.h"
 #include "shMem.h"
+#include "simd.h"
 
 
-#define DIVS_PER_SEG 20         // number of samples of on each spline segment (for arc length parameterization)
+#define DIVS_PER_SEG 20         // number of samples on each spline segment when drawing
 
 float Spline::M[][4][4] = {
 
@@ -36,105 +37,339 @@ const char * Spline::MName[] = {
 };
 
 
-// Evaluate the spline at parameter 't'.  Return the value, tangent
-// (i.e. first derivative), or binormal, depending on the
-// 'returnDerivative' parameter.
+// Evaluate the spline at parameter 't'.  Return the value or tangent
+// (i.e. first derivative), depending on the 'type' parameter.
 //
 // The spline is continuous, so the first data point appears again
 // after the last data point.  t=0 at the first data point and t=n-1
 // at the n^th data point.  For t outside this range, use 't modulo n'.
 //
-// Use the change-of-basis matrix in M[currSpline].
+// The per-segment polynomials come from the change-of-basis matrix in
+// M[currSpline] and are cached by computeCoefficients(), so each call
+// is just a Horner evaluation.
 
 
 vec3 Spline::eval( float t, evalType type )
 
 {
-  // YOUR CODE HERE
+  if (data.size() == 0)
+    return vec3(0,0,0);
+
+  updateCoefficients();
+
+  int i;
+  float u;
+
+  locate( t, i, u );
+
+  const vec3 *c = &coeffs[4*i];
+
+  if (type == TANGENT)
+    return (u * ((3*u) * c[0] + 2 * c[1])) + c[2];
+
+  return (u * ((u * ((u * c[0]) + c[1])) + c[2])) + c[3];
+}
+
+
+// Find the segment index and the u value in [0,1] for parameter t.
+// Assumes data.size() > 0.
+
+
+void Spline::locate( float t, int &seg, float &u )
+
+{
+  int n = data.size();
 
   // for t outside [0,data.size()), move t into range
-    if (t >= data.size())
-        t = t - data.size();
+
+  if (t >= n)
+    t = t - n;
+  if (t < 0)
+    t = t + n;
+  if (t < 0 || t >= n) {
+    t = fmod( t, (float) n );
     if (t < 0)
-        t = t + data.size();
-    float u = t - floor(t);
+      t = t + n;
+  }
 
-  // Find the 4 control points for this t, and the u value in [0,1] for this interval.
-    vec3 qim1;
-    if (floor(t) == 0)
-        qim1 = data[data.size() - 1];
-    else
-        qim1 = data[floor(t) - 1];
-    vec3 qi = data[floor(t)];
-    vec3 qip1 = data[(int(floor(t)) + 1) % data.size()];
-    vec3 qip2 = data[(int(floor(t)) + 2) % data.size()];
-
-  // Compute Mv
-    mat4 v;
-    v.rows[0] = vec4(qim1, 0);
-    v.rows[1] = vec4(qi, 0);
-    v.rows[2] = vec4(qip1, 0);
-    v.rows[3] = vec4(qip2, 0);
-
-    mat4 M2;
-    M2.rows[0] = vec4(M[currSpline][0][0], M[currSpline][0][1], M[currSpline][0][2], M[currSpline][0][3]);
-    M2.rows[1] = vec4(M[currSpline][1][0], M[currSpline][1][1], M[currSpline][1][2], M[currSpline][1][3]);
-    M2.rows[2] = vec4(M[currSpline][2][0], M[currSpline][2][1], M[currSpline][2][2], M[currSpline][2][3]);
-    M2.rows[3] = vec4(M[currSpline][3][0], M[currSpline][3][1], M[currSpline][3][2], M[currSpline][3][3]);
-
-    mat4 Mv = M2 * v;
-    vec4 T = vec4(pow(u, 3), pow(u, 2), u, 1);
-    vec4 Tprime = vec4(3 * pow(u, 2), 2 * u, 1, 0);
-    vec3 result;
-
-  // If type == VALUE, return the value = T (Mv)
-    if (type == VALUE) {
-        result.x = T.x * Mv[0][0] + T.y * Mv[1][0] + T.z * Mv[2][0] + T.w * Mv[3][0];
-        result.y = T.x * Mv[0][1] + T.y * Mv[1][1] + T.z * Mv[2][1] + T.w * Mv[3][1];
-        result.z = T.x * Mv[0][2] + T.y * Mv[1][2] + T.z * Mv[2][2] + T.w * Mv[3][2];
+  seg = (int) t;
+  if (seg >= n)                 // t rounded up to n
+    seg = n-1;
+  u = t - seg;
+}
+
+
+// Evaluate many parameters at once.
+//
+// Parameters are handled four at a time, with the coefficient
+// components held in SIMD lanes.  When the four parameters fall in the
+// same segment (the usual case for sorted t) the coefficients are
+// broadcast; otherwise they are gathered per lane.
+
+
+void Spline::evalBatch( const float *t, int n, vec3 *values, vec3 *tangents )
+
+{
+  if (data.size() == 0) {
+    for (int k=0; k<n; k++) {
+      if (values != NULL)
+        values[k] = vec3(0,0,0);
+      if (tangents != NULL)
+        tangents[k] = vec3(0,0,0);
+    }
+    return;
+  }
+
+  updateCoefficients();
+
+  const vec3 *C = &coeffs[0];
+
+  const f4 two   = f4splat( 2 );
+  const f4 three = f4splat( 3 );
+
+  int k = 0;
+
+  for ( ; k+4<=n; k+=4) {
+
+    int   seg[4];
+    float u[4];
+
+    for (int l=0; l<4; l++)
+      locate( t[k+l], seg[l], u[l] );
+
+    // c[j][d] = component d of coefficient j, one lane per parameter
+
+    f4 c[4][3];
+
+    if (seg[0] == seg[1] && seg[0] == seg[2] && seg[0] == seg[3]) {
+      const vec3 *q = C + 4*seg[0];
+      for (int j=0; j<4; j++) {
+        c[j][0] = f4splat( q[j].x );
+        c[j][1] = f4splat( q[j].y );
+        c[j][2] = f4splat( q[j].z );
+      }
+    } else {
+      const vec3 *q0 = C + 4*seg[0];
+      const vec3 *q1 = C + 4*seg[1];
+      const vec3 *q2 = C + 4*seg[2];
+      const vec3 *q3 = C + 4*seg[3];
+      for (int j=0; j<4; j++) {
+        c[j][0] = f4set( q0[j].x, q1[j].x, q2[j].x, q3[j].x );
+        c[j][1] = f4set( q0[j].y, q1[j].y, q2[j].y, q3[j].y );
+        c[j][2] = f4set( q0[j].z, q1[j].z, q2[j].z, q3[j].z );
+      }
+    }
+
+    f4 uu = f4load( u );
+
+    float out[3][4];
+
+    if (values != NULL) {
+      for (int d=0; d<3; d++)
+        f4store( out[d], f4add( f4mul( uu, f4add( f4mul( uu, f4add( f4mul( uu, c[0][d] ), c[1][d] ) ), c[2][d] ) ), c[3][d] ) );
+      for (int l=0; l<4; l++)
+        values[k+l] = vec3( out[0][l], out[1][l], out[2][l] );
+    }
+
+    if (tangents != NULL) {
+      f4 u3 = f4mul( three, uu );
+      for (int d=0; d<3; d++)
+        f4store( out[d], f4add( f4mul( uu, f4add( f4mul( u3, c[0][d] ), f4mul( two, c[1][d] ) ) ), c[2][d] ) );
+      for (int l=0; l<4; l++)
+        tangents[k+l] = vec3( out[0][l], out[1][l], out[2][l] );
     }
+  }
+
+  // remainder
+
+  for ( ; k<n; k++) {
+    if (values != NULL)
+      values[k] = eval( t[k], VALUE );
+    if (tangents != NULL)
+      tangents[k] = eval( t[k], TANGENT );
+  }
+}
+
+
+// Fill in the coefficients of every segment.  Segment i uses control
+// points i-1 ... i+2 (modulo n), and its coefficients are the rows of
+// M[currSpline] times those four points.
+
+
+void Spline::computeCoefficients()
+
+{
+  int n = data.size();
+
+  coeffs.clear();
+  coeffs.reserve( 4*n );
+
+  for (int i=0; i<4*n; i++)
+    coeffs.add( vec3(0,0,0) );
+
+  segStamps.clear();
+  segStamps.reserve( n );
+
+  for (int i=0; i<n; i++)
+    segStamps.add( 0 );
+
+  for (int i=0; i<n; i++)
+    computeSegmentCoefficients( i );
+
+  dirtySegs.clear();
+  mustRecomputeCoeffs = false;
+}
+
+
+void Spline::computeSegmentCoefficients( int i )
 
-  // If type == TANGENT, return the value T' (Mv)
-    if (type == TANGENT) {
-        result.x = Tprime.x * Mv[0][0] + Tprime.y * Mv[1][0] + Tprime.z * Mv[2][0] + Tprime.w * Mv[3][0];
-        result.y = Tprime.x * Mv[0][1] + Tprime.y * Mv[1][1] + Tprime.z * Mv[2][1] + Tprime.w * Mv[3][1];
-        result.z = Tprime.x * Mv[0][2] + Tprime.y * Mv[1][2] + Tprime.z * Mv[2][2] + Tprime.w * Mv[3][2];
+{
+  int n = data.size();
+
+  float (*B)[4] = M[currSpline];
+
+  vec3 q[4] = { data[(i-1+n) % n],
+                data[i],
+                data[(i+1) % n],
+                data[(i+2) % n] };
+
+  for (int k=0; k<4; k++)
+    coeffs[4*i+k] = B[k][0]*q[0] + B[k][1]*q[1] + B[k][2]*q[2] + B[k][3]*q[3];
+
+  segStamps[i] = ++lastStamp;
+}
+
+
+// Data point j was moved.  With a cubic basis only segments j-2 ... j+1
+// depend on it, so just those are marked for recomputation.  If the
+// coefficients are not already valid for the current points, fall back
+// to invalidating everything.
+//
+// The frame table depends on the whole curve, so it is rebuilt, unless
+// the frames are held (see holdFrames), in which case it is only
+// marked as stale.
+
+
+void Spline::pointMoved( int j )
+
+{
+  int n = data.size();
+
+  if (framesHeld) {
+    framesStale = true;
+    frameVersion++;
+  } else
+    mustRecomputeFrames = true;
+
+  if (mustRecomputeCoeffs || coeffs.size() != 4*n) {
+    invalidate();
+    return;
+  }
+
+  for (int k=-2; k<=1; k++) {
+    int i = ((j+k) % n + n) % n;
+    if (!dirtySegs.exists( i ))
+      dirtySegs.add( i );
+  }
+}
+
+
+// Recompute the dirty segments' coefficients and, if the arc-length
+// table is otherwise valid, their arc-length tables, repairing the
+// prefix sums in O(log n) per segment.  The index over the whole
+// length is left stale (see computeArcIndex).
+
+
+void Spline::updateDirtySegments()
+
+{
+  bool updateTable = (!mustRecomputeArcLength && arcSegs.size() == data.size());
+
+  for (int k=0; k<dirtySegs.size(); k++) {
+
+    int i = dirtySegs[k];
+
+    computeSegmentCoefficients( i );
+
+    if (updateTable) {
+      float oldLength = arcSegs[i].length;
+      computeSegmentTable( i );
+      treeAdd( i, arcSegs[i].length - oldLength );
+      arcIndexStale = true;
     }
+  }
+
+  dirtySegs.clear();
+}
+
+
+void Spline::addPoint( vec3 v )
+
+{
+  data.add( v );
+  invalidate();
+}
+
+
+// The unit vector perpendicular to z that points as much up as
+// possible.  Falls back to +y if z is vertical.
 
-  //return vec3(result.x, result.y, result.z);
-    return result;
+
+static vec3 uprightNormal( vec3 z )
+
+{
+  vec3 y = vec3(0,0,1) - z.z * z;
+
+  if (y.length() < 1e-4)
+    y = vec3(0,1,0) - z.y * z;
+
+  return y.normalize();
 }
 
 
-// Find a local coordinate system at t.  Return the axes x,y,z.  y
-// should point as much up as possible and z should point in the
-// direction of increasing position on the curve.
+// Find a local coordinate system at t.  Return the axes x,y,z.  z
+// points in the direction of increasing position on the curve and y
+// is the rotation-minimising normal from the frame table, so the
+// frame stays continuous through vertical tangents and loops.
 
 
 void Spline::findLocalSystem(float t, vec3& o, vec3& x, vec3& y, vec3& z)
 
 {
-#if 1
+  o = value(t);
+  z = tangent(t);
 
-    // YOUR CODE HERE
-    o = value(t);
-    z = tangent(t).normalize();
-    float yz = -(z.x * z.x + z.y * z.y) / z.z;
-    if (yz < 0)
-        y = vec3(-z.x, -z.y, -yz).normalize();
-    else
-        y = vec3(z.x, z.y, yz).normalize();
-    x = (z ^ y).normalize();
+  if (mustRecomputeFrames)
+    computeFrames();
+
+  vec3 fo, fx, fy, fz;
+
+  if (frames.size() > 0)
+    frameAtArcLength( arcLengthAtParam( t ), fo, fx, fy, fz );
 
+  if (z.length() < 1e-6) {      // cusp: use the table's tangent
+    if (frames.size() == 0) {
+      o = vec3(0,0,0);
+      x = vec3(1,0,0);
+      y = vec3(0,1,0);
+      z = vec3(0,0,1);
+      return;
+    }
+    z = fz;
+  }
 
-#else
+  z = z.normalize();
 
-  o = vec3(0,0,0);
-  x = vec3(1,0,0);
-  y = vec3(0,1,0);
-  z = vec3(0,0,1);
+  if (frames.size() > 0) {
+    y = fy - (fy * z) * z;      // re-orthogonalise against the exact tangent
+    if (y.length() < 1e-4)
+      y = uprightNormal( z );
+    else
+      y = y.normalize();
+  } else
+    y = uprightNormal( z );
 
-#endif
+  x = (z ^ y).normalize();
 }
 
 
@@ -184,17 +419,20 @@ void Spline::draw( mat4 &MV, mat4 &MVP, vec3 lightDir, bool drawIntervals )
 {
   // Draw the spline
 
-  vec3 *points = new vec3[ data.size()*DIVS_PER_SEG + 1 ];
-  vec3 *colours = new vec3[ data.size()*DIVS_PER_SEG + 1 ];
+  int nPts = data.size()*DIVS_PER_SEG;
 
-  int i = 0;
-  for (float t=0; t<data.size(); t+=1/(float)DIVS_PER_SEG) {
-    points[i] = value( t );
+  float *params = new float[ nPts ];
+  vec3 *points = new vec3[ nPts ];
+  vec3 *colours = new vec3[ nPts ];
+
+  for (int i=0; i<nPts; i++) {
+    params[i] = i / (float) DIVS_PER_SEG;
     colours[i] = SPLINE_COLOUR;
-    i++;
   }
 
-  segs->drawSegs( GL_LINE_LOOP, points, colours, i, MV, MVP, lightDir );
+  evalBatch( params, nPts, points, NULL );
+
+  segs->drawSegs( GL_LINE_LOOP, points, colours, nPts, MV, MVP, lightDir );
 
   // Draw points evenly spaced in the parameter
 
@@ -202,6 +440,7 @@ void Spline::draw( mat4 &MV, mat4 &MVP, vec3 lightDir, bool drawIntervals )
     for (float t=0; t<data.size(); t+=1/(float)DIVS_PER_SEG)
       drawLocalSystem( t, MVP );
 
+  delete[] params;
   delete[] points;
   delete[] colours;
 }
@@ -215,17 +454,20 @@ void Spline::drawWithArcLength( mat4 &MV, mat4 &MVP, vec3 lightDir, bool drawInt
 {
   // Draw the spline
 
-  vec3 *points = new vec3[ data.size()*DIVS_PER_SEG + 1 ];
-  vec3 *colours =  new vec3[ data.size()*DIVS_PER_SEG + 1 ];
+  int nPts = data.size()*DIVS_PER_SEG;
 
-  int i = 0;
-  for (float t=0; t<data.size(); t+=1/(float)DIVS_PER_SEG) {
-    points[i] = value( t );
+  float *params = new float[ nPts ];
+  vec3 *points = new vec3[ nPts ];
+  vec3 *colours = new vec3[ nPts ];
+
+  for (int i=0; i<nPts; i++) {
+    params[i] = i / (float) DIVS_PER_SEG;
     colours[i] = SPLINE_COLOUR;
-    i++;
   }
 
-  segs->drawSegs( GL_LINE_LOOP, points, colours, i, MV, MVP, lightDir );
+  evalBatch( params, nPts, points, NULL );
+
+  segs->drawSegs( GL_LINE_LOOP, points, colours, nPts, MV, MVP, lightDir );
 
   // Draw points evenly spaced in arc length
 
@@ -239,113 +481,1121 @@ void Spline::drawWithArcLength( mat4 &MV, mat4 &MVP, vec3 lightDir, bool drawInt
     }
   }
 
+  delete[] params;
   delete[] points;
   delete[] colours;
 }
 
 
-// Fill in an arcLength array such that arcLength[i] is the estimated
-// arc length up to the i^th sample (using DIVS_PER_SEG samples per
-// spline segment).
+// Build the arc-length table: per-segment knots, each with an index
+// that finds the knot interval containing an arc length in O(1), a
+// Fenwick tree over the segment lengths, and an index over the whole
+// length (see computeArcIndex).  The knots of each segment depend only
+// on that segment, so pointMoved() recomputes just the affected ones
+// and repairs the tree in O(log n).
+
+
+#define MIN_ARC_DEPTH 2         // min subdivision depth per segment
+#define MAX_ARC_DEPTH 10        // max subdivision depth per segment
 
 
 void Spline::computeArcLengthParameterization()
 
 {
-  if (data.size() == 0)
+  int n = data.size();
+
+  if (n == 0)
     return;
 
-  if (arcLength != NULL)
-    delete [] arcLength;
+  updateCoefficients();
+
+  if (arcSegs.size() != n) {
+    arcSegs.clear();
+    for (int i=0; i<n; i++)
+      arcSegs.emplace();
+  }
+
+  for (int i=0; i<n; i++)
+    computeSegmentTable( i );
+
+  computeArcIndex();
+
+  mustRecomputeArcLength = false;
+}
+
+
+// Build the knots of segment i by adaptive Gauss-Legendre quadrature.
+
+
+void Spline::computeSegmentTable( int i )
+
+{
+  ArcSegment &seg = arcSegs[i];
+
+  seg.knots.clear();
+  seg.knots.add( ArcKnot( 0, 0, speed( i, 0 ) ) );
+
+  float len = 0;
+  addKnots( i, 0, 1, segmentLength( i, 0, 1 ), arcLengthTol, 0, len );
+
+  seg.length = len;
+  seg.maxZ = segmentMaxZ( i );
+
+  computeSegmentIndex( i );
+}
+
+
+// Build the uniform index over segment i, with one bucket per knot
+// interval, so that a lookup lands on or just before its interval
+
 
-  arcLength = new float[ data.size() * DIVS_PER_SEG + 1 ];
+void Spline::computeSegmentIndex( int i )
 
-  // first sample at length 0
+{
+  ArcSegment &seg = arcSegs[i];
+  seq<ArcKnot> &knots = seg.knots;
 
-  arcLength[0] = 0;
-  vec3 prev = value(0);
+  int nIntervals = knots.size()-1;
 
-  maxHeight = prev.z;
+  seg.buckets.clear();
+  seg.buckets.reserve( nIntervals );
 
-  // Compute intermediate lengths
+  seg.bucketsPerLength = (seg.length > 0 ? nIntervals / seg.length : 0);
 
-  int k = 1;
+  int k = 0;
 
-  for (int i=0; i<data.size(); i++)
-    for (int j=(i>0?0:1); j<DIVS_PER_SEG; j++) {
+  for (int b=0; b<nIntervals; b++) {
 
-      vec3 next = value( i + j/(float)DIVS_PER_SEG );
+    float s = b * seg.length / nIntervals;
 
-      arcLength[k] = arcLength[k-1] + (next-prev).length();
-      prev = next;
+    while (k < nIntervals-1 && knots[k+1].s <= s)
       k++;
 
-      if (next.z > maxHeight)
-        maxHeight = next.z;
-    }
+    seg.buckets.add( k );
+  }
+}
 
-  // last sample at full length
 
-  vec3 next = value( data.size() );
-  arcLength[k] = arcLength[k-1] + (next-prev).length();
+// Accept [a,b] if its length estimate 'whole' agrees with the sum of
+// its two halves to within 'tol', and if the Hermite inverse over
+// [a,b] puts the midpoint within half the tolerance of where it
+// should be; otherwise split it.  The Hermite error peaks at the
+// midpoint, so lookups need no refinement.  Accepted intervals add a
+// knot at b.
+//
+// Every segment is split at least MIN_ARC_DEPTH times: the speed is
+// the root of a quartic and the whole/halves test alone can accept
+// an interval on which the halves are still off by about 'tol'.
 
-  if (next.z > maxHeight)
-    maxHeight = next.z;
 
-  mustRecomputeArcLength = false;
+void Spline::addKnots( int i, float a, float b, float whole, float tol, int depth, float &len )
+
+{
+  float m = 0.5 * (a+b);
+  float left  = segmentLength( i, a, m );
+  float right = segmentLength( i, m, b );
+
+  ArcKnot k1( b, len + left + right, speed( i, b ) );
+
+  bool accept = (depth >= MAX_ARC_DEPTH);
+
+  if (!accept && depth >= MIN_ARC_DEPTH && fabs( left + right - whole ) <= tol) {
+    ArcKnot &k0 = arcSegs[i].knots[ arcSegs[i].knots.size()-1 ];
+    float mErr = fabs( hermiteParam( k0, k1, len + left ) - m ) * speed( i, m );
+    accept = (mErr <= 0.5 * arcLengthTol);
+  }
+
+  if (accept) {
+    len = k1.s;
+    arcSegs[i].knots.add( k1 );
+    return;
+  }
+
+  addKnots( i, a, m, left,  0.5*tol, depth+1, len );
+  addKnots( i, m, b, right, 0.5*tol, depth+1, len );
 }
 
 
-// Find the spline parameter at a particular arc length, s.
+// Length of segment i over [a,b] by five-point Gauss-Legendre quadrature
 
 
-float Spline::paramAtArcLength( float s )
+static const float glNode[5]   = { 0, -0.5384693101, 0.5384693101, -0.9061798459, 0.9061798459 };
+static const float glWeight[5] = { 0.5688888889, 0.4786286705, 0.4786286705, 0.2369268851, 0.2369268851 };
+
+
+float Spline::segmentLength( int i, float a, float b )
 
 {
-  if (mustRecomputeArcLength)
-    computeArcLengthParameterization();
+  float h = 0.5 * (b-a);
+  float mid = 0.5 * (a+b);
 
-  // Do binary search on arc lengths to find l such that
-  //
-  //        arcLength[l] <= s < arcLength[l+1].
+  float sum = 0;
+  for (int k=0; k<5; k++)
+    sum += glWeight[k] * speed( i, mid + h * glNode[k] );
 
-  if (s < 0)
-    s += arcLength[ data.size() * DIVS_PER_SEG ];
+  return h * sum;
+}
 
-  int l = 0;
-  int r = data.size()*DIVS_PER_SEG;
 
-  while (r-l > 1) {
-    int m = (l+r)/2;
-    if (arcLength[m] <= s)
-      l = m;
-    else
-      r = m;
+// Speed |dC/du| of segment i at u.  This is the inner loop of the
+// quadrature, so it's written out per component (the float * vec3
+// operator is not inline).
+
+
+float Spline::speed( int i, float u )
+
+{
+  const vec3 *c = &coeffs[4*i];
+
+  float a = 3*u;
+  float dx = u * (a * c[0].x + 2 * c[1].x) + c[2].x;
+  float dy = u * (a * c[0].y + 2 * c[1].y) + c[2].y;
+  float dz = u * (a * c[0].z + 2 * c[1].z) + c[2].z;
+
+  return sqrt( dx*dx + dy*dy + dz*dz );
+}
+
+
+// Maximum height on segment i, from the endpoints and the roots of
+// dz/du in (0,1)
+
+
+float Spline::segmentMaxZ( int i )
+
+{
+  const vec3 *c = &coeffs[4*i];
+
+  float a = c[0].z, b = c[1].z, d = c[3].z;
+
+  float maxZ = d;
+  float z1 = a + b + c[2].z + d;
+  if (z1 > maxZ)
+    maxZ = z1;
+
+  // dz/du = 3a u^2 + 2b u + c
+
+  float qa = 3*a, qb = 2*b, qc = c[2].z;
+  float roots[2];
+  int nRoots = 0;
+
+  if (fabs(qa) < 1e-12) {
+    if (fabs(qb) > 1e-12)
+      roots[nRoots++] = -qc / qb;
+  } else {
+    float disc = qb*qb - 4*qa*qc;
+    if (disc >= 0) {
+      float r = sqrt( disc );
+      roots[nRoots++] = (-qb + r) / (2*qa);
+      roots[nRoots++] = (-qb - r) / (2*qa);
+    }
   }
 
-  if (arcLength[l] > s || arcLength[l+1] <= s)
-    return (l + 0.5) / (float) DIVS_PER_SEG;
+  for (int k=0; k<nRoots; k++)
+    if (roots[k] > 0 && roots[k] < 1) {
+      float u = roots[k];
+      float z = ((a*u + b)*u + c[2].z)*u + d;
+      if (z > maxZ)
+        maxZ = z;
+    }
+
+  return maxZ;
+}
+
+
+// Cubic Hermite interpolant of u(s) between knots k0 and k1, using
+// du/ds = w at the knots.  Falls back to linear if the cubic leaves
+// [k0.u,k1.u].
+
+
+float Spline::hermiteParam( const ArcKnot &k0, const ArcKnot &k1, float s )
+
+{
+  float h = k1.s - k0.s;
+
+  if (h <= 0)
+    return k0.u;
 
-  // Do linear interpolation in arcLength[l] ... arcLength[l+1] to
-  // find position of s.
+  float x = (s - k0.s) / h;
+  float du = k1.u - k0.u;
 
-  float p = (s - arcLength[l]) / (arcLength[l+1] - arcLength[l]);
+  float d0 = (k0.w > 0 ? h * k0.w : du); // du/dx at the knots
+  float d1 = (k1.w > 0 ? h * k1.w : du);
 
-  // Return the curve parameter at s
+  float x2 = x*x;
+  float x3 = x2*x;
 
-  return (l+p) / (float) DIVS_PER_SEG;
+  float u = k0.u + (-2*x3 + 3*x2) * du + (x3 - 2*x2 + x) * d0 + (x3 - x2) * d1;
+
+  if (u < k0.u || u > k1.u)
+    u = k0.u + du * x;
+
+  return u;
 }
 
 
+// A knot of segment i at or before the knot interval containing arc
+// length s from the start of the segment, from the segment's index.
+// It is usually the interval itself (see invertInSegment).
 
-float Spline::totalArcLength()
+
+int Spline::findKnot( int i, float s )
 
 {
-  if (data.size() == 0)
+  ArcSegment &seg = arcSegs[i];
+
+  int b = (int) (s * seg.bucketsPerLength);
+
+  if (b <= 0)
     return 0;
+  if (b >= seg.buckets.size())
+    b = seg.buckets.size()-1;
 
-  if (mustRecomputeArcLength)
-    computeArcLengthParameterization();
+  return seg.buckets[b];
+}
+
+
+// Find u in segment i at arc length s from the start of the segment,
+// by the Hermite inverse over the knot interval containing s.  The
+// search for that interval starts at knot k, which must not be past
+// it.  The knots are placed so that this is within the tolerance
+// (see addKnots).
+
+
+float Spline::invertInSegment( int i, float s, int k )
+
+{
+  ArcSegment &seg = arcSegs[i];
+
+  if (s <= 0 || seg.length <= 0)
+    return 0;
+  if (s >= seg.length)
+    return 1;
+
+  int last = seg.knots.size()-1;
+
+  while (k < last-1 && seg.knots[k+1].s <= s)
+    k++;
+
+  return hermiteParam( seg.knots[k], seg.knots[k+1], s );
+}
+
+
+// Fenwick tree operations.  segTree is 1-based: segTree[k] holds the
+// total length of segments k - (k & -k) ... k-1.  It is built in O(n),
+// and padded with empty segments to a power of two so that treeFind()
+// needs no bounds checks.
+
+
+void Spline::buildTree()
+
+{
+  int n = arcSegs.size();
+
+  treeSize = 1;
+  while (treeSize < n)
+    treeSize *= 2;
+
+  segTree.clear();
+  segTree.reserve( treeSize+1 );
+
+  segTree.add( 0 );
+  for (int i=0; i<treeSize; i++)
+    segTree.add( i < n ? arcSegs[i].length : 0 );
+
+  for (int i=1; i<=treeSize; i++) {
+    int j = i + (i & -i);
+    if (j <= treeSize)
+      segTree[j] += segTree[i];
+  }
+
+  totalLength = treePrefix( n );
+}
+
+
+// Add delta to the length of segment i
+
+
+void Spline::treeAdd( int i, double delta )
+
+{
+  for (int k=i+1; k<=treeSize; k += k & -k)
+    segTree[k] += delta;
+
+  totalLength += delta;
+}
+
+
+// Length of segments 0 ... i-1
+
+
+double Spline::treePrefix( int i )
+
+{
+  double sum = 0;
+
+  for (int k=i; k>0; k -= k & -k)
+    sum += segTree[k];
+
+  return sum;
+}
+
+
+// Find the segment containing arc length s, and the arc length at its
+// start, by descending the tree.  The steps are selects rather than
+// branches, which would be mispredicted about half the time.
+
+
+int Spline::treeFind( double s, double &start )
 
-  return arcLength[ data.size() * DIVS_PER_SEG ];
+{
+  int n = arcSegs.size();
+
+  int pos = 0;
+  double sum = 0;
+
+  for (int step=treeSize; step>0; step /= 2) {
+    double next = sum + segTree[pos+step];
+    bool right = (next <= s);
+    pos = (right ? pos+step : pos);
+    sum = (right ? next : sum);
+  }
+
+  if (pos >= n) {               // s rounded up to the total
+    pos = n-1;
+    sum = treePrefix( pos );
+  }
+
+  start = sum;
+  return pos;
+}
+
+
+// Rebuild the tree, the arc length at the start of each segment and
+// the uniform index over the whole length, with about one bucket per
+// knot interval, so that a lookup lands on or just before its
+// interval.  This is O(n + knots), without quadrature.
+//
+// A lookup through the index costs about 40 ns against up to 100 ns
+// through the tree (at 400 points), but every edit invalidates it.
+// So pointMoved() only repairs the tree, lookups use the tree while
+// the index is stale, and computeFrames() rebuilds the index along
+// with the frames, which cost O(n) evaluations anyway.  A drag then
+// costs O(log n) per edit beyond its quadrature.
+
+
+void Spline::computeArcIndex()
+
+{
+  int n = arcSegs.size();
+
+  buildTree();
+
+  segStart.clear();
+  segStart.reserve( n+1 );
+
+  int nIntervals = 0;
+  double sum = 0;
+
+  for (int i=0; i<n; i++) {
+    segStart.add( sum );
+    sum += arcSegs[i].length;
+    nIntervals += arcSegs[i].knots.size()-1;
+  }
+
+  segStart.add( sum );
+
+  arcIndex.clear();
+  arcIndex.reserve( nIntervals );
+
+  arcBucketsPerLength = nIntervals / totalLength;
+
+  int i = 0;
+  int k = 0;
+
+  for (int b=0; b<nIntervals; b++) {
+
+    double s = b / (double) arcBucketsPerLength;
+
+    while (i < n-1 && segStart[i+1] <= s) {
+      i++;
+      k = 0;
+    }
+
+    seq<ArcKnot> &knots = arcSegs[i].knots;
+
+    while (k < knots.size()-2 && segStart[i] + knots[k+1].s <= s)
+      k++;
+
+    arcIndex.add( ArcBucket( i, k ) );
+  }
+
+  arcIndexStale = false;
+}
+
+
+// Bring the arc-length table up to date
+
+
+void Spline::updateArcLength()
+
+{
+  updateCoefficients();
+
+  if (mustRecomputeArcLength)
+    computeArcLengthParameterization();
+}
+
+
+// Find the spline parameter at a particular arc length, s.  s is
+// taken modulo the total length, since the track is closed.
+
+
+float Spline::paramAtArcLength( float s )
+
+{
+  if (data.size() == 0)
+    return 0;
+
+  updateArcLength();
+
+  float total = totalLength;
+
+  if (total <= 0)
+    return 0;
+
+  if (s < 0 || s >= total) {
+    s = fmod( s, total );
+    if (s < 0)
+      s += total;
+    if (s >= total)             // s rounded up to total
+      s = 0;
+  }
+
+  if (arcIndexStale) {
+    double start;
+    int i = treeFind( s, start );
+    float ds = s - start;
+    return i + invertInSegment( i, ds, findKnot( i, ds ) );
+  }
+
+  // Start from the index and step forward to the segment containing s
+
+  int b = (int) (s * arcBucketsPerLength);
+  if (b >= arcIndex.size())
+    b = arcIndex.size()-1;
+
+  int i = arcIndex[b].seg;
+  int k = arcIndex[b].knot;
+
+  while (i < arcSegs.size()-1 && segStart[i+1] <= s) {
+    i++;
+    k = 0;
+  }
+
+  return i + invertInSegment( i, s - segStart[i], k );
+}
+
+
+
+float Spline::totalArcLength()
+
+{
+  if (data.size() == 0)
+    return 0;
+
+  updateArcLength();
+
+  return totalLength;
+}
+
+
+// Per-segment queries.  Segment i runs from data[i] to data[i+1]
+// (wrapping around), i.e. over params [i,i+1].
+
+
+int Spline::segmentStamp( int i )
+
+{
+  updateCoefficients();
+
+  return segStamps[i];
+}
+
+
+float Spline::segmentArcLength( int i )
+
+{
+  updateArcLength();
+
+  return arcSegs[i].length;
+}
+
+
+float Spline::segmentStartArcLength( int i )
+
+{
+  updateArcLength();
+
+  return treePrefix( i );
+}
+
+
+float Spline::paramInSegment( int i, float s )
+
+{
+  updateArcLength();
+
+  return i + invertInSegment( i, s, findKnot( i, s ) );
+}
+
+
+// Maximum height of the curve
+
+
+float Spline::getMaxHeight()
+
+{
+  if (data.size() == 0)
+    return 0;
+
+  updateArcLength();
+
+  float maxHeight = arcSegs[0].maxZ;
+  for (int i=1; i<arcSegs.size(); i++)
+    if (arcSegs[i].maxZ > maxHeight)
+      maxHeight = arcSegs[i].maxZ;
+
+  return maxHeight;
+}
+
+
+// Rotation-minimising frames
+//
+// Frames are sampled every frameSpacing along the arc length (an even
+// split into FRAMES_PER_SEG samples per segment).  The normal y is
+// carried from sample to sample by the double-reflection method of
+// Wang et al., "Computation of rotation minimizing frames", 2008.
+// Around the closed track the carried normal comes back twisted by
+// some angle, which is spread evenly over the samples so that the
+// frame is continuous at s = 0.
+//
+// Each sample stores the position, the unit tangent and the frame as
+// a quaternion for the rotation with columns (y ^ z, y, z).  Lookups
+// interpolate the position by cubic Hermite and the frame by slerp.
+
+
+#define FRAMES_PER_SEG 16
+
+
+// Quaternion (x,y,z,w) of the rotation matrix with columns X,Y,Z
+
+
+static vec4 frameToQuat( vec3 X, vec3 Y, vec3 Z )
+
+{
+  float trace = X.x + Y.y + Z.z;
+  vec4 q;
+
+  if (trace > 0) {
+    float S = 2 * sqrt( trace + 1 );
+    q = vec4( (Y.z - Z.y) / S, (Z.x - X.z) / S, (X.y - Y.x) / S, 0.25 * S );
+  } else if (X.x > Y.y && X.x > Z.z) {
+    float S = 2 * sqrt( 1 + X.x - Y.y - Z.z );
+    q = vec4( 0.25 * S, (Y.x + X.y) / S, (Z.x + X.z) / S, (Y.z - Z.y) / S );
+  } else if (Y.y > Z.z) {
+    float S = 2 * sqrt( 1 + Y.y - X.x - Z.z );
+    q = vec4( (Y.x + X.y) / S, 0.25 * S, (Z.y + Y.z) / S, (Z.x - X.z) / S );
+  } else {
+    float S = 2 * sqrt( 1 + Z.z - X.x - Y.y );
+    q = vec4( (Z.x + X.z) / S, (Z.y + Y.z) / S, 0.25 * S, (X.y - Y.x) / S );
+  }
+
+  return q;
+}
+
+
+// Second and third columns (the y and z axes) of the rotation of q
+
+
+static void quatToFrame( vec4 q, vec3 &Y, vec3 &Z )
+
+{
+  Y = vec3( 2 * (q.x*q.y - q.w*q.z),
+            1 - 2 * (q.x*q.x + q.z*q.z),
+            2 * (q.y*q.z + q.w*q.x) );
+
+  Z = vec3( 2 * (q.x*q.z + q.w*q.y),
+            2 * (q.y*q.z - q.w*q.x),
+            1 - 2 * (q.x*q.x + q.y*q.y) );
+}
+
+
+// Spherical linear interpolation of unit quaternions a and b
+
+
+static vec4 slerp( vec4 a, vec4 b, float f )
+
+{
+  float d = a * b;
+
+  if (d < 0) {                  // take the shorter arc
+    b = vec4( -b.x, -b.y, -b.z, -b.w );
+    d = -d;
+  }
+
+  float wa, wb;
+
+  if (d > 0.9995) {             // nearly equal: lerp and normalise
+    wa = 1-f;
+    wb = f;
+  } else {
+    float theta = acos( d );
+    float sinTheta = sin( theta );
+    wa = sin( (1-f) * theta ) / sinTheta;
+    wb = sin( f * theta ) / sinTheta;
+  }
+
+  vec4 q( wa*a.x + wb*b.x, wa*a.y + wb*b.y, wa*a.z + wb*b.z, wa*a.w + wb*b.w );
+
+  return (1 / q.length()) * q;
+}
+
+
+// Rotate v by angle about the unit axis k
+
+
+static vec3 rotateAbout( vec3 v, vec3 k, float angle )
+
+{
+  float c = cos( angle );
+  float s = sin( angle );
+
+  return c * v + s * (k ^ v) + ((1-c) * (k * v)) * k;
+}
+
+
+// Build the frame table
+
+
+void Spline::computeFrames()
+
+{
+  frames.clear();
+  mustRecomputeFrames = false;
+  frameVersion++;
+
+  int n = data.size();
+
+  if (n == 0)
+    return;
+
+  updateArcLength();
+
+  if (arcIndexStale)
+    computeArcIndex();
+
+  if (totalLength <= 0)
+    return;
+
+  int nFrames = n * FRAMES_PER_SEG;
+
+  frameSpacing = totalLength / nFrames;
+  frameSegStart = segStart;
+
+  // Curve parameters of the samples, walking the segments in order.
+  // The last sample is at s = totalLength, i.e. back at the start.
+
+  float *params = new float[ nFrames+1 ];
+  vec3 *pos = new vec3[ nFrames+1 ];
+  vec3 *tan = new vec3[ nFrames+1 ];
+
+  int i = 0;
+
+  for (int k=0; k<nFrames; k++) {
+    double s = k * (double) frameSpacing;
+    while (i < n-1 && segStart[i+1] <= s)
+      i++;
+    float ds = s - segStart[i];
+    params[k] = i + invertInSegment( i, ds, findKnot( i, ds ) );
+  }
+  params[nFrames] = n;
+
+  evalBatch( params, nFrames+1, pos, tan );
+
+  // Unit tangents, carrying the previous one over cusps
+
+  for (int k=0; k<=nFrames; k++)
+    if (tan[k].length() < 1e-6)
+      tan[k] = (k > 0 ? tan[k-1] : vec3(1,0,0));
+    else
+      tan[k] = tan[k].normalize();
+
+  // Carry the normal along by double reflection
+
+  vec3 *normals = new vec3[ nFrames+1 ];
+
+  normals[0] = uprightNormal( tan[0] );
+
+  for (int k=0; k<nFrames; k++) {
+
+    vec3 r = normals[k];
+    vec3 t = tan[k];
+
+    // Reflect in the plane bisecting pos[k] and pos[k+1] ...
+
+    vec3 v1 = pos[k+1] - pos[k];
+    float c1 = v1 * v1;
+
+    if (c1 > 1e-12) {
+      r = r - ((2/c1) * (v1 * r)) * v1;
+      t = t - ((2/c1) * (v1 * t)) * v1;
+    }
+
+    // ... then in the plane that takes the reflected tangent to tan[k+1]
+
+    vec3 v2 = tan[k+1] - t;
+    float c2 = v2 * v2;
+
+    if (c2 > 1e-12)
+      r = r - ((2/c2) * (v2 * r)) * v2;
+
+    // Remove drift out of the normal plane
+
+    r = r - (r * tan[k+1]) * tan[k+1];
+    normals[k+1] = (r.length() > 1e-6 ? r.normalize() : uprightNormal( tan[k+1] ));
+  }
+
+  // Spread the closing twist over the loop
+
+  vec3 rN = normals[nFrames];
+  vec3 r0 = normals[0];
+
+  float twist = atan2( (rN ^ r0) * tan[0], rN * r0 );
+
+  frames.reserve( nFrames+1 );
+
+  for (int k=0; k<=nFrames; k++) {
+
+    vec3 z = tan[k];
+    vec3 y = rotateAbout( normals[k], z, twist * k / (float) nFrames );
+
+    y = (y - (y * z) * z).normalize();
+
+    FrameSample f;
+    f.o = pos[k];
+    f.z = z;
+    f.q = frameToQuat( y ^ z, y, z );
+
+    // keep consecutive quaternions in the same hemisphere
+
+    if (k > 0 && f.q * frames[k-1].q < 0)
+      f.q = vec4( -f.q.x, -f.q.y, -f.q.z, -f.q.w );
+
+    frames.add( f );
+  }
+
+  delete [] params;
+  delete [] pos;
+  delete [] tan;
+  delete [] normals;
+}
+
+
+// Arc length from the start of the curve to parameter t
+
+
+float Spline::arcLengthAtParam( float t )
+
+{
+  if (data.size() == 0)
+    return 0;
+
+  updateArcLength();
+
+  int i;
+  float u;
+
+  locate( t, i, u );
+
+  // Knot interval with knots[l].u <= u
+
+  ArcSegment &seg = arcSegs[i];
+
+  int l = 0;
+  int r = seg.knots.size()-1;
+
+  while (r-l > 1) {
+    int m = (l+r)/2;
+    if (seg.knots[m].u <= u)
+      l = m;
+    else
+      r = m;
+  }
+
+  return treePrefix( i ) + seg.knots[l].s + segmentLength( i, seg.knots[l].u, u );
+}
+
+
+// The table interval k that arc length s falls in, wrapped around the
+// track, and the fraction f of the way through it.  Assumes the table
+// is up to date and not empty.
+
+
+void Spline::locateFrame( float s, int &k, float &f )
+
+{
+  int nFrames = frames.size()-1;
+  float total = nFrames * frameSpacing;
+
+  if (s < 0 || s >= total) {
+    s = fmod( s, total );
+    if (s < 0)
+      s += total;
+  }
+
+  float p = s / frameSpacing;
+  k = (int) p;
+  if (k >= nFrames)
+    k = nFrames-1;
+  f = p - k;
+}
+
+
+// Arc length s on the current curve mapped to the held, stale frame
+// table.  Each segment's part of the table is stretched to the
+// segment's current length, so lookups wrap at the current total
+// length, and land where they should on the segments that have not
+// moved.  Only the segments being dragged are off the curve.
+// 'stretch' is the derivative of the result with respect to s.
+
+
+float Spline::heldArcLength( float s, float &stretch )
+
+{
+  updateArcLength();
+
+  stretch = 1;
+
+  int n = arcSegs.size();
+
+  if (frameSegStart.size() != n+1 || totalLength <= 0)
+    return s;
+
+  if (s < 0 || s >= totalLength) {
+    s = fmod( s, totalLength );
+    if (s < 0)
+      s += totalLength;
+  }
+
+  double start;
+  int i = treeFind( s, start );
+
+  double heldLength = frameSegStart[i+1] - frameSegStart[i];
+
+  if (arcSegs[i].length > 0)
+    stretch = heldLength / arcSegs[i].length;
+
+  return frameSegStart[i] + (s - start) * stretch;
+}
+
+
+// Frame at arc length s, interpolated from the table.  Assumes the
+// table is up to date and not empty.
+
+
+void Spline::frameAtArcLength( float s, vec3 &o, vec3 &x, vec3 &y, vec3 &z )
+
+{
+  int k;
+  float f;
+
+  if (framesStale) {
+    float stretch;
+    s = heldArcLength( s, stretch );
+  }
+
+  locateFrame( s, k, f );
+  frameBetween( k, f, o, x, y, z );
+}
+
+
+// Frame 'f' of the way from sample k to sample k+1
+
+
+void Spline::frameBetween( int k, float f, vec3 &o, vec3 &x, vec3 &y, vec3 &z )
+
+{
+  FrameSample &a = frames[k];
+  FrameSample &b = frames[k+1];
+
+  // Hermite position with derivatives (unit tangent) * spacing
+
+  float f2 = f*f;
+  float f3 = f2*f;
+
+  float h00 = 2*f3 - 3*f2 + 1;
+  float h10 = f3 - 2*f2 + f;
+  float h01 = -2*f3 + 3*f2;
+  float h11 = f3 - f2;
+
+  o = h00 * a.o + (h10 * frameSpacing) * a.z + h01 * b.o + (h11 * frameSpacing) * b.z;
+
+  quatToFrame( slerp( a.q, b.q, f ), y, z );
+
+  x = (z ^ y).normalize();
+}
+
+
+// Local coordinate system at arc length s
+
+
+void Spline::findLocalSystemAtArcLength( float s, vec3 &o, vec3 &x, vec3 &y, vec3 &z )
+
+{
+  if (mustRecomputeFrames)
+    computeFrames();
+
+  if (frames.size() == 0) {
+    findLocalSystem( paramAtArcLength( s ), o, x, y, z );
+    return;
+  }
+
+  frameAtArcLength( s, o, x, y, z );
+}
+
+
+mat4 Spline::findLocalTransformAtArcLength( float s )
+
+{
+  vec3 o, x, y, z;
+
+  findLocalSystemAtArcLength( s, o, x, y, z );
+
+  mat4 M;
+  M.rows[0] = vec4( x.x, y.x, z.x, o.x );
+  M.rows[1] = vec4( x.y, y.y, z.y, o.y );
+  M.rows[2] = vec4( x.z, y.z, z.z, o.z );
+  M.rows[3] = vec4( 0, 0, 0, 1 );
+
+  return M;
+}
+
+
+// Height of the track at arc length s and its derivative by arc
+// length.  Both come from the Hermite curve of frameAtArcLength(), so
+// that the slope is exactly the rate of change of the height.
+
+
+void Spline::heightAtArcLength( float s, float &z, float &dzds )
+
+{
+  if (mustRecomputeFrames)
+    computeFrames();
+
+  if (frames.size() == 0) {
+    float t = paramAtArcLength( s );
+    z = value( t ).z;
+    dzds = tangent( t ).normalize().z;
+    return;
+  }
+
+  int k;
+  float f;
+  float stretch = 1;
+
+  if (framesStale)
+    s = heldArcLength( s, stretch );
+
+  locateFrame( s, k, f );
+
+  FrameSample &a = frames[k];
+  FrameSample &b = frames[k+1];
+
+  float f2 = f*f;
+  float f3 = f2*f;
+
+  z = (2*f3 - 3*f2 + 1) * a.o.z + ((f3 - 2*f2 + f) * frameSpacing) * a.z.z
+    + (-2*f3 + 3*f2) * b.o.z + ((f3 - f2) * frameSpacing) * b.z.z;
+
+  // d/ds = (1/frameSpacing) d/df
+
+  dzds = (6*f2 - 6*f) * (a.o.z - b.o.z) / frameSpacing
+       + (3*f2 - 4*f + 1) * a.z.z + (3*f2 - 2*f) * b.z.z;
+
+  dzds *= stretch;
+}
+
+
+// Local transforms at the n arc lengths s[0..n-1].  Only the first is
+// located in the table; each of the others is reached by stepping
+// from the one before by their difference in arc length, so that cars
+// or track pieces in order along the track take one walk over the
+// table.
+
+
+void Spline::findLocalTransforms( const float *s, int n, mat4 *M )
+
+{
+  if (mustRecomputeFrames)
+    computeFrames();
+
+  if (n <= 0)
+    return;
+
+  vec3 o, x, y, z;
+
+  if (frames.size() == 0) {
+    for (int i=0; i<n; i++) {
+      findLocalSystem( paramAtArcLength( s[i] ), o, x, y, z );
+      M[i].rows[0] = vec4( x.x, y.x, z.x, o.x );
+      M[i].rows[1] = vec4( x.y, y.y, z.y, o.y );
+      M[i].rows[2] = vec4( x.z, y.z, z.z, o.z );
+      M[i].rows[3] = vec4( 0, 0, 0, 1 );
+    }
+    return;
+  }
+
+  if (framesStale) {             // no longer even in s (see heldArcLength)
+    for (int i=0; i<n; i++) {
+      frameAtArcLength( s[i], o, x, y, z );
+      M[i].rows[0] = vec4( x.x, y.x, z.x, o.x );
+      M[i].rows[1] = vec4( x.y, y.y, z.y, o.y );
+      M[i].rows[2] = vec4( x.z, y.z, z.z, o.z );
+      M[i].rows[3] = vec4( 0, 0, 0, 1 );
+    }
+    return;
+  }
+
+  int nFrames = frames.size()-1;
+  double perFrame = 1.0 / frameSpacing;
+
+  int k;
+  float f;
+
+  locateFrame( s[0], k, f );
+
+  double p = k + f;             // position in the table, in [0,nFrames)
+
+  for (int i=0; i<n; i++) {
+
+    if (i > 0) {
+
+      p += (s[i] - s[i-1]) * perFrame;
+
+      while (p < 0)
+        p += nFrames;
+      while (p >= nFrames)
+        p -= nFrames;
+
+      k = (int) p;
+      f = p - k;
+    }
+
+    frameBetween( k, f, o, x, y, z );
+
+    M[i].rows[0] = vec4( x.x, y.x, z.x, o.x );
+    M[i].rows[1] = vec4( x.y, y.y, z.y, o.y );
+    M[i].rows[2] = vec4( x.z, y.z, z.z, o.z );
+    M[i].rows[3] = vec4( 0, 0, 0, 1 );
+  }
 }
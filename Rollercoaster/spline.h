@@ -24,9 +24,116 @@ class Spline {
 
   int currSpline;
 
+  // Arc-length table.  Each segment is split adaptively into intervals
+  // over which Gauss-Legendre quadrature, and the Hermite inverse of
+  // hermiteParam(), are within the tolerance.  Each interval end is
+  // stored as a knot (u,s,w) with s the arc length from the start of
+  // the segment to u and w = du/ds, one over the speed at u (or 0 if
+  // the speed is 0).
+
+  struct ArcKnot {
+    float u, s, w;
+    ArcKnot() {}
+    ArcKnot( float uu, float ss, float speed ) { u = uu; s = ss; w = (speed > 0 ? 1/speed : 0); }
+  };
+
+  // Each segment also has a uniform index over its length, with about
+  // one bucket per knot interval: bucket b holds the knot interval
+  // containing arc length b / bucketsPerLength.
+
+  struct ArcSegment {
+    seq<ArcKnot> knots;         // knots[0] = (0,0), last = (1,length)
+    seq<int> buckets;
+    float bucketsPerLength;
+    float length;
+    float maxZ;
+  };
+
   void computeArcLengthParameterization();
-  float *arcLength;
-  float maxHeight;
+  void computeSegmentTable( int i );
+  void addKnots( int i, float a, float b, float whole, float tol, int depth, float &len );
+  float segmentLength( int i, float a, float b ); // Gauss-Legendre length of segment i over [a,b]
+  float speed( int i, float u );
+  float hermiteParam( const ArcKnot &k0, const ArcKnot &k1, float s );
+  void computeSegmentIndex( int i );
+  int findKnot( int i, float s );
+  float invertInSegment( int i, float s, int k );
+  float segmentMaxZ( int i );
+
+  void updateArcLength();
+  void computeArcIndex();
+
+  // Fenwick tree over the segment lengths, kept up to date by
+  // pointMoved()
+
+  void buildTree();
+  void treeAdd( int i, double delta );
+  double treePrefix( int i );
+  int treeFind( double s, double &start );
+
+  // Uniform index over the whole length: bucket b holds the segment
+  // and knot interval containing arc length b / arcBucketsPerLength.
+  // pointMoved() leaves it stale until the frames are next rebuilt.
+
+  struct ArcBucket {
+    int seg, knot;
+    ArcBucket() {}
+    ArcBucket( int i, int k ) { seg = i; knot = k; }
+  };
+
+  seq<ArcSegment> arcSegs;
+  seq<double> segTree;
+  int treeSize;                 // n rounded up to a power of two
+  seq<double> segStart;         // arc length at the start of each segment, then the total
+  seq<ArcBucket> arcIndex;
+  float arcBucketsPerLength;
+  bool arcIndexStale;
+  double totalLength;
+  float arcLengthTol;           // max arc-length error per segment
+
+  // Rotation-minimising frame table (see computeFrames)
+
+  struct FrameSample {
+    vec3 o;                     // position
+    vec3 z;                     // unit tangent
+    vec4 q;                     // rotation with columns (y ^ z, y, z)
+  };
+
+  void computeFrames();
+  void locateFrame( float s, int &k, float &f );
+  float heldArcLength( float s, float &stretch );
+  void frameAtArcLength( float s, vec3 &o, vec3 &x, vec3 &y, vec3 &z );
+  void frameBetween( int k, float f, vec3 &o, vec3 &x, vec3 &y, vec3 &z );
+  float arcLengthAtParam( float t );
+
+  seq<FrameSample> frames;      // at s = k * frameSpacing, with the last at the total length
+  float frameSpacing;
+  seq<double> frameSegStart;    // segStart when the table was built
+  bool mustRecomputeFrames;
+  bool framesHeld;              // see holdFrames()
+  bool framesStale;             // points moved while the frames were held
+  int frameVersion;             // incremented each time the table is rebuilt or goes stale
+
+  // Cubic coefficients of each segment, four per segment, so that
+  // segment i at u in [0,1] is ((c[4i] u + c[4i+1]) u + c[4i+2]) u + c[4i+3]
+
+  void computeCoefficients();
+  void computeSegmentCoefficients( int i );
+  void updateDirtySegments();
+  seq<vec3> coeffs;
+  seq<int> dirtySegs;           // segments to recompute (see pointMoved)
+  seq<int> segStamps;           // changed whenever a segment's coefficients change
+  int lastStamp;
+  bool mustRecomputeCoeffs;
+
+  void updateCoefficients() {
+    if (mustRecomputeCoeffs || coeffs.size() != 4*data.size())
+      computeCoefficients();
+    else if (dirtySegs.size() > 0)
+      updateDirtySegments();
+  }
+
+  void locate( float t, int &seg, float &u ); // segment and local parameter of t
 
  public:
 
@@ -35,31 +142,75 @@ class Spline {
 
   Spline() {
     mustRecomputeArcLength = true;
-    arcLength = NULL;
+    mustRecomputeCoeffs = true;
+    mustRecomputeFrames = true;
+    framesHeld = false;
+    framesStale = false;
+    arcIndexStale = true;
+    frameVersion = 0;
+    lastStamp = 0;
+    arcLengthTol = 0.001;
     currSpline = 0;
   }
 
+  // Call after any change to 'data' or to the basis
+
+  void invalidate() {
+    mustRecomputeArcLength = true;
+    mustRecomputeCoeffs = true;
+    mustRecomputeFrames = true;
+  }
+
+  // Call instead of invalidate() when only data[j] has changed
+
+  void pointMoved( int j );
+
+  // Hold the frame table while a point is dragged.  pointMoved() then
+  // leaves the table as it is, so frame lookups use the stale table
+  // (see heldArcLength), and it is rebuilt once, on the first lookup
+  // after the hold ends.
+
+  void holdFrames( bool hold ) {
+    framesHeld = hold;
+    if (!hold && framesStale) {
+      mustRecomputeFrames = true;
+      framesStale = false;
+    }
+  }
+
+  bool framesAreHeld() {
+    return framesHeld;
+  }
+
   void clear() {
     data.clear();
-    mustRecomputeArcLength = true;
+    invalidate();
   }
 
   void nextCOB() {
     currSpline++;
     if (MName[currSpline][0] == '\0')
       currSpline = 0;
+    invalidate();
+  }
+
+  // Set the maximum arc-length error per segment, in world units
+
+  void setArcLengthTolerance( float tol ) {
+    arcLengthTol = tol;
     mustRecomputeArcLength = true;
+    mustRecomputeFrames = true;
+  }
+
+  float arcLengthTolerance() {
+    return arcLengthTol;
   }
 
   const char *name() {
     return MName[currSpline];
   }
 
-  float getMaxHeight() {
-    if (mustRecomputeArcLength)
-      computeArcLengthParameterization();
-    return maxHeight;
-  }
+  float getMaxHeight();
 
   void draw( mat4 &MV, mat4 &MVP, vec3 lightDir, bool drawIntervals );
   void drawWithArcLength( mat4 &MV, mat4 &MVP, vec3 lightDir, bool drawIntervals );
@@ -67,12 +218,48 @@ class Spline {
   float paramAtArcLength( float s );
   float totalArcLength();
 
+  // Per-segment access, for building geometry one segment at a time.
+  // segmentStamp(i) changes whenever segment i changes shape.
+
+  int segmentStamp( int i );
+  float segmentArcLength( int i );
+  float segmentStartArcLength( int i );
+  float paramInSegment( int i, float s ); // param at arc length s from the start of segment i
+
   void findLocalSystem( float t, vec3 &o, vec3 &x, vec3 &y, vec3 &z );
   mat4 findLocalTransform( float t );
+
+  // The same by arc length, read from the frame table.  The batch
+  // version fills M[0..n-1] with the local transforms at s[0..n-1].
+
+  void findLocalSystemAtArcLength( float s, vec3 &o, vec3 &x, vec3 &y, vec3 &z );
+  mat4 findLocalTransformAtArcLength( float s );
+  void findLocalTransforms( const float *s, int n, mat4 *M );
+
+  // Height of the track at arc length s and its rate of change along
+  // the track (the z of the unit tangent), in constant time
+
+  void heightAtArcLength( float s, float &z, float &dzds );
+
+  // Changes whenever the frames change, and while they are held,
+  // whenever a point moves, so that anything built from the spline
+  // can be rebuilt only when needed
+
+  int version() {
+    if (mustRecomputeFrames)
+      computeFrames();
+    return frameVersion;
+  }
+
   void drawLocalSystem( float t, mat4 &MVP );
 
   vec3 eval( float t, evalType type ); // evaluate the spline at param t
 
+  // Evaluate the spline at the n params t[0..n-1].  Either output
+  // array may be NULL.  Fastest when t is sorted.
+
+  void evalBatch( const float *t, int n, vec3 *values, vec3 *tangents );
+
   vec3 value( float t ) {
     return eval( t, VALUE );
   }
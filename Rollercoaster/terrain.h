@@ -7,6 +7,12 @@
 #include "texture.h"
 #include "seq.h"
 #include "gpuProgram.h"
+#include "terrainChunks.h"
+#include "heightMap.h"
+#include "softRaster.h"
+
+
+#define TERRAIN_MAX_PIXEL_ERROR 1.0
 
 /*
 the rollercoaster terrain consists of 2 textures: height and colour
@@ -15,19 +21,49 @@ the colour texture is simply the colour at each 2D x, y point
 */
 class Terrain {
 
-  //colour value at each point. point height determined by height texture
-  vec3 **points;
+  // The heightfield (see heightMap.h)
 
-  //normal to each point for lighting
-  vec3 **normals;
+  HeightMap heightMap;
 
-  seq<vec3> quadsToHighlight;
+  vec3 point( int x, int y ) {
+    return heightMap.point( x, y );
+  }
+
+  GPUProgram  gpu;
 
-  bool rayTriangleInt( vec3 rayStart, vec3 rayDir, vec3 v0, vec3 v1, vec3 v2, vec3 & intPoint, float & intParam );
+  // The surface, in chunks of all levels of detail.  The vertices of
+  // all chunks are in one buffer, interleaved, and the index lists of
+  // all levels (which are shared by the chunks) in another.
+
+  TerrainChunks chunks;
+  seq<TerrainChunks::Selection> selectedChunks;
 
   GLuint      VAO;
-  GPUProgram  gpu;
-  int         nFaces;
+  GLuint      vertexBufferID;
+
+  // The curtain around the sides (a triangle strip) followed by the
+  // underside (a triangle fan), built once with the terrain
+
+  GLuint      skirtVAO;
+  int         nCurtainVerts;
+
+  UniformHandle<mat4>  MVUniform, MVPUniform;
+  UniformHandle<vec3>  lightDirUniform;
+  UniformHandle<float> alphaUniform;
+  UniformHandle<int>   samplerUniform;
+  UniformHandle<int>   useFlatColourUniform;
+  UniformHandle<vec3>  flatColourUniform;
+
+  void buildSkirt( seq<vec3> &pts );
+  void setupSkirtVAO();
+  void selectChunks( mat4 MV, mat4 MVP, int viewportHeight );
+
+  // CPU copies of the vertices and the skirt for drawSoft(), and its
+  // index list
+
+  float            *softVertices;
+  seq<vec3>         softSkirt;
+  seq<unsigned int> softIndices;
 
   static const char *vertShader;
   static const char *fragShader;
@@ -37,17 +73,71 @@ class Terrain {
   Texture *heightfield;
   Texture *texture;
 
-  Terrain( string basePath, string heightfieldFilename, string textureFilename ) {
-    readTextures( basePath, heightfieldFilename, textureFilename );
+  float maxPixelError;          // allowed screen error of the terrain's level of detail
+
+  // With useGL false, no OpenGL calls are made and the terrain can
+  // only be drawn with drawSoft().
+
+  Terrain( string basePath, string heightfieldFilename, string textureFilename, bool useGL = true ) {
+    maxPixelError = TERRAIN_MAX_PIXEL_ERROR;
+    softVertices = NULL;
+    readTextures( basePath, heightfieldFilename, textureFilename, useGL );
+
+    // Cut the heightfield into chunks
+
+    chunks.build( heightMap.width, heightMap.height, heightMap.heights );
+
+    if (!useGL)
+      return;
+
     gpu.init( vertShader, fragShader, "in terrain.cpp" );
+
+    MVUniform       = gpu.uniform<mat4>( "MV" );
+    MVPUniform      = gpu.uniform<mat4>( "MVP" );
+    lightDirUniform = gpu.uniform<vec3>( "lightDir" );
+    alphaUniform    = gpu.uniform<float>( "alpha" );
+    samplerUniform  = gpu.uniform<int>( "terrainColourSampler" );
+    useFlatColourUniform = gpu.uniform<int>( "useFlatColour" );
+    flatColourUniform    = gpu.uniform<vec3>( "flatColour" );
     setupVAO();
   }
 
-  void readTextures( string basePath, string heightfieldFilename, string textureFilename );
+  ~Terrain() {
+    delete[] softVertices;
+  }
+
+  void readTextures( string basePath, string heightfieldFilename, string textureFilename, bool useGL = true );
   void setupVAO();
   void draw( mat4 &MV, mat4 &MVP, vec3 lightDir, bool drawUndersideOnly );
 
-  bool findIntPoint( vec3 rayStart, vec3 rayDir, vec3 planePerp, vec3 &intPoint, mat4 &M );
+  // The same, in software (see softRaster.h).  The level of detail is
+  // chosen for the raster's height.
+
+  void drawSoft( SoftRaster &raster, const mat4 &MV, const mat4 &MVP, vec3 lightDir, bool drawUndersideOnly );
+
+  bool findIntPoint( vec3 rayStart, vec3 rayDir, vec3 &intPoint, mat4 &M );
+
+  // Cast many rays, given in the terrain's own coordinates.  See
+  // HeightMap::intersectRays().
+
+  int intersectRays( const vec3 *starts, const vec3 *dirs, int n, vec3 *hits, vec3 *normals, float *dists ) {
+    return heightMap.intersectRays( starts, dirs, n, hits, normals, dists );
+  }
+
+  // The ground at (x,y) in the terrain's own coordinates.  See
+  // HeightMap::heightAt() and sampleAt().
+
+  float heightAt( float x, float y, HeightMap::Filter filter = HeightMap::BILINEAR ) {
+    return heightMap.heightAt( x, y, filter );
+  }
+
+  vec3 normalAt( float x, float y, HeightMap::Filter filter = HeightMap::BILINEAR ) {
+    return heightMap.normalAt( x, y, filter );
+  }
+
+  void sampleAt( const float *xs, const float *ys, int n, float *zs, vec3 *normals, HeightMap::Filter filter = HeightMap::BILINEAR ) {
+    heightMap.sampleAt( xs, ys, n, zs, normals, filter );
+  }
 };
 
 #endif
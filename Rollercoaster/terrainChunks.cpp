@@ -0,0 +1,388 @@
+// terrainChunks.cpp
+
+
+#include "terrainChunks.h"
+
+
+#define N  TERRAIN_CHUNK_QUADS
+
+#define GRID_VERTS  ((N+1)*(N+1))   // the chunk's grid, row by row
+#define SKIRT_VERTS (4*N)           // then one below each vertex around the edge
+
+
+int TerrainChunks::vertsPerChunk()
+
+{
+  return GRID_VERTS + SKIRT_VERTS;
+}
+
+
+// Position in the chunk's grid of vertex p on the edge, going
+// counterclockwise from (0,0) along the sides below, right, above and
+// left
+
+static void edgeVertex( int p, int &i, int &j )
+
+{
+  int t = p % N;
+
+  switch (p / N) {
+  case 0: i = t;   j = 0;   break;
+  case 1: i = N;   j = t;   break;
+  case 2: i = N-t; j = N;   break;
+  default: i = 0;  j = N-t; break;   // 3
+  }
+}
+
+
+void TerrainChunks::build( int w, int h, const float *heights, ThreadPool &pool )
+
+{
+  width  = w;
+  height = h;
+
+  chunksX = (width-1 + N-1) / N;
+  chunksY = (height-1 + N-1) / N;
+
+  chunks.clear();
+  chunks.reserve( chunksX * chunksY );
+
+  for (int c=0; c<chunksX*chunksY; c++)
+    chunks.add( Chunk() );
+
+  pool.parallelFor( 0, chunksY, 1, [&]( int cy0, int cy1 ) {
+
+    for (int cy=cy0; cy<cy1; cy++)
+      for (int cx=0; cx<chunksX; cx++) {
+
+        Chunk &chunk = chunks[ cy*chunksX + cx ];
+
+        chunk.x0 = cx * N;
+        chunk.y0 = cy * N;
+
+        chunkErrors( chunk, heights );
+
+        // Skirts drop to the bottom of the chunk's box, which is below
+        // any neighbour's edge at any level.  There is no neighbour on
+        // the edges of the heightfield, where the skirt is left flat
+        // (i.e. degenerate) so as not to show in front of the curtain.
+
+        bool boundary[4] = { chunk.y0 == 0,
+                             chunk.x0 + N >= width-1,
+                             chunk.y0 + N >= height-1,
+                             chunk.x0 == 0 };
+
+        for (int s=0; s<4; s++)
+          chunk.skirtZ[s] = (boundary[s] ? MAXFLOAT : chunk.boxMin.z);
+      }
+  } );
+
+  buildIndices();
+  buildQuadtree();
+}
+
+
+// The bounding box of a chunk, and the greatest difference at each
+// level between the heightfield and the level's triangles.  The coarse
+// triangles split each quad along the same diagonal as the finest ones.
+
+
+void TerrainChunks::chunkErrors( Chunk &chunk, const float *heights )
+
+{
+  int gx[N+1], gy[N+1];        // grid position of each row and column, clamped
+
+  for (int i=0; i<=N; i++) {
+    gx[i] = (chunk.x0 + i < width  ? chunk.x0 + i : width-1);
+    gy[i] = (chunk.y0 + i < height ? chunk.y0 + i : height-1);
+  }
+
+  float minZ = MAXFLOAT;
+  float maxZ = -MAXFLOAT;
+
+  for (int j=0; j<=N; j++)
+    for (int i=0; i<=N; i++) {
+      float z = heights[ gy[j]*width + gx[i] ];
+      minZ = fmin( minZ, z );
+      maxZ = fmax( maxZ, z );
+    }
+
+  chunk.boxMin = vec3( gx[0], gy[0], minZ );
+  chunk.boxMax = vec3( gx[N], gy[N], maxZ );
+
+  chunk.error[0] = 0;
+
+  for (int l=1; l<TERRAIN_LOD_LEVELS; l++) {
+
+    int s = 1 << l;
+    float maxError = 0;
+
+    for (int j=0; j<=N; j++) {
+
+      int cj0 = (j/s < N/s ? j/s : N/s-1) * s;
+      int cj1 = cj0 + s;
+      float fy = (gy[cj1] > gy[cj0] ? (gy[j] - gy[cj0]) / (float) (gy[cj1] - gy[cj0]) : 0);
+
+      for (int i=0; i<=N; i++) {
+
+        int ci0 = (i/s < N/s ? i/s : N/s-1) * s;
+        int ci1 = ci0 + s;
+        float fx = (gx[ci1] > gx[ci0] ? (gx[i] - gx[ci0]) / (float) (gx[ci1] - gx[ci0]) : 0);
+
+        float h00 = heights[ gy[cj0]*width + gx[ci0] ];
+        float h10 = heights[ gy[cj0]*width + gx[ci1] ];
+        float h01 = heights[ gy[cj1]*width + gx[ci0] ];
+        float h11 = heights[ gy[cj1]*width + gx[ci1] ];
+
+        float z;
+        if (fx + fy <= 1)
+          z = h00 + fx * (h10-h00) + fy * (h01-h00);
+        else
+          z = h11 + (1-fx) * (h01-h11) + (1-fy) * (h10-h11);
+
+        maxError = fmax( maxError, fabs( z - heights[ gy[j]*width + gx[i] ] ) );
+      }
+    }
+
+    chunk.error[l] = fmax( maxError, chunk.error[l-1] );
+  }
+}
+
+
+// Grid position of vertex k of chunk c.  The vertex's height is that of
+// the heightfield there, but no higher than zLimit (which is MAXFLOAT
+// except for skirt vertices).
+
+
+void TerrainChunks::vertexSource( int c, int k, int &x, int &y, float &zLimit )
+
+{
+  Chunk &chunk = chunks[c];
+
+  int i, j;
+
+  if (k < GRID_VERTS) {
+    i = k % (N+1);
+    j = k / (N+1);
+    zLimit = MAXFLOAT;
+  } else {
+    int p = k - GRID_VERTS;
+    edgeVertex( p, i, j );
+    int side = p / N;
+    zLimit = chunk.skirtZ[side];
+    if (p % N == 0)              // a corner, shared with the previous side
+      zLimit = fmax( zLimit, chunk.skirtZ[(side+3) % 4] );
+  }
+
+  x = (chunk.x0 + i < width  ? chunk.x0 + i : width-1);
+  y = (chunk.y0 + j < height ? chunk.y0 + j : height-1);
+}
+
+
+void TerrainChunks::buildVertices( const float *heights, const vec3 *normals, float *out, ThreadPool &pool )
+
+{
+  int V = vertsPerChunk();
+
+  pool.parallelFor( 0, chunksY, 1, [&]( int cy0, int cy1 ) {
+
+    float *v = out + cy0 * chunksX * V * 8;
+
+    for (int c=cy0*chunksX; c<cy1*chunksX; c++)
+      for (int k=0; k<V; k++) {
+
+        int x, y;
+        float zLimit;
+
+        vertexSource( c, k, x, y, zLimit );
+
+        const vec3 &n = normals[ y*width + x ];
+
+        *v++ = x;
+        *v++ = y;
+        *v++ = fmin( heights[ y*width + x ], zLimit );
+        *v++ = n.x;
+        *v++ = n.y;
+        *v++ = n.z;
+        *v++ = x/(float)(width-1);
+        *v++ = y/(float)(height-1);
+      }
+  } );
+}
+
+
+// Index lists of each level, relative to the chunk's first vertex:
+// the level's grid triangles, then its skirt
+
+
+void TerrainChunks::buildIndices()
+
+{
+  indices.clear();
+
+  for (int l=0; l<TERRAIN_LOD_LEVELS; l++) {
+
+    int s = 1 << l;
+
+    levelStart[l] = indices.size();
+
+    for (int j=0; j<N; j+=s)
+      for (int i=0; i<N; i+=s) {
+
+        unsigned short k = j*(N+1) + i;
+
+        indices.add( k );
+        indices.add( k+s );
+        indices.add( k + s*(N+1) );
+
+        indices.add( k + s*(N+1) );
+        indices.add( k+s );
+        indices.add( k+s + s*(N+1) );
+      }
+
+    for (int p=0; p<4*N; p+=s) {
+
+      int q = (p+s) % (4*N);
+      int i0, j0, i1, j1;
+
+      edgeVertex( p, i0, j0 );
+      edgeVertex( q, i1, j1 );
+
+      unsigned short e0 = j0*(N+1) + i0;
+      unsigned short e1 = j1*(N+1) + i1;
+      unsigned short s0 = GRID_VERTS + p;
+      unsigned short s1 = GRID_VERTS + q;
+
+      indices.add( e0 );
+      indices.add( s0 );
+      indices.add( e1 );
+
+      indices.add( e1 );
+      indices.add( s0 );
+      indices.add( s1 );
+    }
+
+    levelCount[l] = indices.size() - levelStart[l];
+  }
+}
+
+
+void TerrainChunks::buildQuadtree()
+
+{
+  boxes.clear();
+  boxesX.clear();
+  boxesY.clear();
+
+  seq<Box> level( chunks.size() );
+
+  for (int c=0; c<chunks.size(); c++) {
+    Box b;
+    b.min = chunks[c].boxMin;
+    b.max = chunks[c].boxMax;
+    level.add( b );
+  }
+
+  int nx = chunksX;
+  int ny = chunksY;
+
+  boxes.add( std::move( level ) );
+  boxesX.add( nx );
+  boxesY.add( ny );
+
+  while (nx > 1 || ny > 1) {
+
+    seq<Box> &below = boxes[ boxes.size()-1 ];
+
+    int px = (nx+1) / 2;
+    int py = (ny+1) / 2;
+
+    seq<Box> parents( px * py );
+
+    for (int j=0; j<py; j++)
+      for (int i=0; i<px; i++) {
+
+        Box b = below[ (2*j)*nx + 2*i ];
+
+        for (int dj=0; dj<2; dj++)
+          for (int di=0; di<2; di++)
+            if (2*i+di < nx && 2*j+dj < ny) {
+              Box &child = below[ (2*j+dj)*nx + 2*i+di ];
+              b.min = vec3( fmin( b.min.x, child.min.x ), fmin( b.min.y, child.min.y ), fmin( b.min.z, child.min.z ) );
+              b.max = vec3( fmax( b.max.x, child.max.x ), fmax( b.max.y, child.max.y ), fmax( b.max.z, child.max.z ) );
+            }
+
+        parents.add( b );
+      }
+
+    nx = px;
+    ny = py;
+
+    boxes.add( std::move( parents ) );
+    boxesX.add( nx );
+    boxesY.add( ny );
+  }
+}
+
+
+void TerrainChunks::select( vec3 eye, float errorScale, float maxPixelError, mat4 &MVP, seq<Selection> &selected )
+
+{
+  selected.clear();
+
+  if (chunks.size() == 0)
+    return;
+
+  ViewFrustum frustum( MVP );
+
+  selectBox( boxes.size()-1, 0, 0, frustum, false, eye, errorScale, maxPixelError, selected );
+}
+
+
+// Visit box (i,j) of quadtree level 'level'.  'inside' is true if its
+// parent is entirely inside the frustum, so the box need not be tested.
+
+
+void TerrainChunks::selectBox( int level, int i, int j, ViewFrustum &frustum, bool inside,
+                               vec3 eye, float errorScale, float maxPixelError, seq<Selection> &selected )
+
+{
+  Box &b = boxes[level][ j*boxesX[level] + i ];
+
+  if (!inside) {
+    int v = frustum.boxVisibility( b.min, b.max );
+    if (v == FRUSTUM_OUTSIDE)
+      return;
+    inside = (v == FRUSTUM_INSIDE);
+  }
+
+  if (level > 0) {
+    int nx = boxesX[level-1];
+    int ny = boxesY[level-1];
+    for (int dj=0; dj<2; dj++)
+      for (int di=0; di<2; di++)
+        if (2*i+di < nx && 2*j+dj < ny)
+          selectBox( level-1, 2*i+di, 2*j+dj, frustum, inside, eye, errorScale, maxPixelError, selected );
+    return;
+  }
+
+  // A chunk.  Pick the coarsest level whose error, seen from the
+  // nearest point of the box, is small enough.
+
+  int c = j*chunksX + i;
+
+  vec3 d( fmax( 0, fmax( b.min.x - eye.x, eye.x - b.max.x ) ),
+          fmax( 0, fmax( b.min.y - eye.y, eye.y - b.max.y ) ),
+          fmax( 0, fmax( b.min.z - eye.z, eye.z - b.max.z ) ) );
+
+  float allowed = maxPixelError * d.length() / errorScale;
+
+  int l = TERRAIN_LOD_LEVELS-1;
+  while (l > 0 && chunks[c].error[l] > allowed)
+    l--;
+
+  Selection s;
+  s.chunk = c;
+  s.level = l;
+  selected.add( s );
+}
@@ -0,0 +1,122 @@
+// terrainChunks.h
+//
+// Level of detail for the terrain by geomipmapping.  The heightfield is
+// cut into square chunks of TERRAIN_CHUNK_QUADS x TERRAIN_CHUNK_QUADS
+// quads.  Each chunk can be drawn at any of TERRAIN_LOD_LEVELS levels,
+// where level l uses every 2^l-th vertex, and each level's triangles
+// come with a skirt hanging down from the chunk's edge to hide the
+// cracks between neighbouring chunks at different levels.
+//
+// This is CPU-only, so that selection can be run and timed without a
+// GPU.  Every chunk has the same vertex layout, so one set of (16-bit)
+// index lists serves all chunks:
+//
+//    TerrainChunks chunks;
+//    chunks.build( width, height, heights );   // row-major heights
+//
+//    for each chunk c and each vertex k < vertsPerChunk()
+//      chunks.vertexSource( c, k, x, y, zLimit )  -> grid vertex (x,y),
+//                                                    with z = min( height, zLimit )
+//
+// or buildVertices() fills a whole vertex buffer that way.
+//
+//    chunks.select( eye, errorScale, maxPixelError, MVP, selected );
+//
+//    for each (chunk,level) in selected
+//      draw indices[ levelStart[level] .. + levelCount[level] ]
+//      with vertex base chunk * vertsPerChunk()
+//
+// Chunks at the high x and y edges of the heightfield may extend past
+// it, in which case their extra vertices are clamped to the edge and
+// give degenerate triangles.
+//
+// Selection walks a quadtree of bounding boxes over the chunks,
+// skipping subtrees outside the view frustum, and picks for each
+// visible chunk the coarsest level whose height error projects to at
+// most maxPixelError pixels at the chunk's distance from the eye.
+
+
+#ifndef TERRAIN_CHUNKS_H
+#define TERRAIN_CHUNKS_H
+
+#include "headers.h"
+#include "seq.h"
+#include "viewFrustum.h"
+#include "threadPool.h"
+
+
+#define TERRAIN_CHUNK_QUADS  32   // quads along a side of a chunk (a power of 2)
+#define TERRAIN_LOD_LEVELS    6   // log2( TERRAIN_CHUNK_QUADS ) + 1
+
+
+class TerrainChunks {
+
+ public:
+
+  struct Chunk {
+    int   x0, y0;                         // grid position of the chunk's first vertex
+    vec3  boxMin, boxMax;                 // bounding box of the chunk's surface
+    float error[TERRAIN_LOD_LEVELS];      // greatest height error at each level (non-decreasing)
+    float skirtZ[4];                      // bottom of the skirt on each side (below, right, above, left)
+  };
+
+  struct Selection {
+    int chunk;
+    int level;
+  };
+
+  int width, height;                      // heightfield size in vertices
+  int chunksX, chunksY;
+
+  seq<Chunk> chunks;                      // row by row
+
+  seq<unsigned short> indices;            // all levels, one after the other
+  int levelStart[TERRAIN_LOD_LEVELS];
+  int levelCount[TERRAIN_LOD_LEVELS];
+
+  TerrainChunks() {
+    width = height = 0;
+    chunksX = chunksY = 0;
+  }
+
+  // build() and buildVertices() spread rows of chunks over 'pool'
+
+  void build( int width, int height, const float *heights, ThreadPool &pool = ThreadPool::global() );
+
+  static int vertsPerChunk();
+  void vertexSource( int c, int k, int &x, int &y, float &zLimit );
+
+  // Fill 'out' (of chunks.size() * vertsPerChunk() * 8 floats) with
+  // each vertex's position, normal, and texture coordinates in [0,1]
+
+  void buildVertices( const float *heights, const vec3 *normals, float *out,
+                      ThreadPool &pool = ThreadPool::global() );
+
+  // errorScale converts a height error over a distance into pixels:
+  // it is P[1][1] * (viewport height) / 2 for projection matrix P.
+  // MVP maps the terrain's coordinates to clip coordinates, and eye is
+  // in the terrain's coordinates.
+
+  void select( vec3 eye, float errorScale, float maxPixelError, mat4 &MVP, seq<Selection> &selected );
+
+ private:
+
+  struct Box {
+    vec3 min, max;
+  };
+
+  // The quadtree: boxes[0] has one box per chunk and each later level
+  // has one box per 2x2 boxes of the level before, up to a single box.
+
+  seq< seq<Box> > boxes;
+  seq<int> boxesX, boxesY;
+
+  void buildIndices();
+  void buildQuadtree();
+  void chunkErrors( Chunk &chunk, const float *heights );
+
+  void selectBox( int level, int i, int j, ViewFrustum &frustum, bool inside,
+                  vec3 eye, float errorScale, float maxPixelError, seq<Selection> &selected );
+};
+
+#endif
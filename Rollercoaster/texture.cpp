@@ -51,9 +51,7 @@ void Texture::loadTexture( string filename )
   
   texmap = new GLubyte[ width * height * 4 ];
 
-  GLubyte *p = texmap;
-  for (unsigned int i=0; i<width*height*4; i++)
-    *p++ = image[i];
+  memcpy( texmap, image.data(), width * height * 4 );
 
   hasAlpha = true;
 }
@@ -11,9 +11,6 @@ class Texture {
 
   GLubyte *texmap; 
 
-  void registerWithOpenGL();
-  void loadTexture( string filename );
-
  public:
 
   string name;
@@ -31,6 +28,13 @@ class Texture {
     registerWithOpenGL();
   }
 
+  // The two halves of the constructor.  loadTexture() makes no OpenGL
+  // calls, so it can run on any thread; registerWithOpenGL() must run
+  // on the thread with the context.
+
+  void loadTexture( string filename );
+  void registerWithOpenGL();
+
   void activate( int textureUnit ) {
     glActiveTexture( GL_TEXTURE0 + textureUnit );
     glBindTexture( GL_TEXTURE_2D, textureID );
@@ -42,6 +46,16 @@ class Texture {
   }
 
   vec3 texel( int i, int j, float &alpha );
+
+  // The raw texels, row by row, each of bytesPerTexel() bytes (red first)
+
+  const GLubyte *texels() {
+    return texmap;
+  }
+
+  int bytesPerTexel() {
+    return (hasAlpha ? 4 : 3);
+  }
 };
 
 
@@ -0,0 +1,425 @@
+// trackMesh.cpp
+
+
+#include "trackMesh.h"
+
+
+// Cross-sections, in the local frame of the track (x across, y up,
+// z along), matching the rails and ties of World::drawAllTrack
+
+#define RAIL_X       1.5
+#define RAIL_Y      -1.0
+#define RAIL_HALF_W  0.25
+#define RAIL_HALF_H  0.375
+
+#define TIE_Y       -1.5
+#define TIE_HALF_W   2.0
+#define TIE_HALF_H   0.125
+#define TIE_HALF_L   0.5
+
+#define TRACK_MAX_DRIFT  (2 * M_PI / 180) // radians from the spline's frames
+
+#define RAIL_VERTS_PER_RING 16  // 2 rails x 4 sides x 2 corners (flat shaded)
+#define TIE_VERTS           24  // 6 faces x 4 corners
+
+
+// Corners of the four sides of a rail, going around the cross-section,
+// with each side's outward normal
+
+static const float railSides[4][3][2] = {
+  { { -1, 1 }, {  1, 1 }, {  0, 1 } }, // top
+  { {  1, 1 }, {  1,-1 }, {  1, 0 } }, // right
+  { {  1,-1 }, { -1,-1 }, {  0,-1 } }, // bottom
+  { { -1,-1 }, { -1, 1 }, { -1, 0 } }  // left
+};
+
+
+// Each face of a tie as its normal and two in-face axes, so that the
+// corners are normal +- u +- v on the unit box
+
+static const float tieFaces[6][3][3] = {
+  { {  0, 1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } },
+  { {  0,-1, 0 }, { 1, 0, 0 }, { 0, 0,  1 } },
+  { {  0, 0, 1 }, { 1, 0, 0 }, { 0, 1,  0 } },
+  { {  0, 0,-1 }, {-1, 0, 0 }, { 0, 1,  0 } },
+  { { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1,  0 } },
+  { {  1, 0, 0 }, { 0, 0,-1 }, { 0, 1,  0 } }
+};
+
+static const float tieCorners[4][2] = { {-1,-1}, {1,-1}, {1,1}, {-1,1} };
+
+
+int TrackMesh::vertsPerSegment()
+
+{
+  return RAIL_VERTS_PER_RING * (TRACK_RINGS_PER_SEG+1) + TIE_VERTS * TRACK_RINGS_PER_SEG;
+}
+
+
+int TrackMesh::railIndicesPerSegment()
+
+{
+  return 2*4*6 * TRACK_RINGS_PER_SEG;
+}
+
+
+int TrackMesh::tieIndicesPerSegment()
+
+{
+  return 6*6 * TRACK_RINGS_PER_SEG;
+}
+
+
+int TrackMesh::railIndexCount()
+
+{
+  return segs.size() * railIndicesPerSegment();
+}
+
+
+int TrackMesh::tieIndexCount()
+
+{
+  return segs.size() * tieIndicesPerSegment();
+}
+
+
+// The unit vector in the direction of v with its component along the
+// unit vector t removed, or some unit vector perpendicular to t if v is
+// (nearly) parallel to t
+
+
+static vec3 perpendicularTo( vec3 v, vec3 t )
+
+{
+  vec3 p = v - (v * t) * t;
+
+  if (p.length() > 1e-6)
+    return p.normalize();
+
+  p = (fabs(t.z) < 0.9 ? vec3(0,0,1) : vec3(0,1,0));
+  p = p - (p * t) * t;
+
+  return p.normalize();
+}
+
+
+static vec3 rotateAbout( vec3 v, vec3 k, float angle )
+
+{
+  float c = cos( angle );
+  float s = sin( angle );
+
+  return c * v + s * (k ^ v) + ((1-c) * (k * v)) * k;
+}
+
+
+// Bring the mesh up to date with the spline.  Returns true if anything
+// changed, in which case either 'rebuilt' is set or 'changedSegs' lists
+// the segments that were regenerated.
+
+
+bool TrackMesh::update( Spline *spline )
+
+{
+  rebuilt = false;
+  changedSegs.clear();
+
+  int version = spline->version();
+
+  if (version == splineVersion)
+    return false;
+
+  splineVersion = version;
+
+  int n = spline->data.size();
+
+  if (n < 2 || spline->totalArcLength() <= 0) {
+    segs.clear();
+    positions.clear();
+    normals.clear();
+    indices.clear();
+    boxMins.resize( 0 );
+    boxMaxs.resize( 0 );
+    rebuilt = true;
+    return true;
+  }
+
+  if (segs.size() != n) {
+    rebuild( spline );
+    return true;
+  }
+
+  bool *changed = new bool[n];
+
+  for (int i=0; i<n; i++) {
+    changed[i] = (spline->segmentStamp( i ) != segs[i].stamp);
+    if (changed[i])
+      changedSegs.add( i );
+  }
+
+  // The spline's frames twist slightly everywhere when any part of the
+  // curve changes, so the kept normals slowly drift from them.  Start
+  // again once they are too far off.  While the frames are held (as
+  // during a drag) they are stale, so this waits for the release.
+
+  float maxDrift = 0;
+
+  if (changedSegs.size() < n && !spline->framesAreHeld())
+    for (int i=0; i<n; i++)
+      if (!changed[i]) {
+        float c = segs[i].yStart * knotNormal( spline, i );
+        maxDrift = fmax( maxDrift, acos( fmin( 1, c ) ) );
+      }
+
+  if (changedSegs.size() == n || maxDrift > TRACK_MAX_DRIFT)
+    rebuild( spline );
+
+  else if (changedSegs.size() > 0) {
+
+    // New end normals.  A knot between two changed segments takes the
+    // spline's normal; otherwise the normal of the unchanged neighbour
+    // is kept, so the join with it does not move.
+
+    for (int j=0; j<changedSegs.size(); j++) {
+
+      int i = changedSegs[j];
+      int prev = (i-1+n) % n;
+      int next = (i+1) % n;
+
+      segs[i].yStart = (changed[prev] ? knotNormal( spline, i )    : segs[prev].yEnd);
+      segs[i].yEnd   = (changed[next] ? knotNormal( spline, next ) : segs[next].yStart);
+    }
+
+    for (int j=0; j<changedSegs.size(); j++)
+      buildSegment( spline, changedSegs[j] );
+  }
+
+  delete [] changed;
+
+  return (rebuilt || changedSegs.size() > 0);
+}
+
+
+// The spline's normal (the y axis of its local frame) at knot i
+
+
+vec3 TrackMesh::knotNormal( Spline *spline, int i )
+
+{
+  vec3 o, x, y, z;
+
+  spline->findLocalSystemAtArcLength( spline->segmentStartArcLength( i ), o, x, y, z );
+
+  return y;
+}
+
+
+// Build everything, taking all end normals from the spline
+
+
+void TrackMesh::rebuild( Spline *spline )
+
+{
+  int n = spline->data.size();
+
+  segs.clear();
+  segs.reserve( n );
+
+  for (int i=0; i<n; i++) {
+    SegmentInfo info;
+    info.stamp = 0;
+    info.yStart = knotNormal( spline, i );
+    segs.add( info );
+  }
+
+  for (int i=0; i<n; i++)
+    segs[i].yEnd = segs[(i+1) % n].yStart;
+
+  int nVerts = n * vertsPerSegment();
+
+  positions.clear();
+  normals.clear();
+  positions.reserve( nVerts );
+  normals.reserve( nVerts );
+
+  for (int k=0; k<nVerts; k++) {
+    positions.add( vec3(0,0,0) );
+    normals.add( vec3(0,0,0) );
+  }
+
+  boxMins.resize( n );
+  boxMaxs.resize( n );
+
+  for (int i=0; i<n; i++)
+    buildSegment( spline, i );
+
+  buildIndices();
+
+  rebuilt = true;
+  changedSegs.clear();
+}
+
+
+// Regenerate the vertices of segment i.  The rings are evenly spaced by
+// arc length.  The normal is carried from yStart by double reflection
+// (as in Spline::computeFrames) and the remaining twist to yEnd is
+// spread over the segment.
+
+
+void TrackMesh::buildSegment( Spline *spline, int i )
+
+{
+  const int R = TRACK_RINGS_PER_SEG;
+
+  float params[R+1];
+  vec3 pos[R+1], tan[R+1], y[R+1];
+
+  float len = spline->segmentArcLength( i );
+
+  for (int k=1; k<R; k++)
+    params[k] = spline->paramInSegment( i, k * len / R );
+
+  params[0] = i;                // exactly, so that the ends match the neighbours'
+  params[R] = i+1;
+
+  spline->evalBatch( params, R+1, pos, tan );
+
+  for (int k=0; k<=R; k++)
+    if (tan[k].length() < 1e-6)
+      tan[k] = (k > 0 ? tan[k-1] : vec3(1,0,0));
+    else
+      tan[k] = tan[k].normalize();
+
+  y[0] = perpendicularTo( segs[i].yStart, tan[0] );
+
+  for (int k=0; k<R; k++) {
+
+    vec3 r = y[k];
+    vec3 t = tan[k];
+
+    vec3 v1 = pos[k+1] - pos[k];
+    float c1 = v1 * v1;
+
+    if (c1 > 1e-12) {
+      r = r - ((2/c1) * (v1 * r)) * v1;
+      t = t - ((2/c1) * (v1 * t)) * v1;
+    }
+
+    vec3 v2 = tan[k+1] - t;
+    float c2 = v2 * v2;
+
+    if (c2 > 1e-12)
+      r = r - ((2/c2) * (v2 * r)) * v2;
+
+    y[k+1] = perpendicularTo( r, tan[k+1] );
+  }
+
+  vec3 yEnd = perpendicularTo( segs[i].yEnd, tan[R] );
+
+  float twist = atan2( (y[R] ^ yEnd) * tan[R], y[R] * yEnd );
+
+  for (int k=1; k<R; k++)
+    y[k] = perpendicularTo( rotateAbout( y[k], tan[k], twist * k / (float) R ), tan[k] );
+
+  y[R] = yEnd;
+
+  segs[i].yStart = y[0];
+  segs[i].yEnd   = y[R];
+  segs[i].stamp  = spline->segmentStamp( i );
+
+  // Vertices
+
+  vec3 *P = &positions[ i * vertsPerSegment() ];
+  vec3 *N = &normals[ i * vertsPerSegment() ];
+
+  for (int k=0; k<=R; k++) {
+
+    vec3 z = tan[k];
+    vec3 x = (z ^ y[k]).normalize();
+
+    for (int side=-1; side<=1; side+=2)
+      for (int s=0; s<4; s++) {
+        vec3 n = railSides[s][2][0] * x + railSides[s][2][1] * y[k];
+        for (int c=0; c<2; c++) {
+          *P++ = pos[k] + (side * RAIL_X + railSides[s][c][0] * RAIL_HALF_W) * x
+                        + (RAIL_Y + railSides[s][c][1] * RAIL_HALF_H) * y[k];
+          *N++ = n;
+        }
+      }
+  }
+
+  for (int k=0; k<R; k++) {
+
+    vec3 z = tan[k];
+    vec3 x = (z ^ y[k]).normalize();
+    vec3 o = pos[k] + TIE_Y * y[k];
+
+    for (int f=0; f<6; f++) {
+
+      const float (*F)[3] = tieFaces[f];
+      vec3 n = F[0][0] * x + F[0][1] * y[k] + F[0][2] * z;
+
+      for (int c=0; c<4; c++) {
+        float a = tieCorners[c][0];
+        float b = tieCorners[c][1];
+        *P++ = o + ((F[0][0] + a*F[1][0] + b*F[2][0]) * TIE_HALF_W) * x
+                 + ((F[0][1] + a*F[1][1] + b*F[2][1]) * TIE_HALF_H) * y[k]
+                 + ((F[0][2] + a*F[1][2] + b*F[2][2]) * TIE_HALF_L) * z;
+        *N++ = n;
+      }
+    }
+  }
+
+  // Bounding box
+
+  vec3 *first = &positions[ i * vertsPerSegment() ];
+
+  vec3 boxMin = first[0];
+  vec3 boxMax = first[0];
+
+  for (vec3 *p = first; p < P; p++) {
+    boxMin = vec3( fmin( boxMin.x, p->x ), fmin( boxMin.y, p->y ), fmin( boxMin.z, p->z ) );
+    boxMax = vec3( fmax( boxMax.x, p->x ), fmax( boxMax.y, p->y ), fmax( boxMax.z, p->z ) );
+  }
+
+  boxMins.set( i, boxMin );
+  boxMaxs.set( i, boxMax );
+}
+
+
+// Indices depend only on the number of segments.  Triangles are
+// counterclockwise seen from outside.  (The frame (x,y,z) with x = z ^ y
+// is left-handed, which reverses the tie faces as listed above.)
+
+
+void TrackMesh::buildIndices()
+
+{
+  const int R = TRACK_RINGS_PER_SEG;
+
+  int n = segs.size();
+  int V = vertsPerSegment();
+
+  indices.clear();
+  indices.reserve( railIndexCount() + tieIndexCount() );
+
+  for (int i=0; i<n; i++)
+    for (int k=0; k<R; k++)
+      for (int s=0; s<8; s++) {
+        unsigned int a = i*V + k*RAIL_VERTS_PER_RING + 2*s;
+        unsigned int b = a+1;
+        unsigned int c = a + RAIL_VERTS_PER_RING;
+        unsigned int d = b + RAIL_VERTS_PER_RING;
+        indices.add( a ); indices.add( b ); indices.add( d );
+        indices.add( a ); indices.add( d ); indices.add( c );
+      }
+
+  for (int i=0; i<n; i++)
+    for (int k=0; k<R; k++)
+      for (int f=0; f<6; f++) {
+        unsigned int a = i*V + RAIL_VERTS_PER_RING*(R+1) + k*TIE_VERTS + 4*f;
+        indices.add( a ); indices.add( a+2 ); indices.add( a+1 );
+        indices.add( a ); indices.add( a+3 ); indices.add( a+2 );
+      }
+}
@@ -0,0 +1,89 @@
+// trackMesh.h
+//
+// Track geometry swept along the spline.  The rail cross-sections are
+// extruded through rings of frames along each segment and a tie is
+// placed at each ring, giving one indexed triangle mesh of positions
+// and normals.
+//
+// This is CPU-only; see TrackRenderer for drawing it.
+//
+// The mesh is stored segment by segment, with the same number of
+// vertices and indices in every segment, so that moving a control point
+// changes only the blocks of the segments that it affects:
+//
+//    TrackMesh mesh;
+//
+//    if (mesh.update( spline ))   // true if anything changed
+//      ... upload mesh.changedSegs (or everything if mesh.rebuilt) ...
+//
+// Each segment's frames are carried from a normal at its start to a
+// normal at its end by rotation-minimising steps.  These end normals
+// are shared with the neighbouring segments and are re-read from the
+// spline's frames only at knots where both neighbours changed, so
+// untouched segments never need to be regenerated to stay joined.
+
+
+#ifndef TRACK_MESH_H
+#define TRACK_MESH_H
+
+#include "headers.h"
+#include "seq.h"
+#include "spline.h"
+
+
+#define TRACK_RINGS_PER_SEG  20   // also one tie per ring
+
+
+class TrackMesh {
+
+ public:
+
+  seq<vec3> positions;
+  seq<vec3> normals;
+  seq<unsigned int> indices;    // all rails, then all ties
+
+  bool rebuilt;                 // last update() rebuilt everything
+  seq<int> changedSegs;         // otherwise, the segments it regenerated
+
+  vec3SoA boxMins, boxMaxs;     // bounding box of each segment
+
+  TrackMesh() {
+    splineVersion = -1;
+    rebuilt = false;
+  }
+
+  bool update( Spline *spline );
+
+  int numSegments() {
+    return segs.size();
+  }
+
+  // Layout of segment i: vertices [i*vertsPerSegment(), (i+1)*vertsPerSegment())
+
+  int vertsPerSegment();
+  int railIndexCount();         // indices[0 .. railIndexCount()-1] are the rails
+  int tieIndexCount();          // the rest are the ties
+
+  // Within the rails and within the ties, segment i's indices are
+  // block i of this many
+
+  int railIndicesPerSegment();
+  int tieIndicesPerSegment();
+
+ private:
+
+  struct SegmentInfo {
+    int stamp;                  // spline's segmentStamp() when built
+    vec3 yStart, yEnd;          // normals at the two ends
+  };
+
+  seq<SegmentInfo> segs;
+  int splineVersion;
+
+  void rebuild( Spline *spline );
+  void buildSegment( Spline *spline, int i );
+  void buildIndices();
+  vec3 knotNormal( Spline *spline, int i );
+};
+
+#endif
@@ -0,0 +1,175 @@
+// trackRenderer.cpp
+
+
+#include "trackRenderer.h"
+#include "drawStats.h"
+
+
+void TrackRenderer::setupVAO()
+
+{
+  glGenVertexArrays( 1, &VAO );
+  glBindVertexArray( VAO );
+
+  // attribute 0 = position
+
+  glGenBuffers( 1, &positionBufferID );
+  glBindBuffer( GL_ARRAY_BUFFER, positionBufferID );
+
+  glEnableVertexAttribArray( 0 );
+  glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+
+  // attribute 1 = normal
+
+  glGenBuffers( 1, &normalBufferID );
+  glBindBuffer( GL_ARRAY_BUFFER, normalBufferID );
+
+  glEnableVertexAttribArray( 1 );
+  glVertexAttribPointer( 1, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+
+  // indices (bound as part of the VAO state)
+
+  glGenBuffers( 1, &indexBufferID );
+  glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, indexBufferID );
+
+  glBindVertexArray( 0 );
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+  nRailIndices = 0;
+  nTieIndices = 0;
+  nRailIndicesPerSeg = 0;
+  nTieIndicesPerSeg = 0;
+}
+
+
+// Copy the mesh to the GPU: everything if it was rebuilt, otherwise
+// just the vertex blocks of the changed segments
+
+
+void TrackRenderer::upload( TrackMesh &mesh )
+
+{
+  if (mesh.rebuilt) {
+
+    glBindBuffer( GL_ARRAY_BUFFER, positionBufferID );
+    glBufferData( GL_ARRAY_BUFFER, mesh.positions.size() * sizeof(vec3), mesh.positions.array(), GL_DYNAMIC_DRAW );
+
+    glBindBuffer( GL_ARRAY_BUFFER, normalBufferID );
+    glBufferData( GL_ARRAY_BUFFER, mesh.normals.size() * sizeof(vec3), mesh.normals.array(), GL_DYNAMIC_DRAW );
+
+    glBindVertexArray( VAO );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), mesh.indices.array(), GL_STATIC_DRAW );
+    glBindVertexArray( 0 );
+
+    nRailIndices = mesh.railIndexCount();
+    nTieIndices = mesh.tieIndexCount();
+    nRailIndicesPerSeg = mesh.railIndicesPerSegment();
+    nTieIndicesPerSeg = mesh.tieIndicesPerSegment();
+
+  } else {
+
+    int V = mesh.vertsPerSegment();
+    GLsizeiptr size = V * sizeof(vec3);
+
+    for (int j=0; j<mesh.changedSegs.size(); j++) {
+
+      int i = mesh.changedSegs[j];
+      GLintptr offset = i * size;
+
+      glBindBuffer( GL_ARRAY_BUFFER, positionBufferID );
+      glBufferSubData( GL_ARRAY_BUFFER, offset, size, &mesh.positions[i*V] );
+
+      glBindBuffer( GL_ARRAY_BUFFER, normalBufferID );
+      glBufferSubData( GL_ARRAY_BUFFER, offset, size, &mesh.normals[i*V] );
+    }
+  }
+
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+
+void TrackRenderer::draw( const mat4 &MV, const mat4 &MVP, vec3 lightDir, vec3 railColour, vec3 tieColour,
+                          const seq<int> &segments )
+
+{
+  if (nRailIndices == 0 || segments.size() == 0)
+    return;
+
+  gpu.activate();
+
+  MVUniform.set( MV );
+  MVPUniform.set( MVP );
+  lightDirUniform.set( lightDir );
+
+  glBindVertexArray( VAO );
+
+  for (int pass=0; pass<2; pass++) {
+
+    int perSeg = (pass == 0 ? nRailIndicesPerSeg : nTieIndicesPerSeg);
+    int start  = (pass == 0 ? 0 : nRailIndices);
+
+    colourUniform.set( pass == 0 ? railColour : tieColour );
+
+    int i = 0;
+
+    while (i < segments.size()) {
+
+      int j = i+1;
+      while (j < segments.size() && segments[j] == segments[j-1]+1)
+        j++;
+
+      GLintptr offset = (start + segments[i] * perSeg) * sizeof(unsigned int);
+
+      glDrawElements( GL_TRIANGLES, (j-i) * perSeg, GL_UNSIGNED_INT, (void *) offset );
+      drawStats.drawCalls++;
+
+      i = j;
+    }
+  }
+
+  glBindVertexArray( 0 );
+
+  gpu.deactivate();
+}
+
+
+const char *TrackRenderer::vertShader = R"(
+
+  #version 330 es
+
+  uniform mat4 MVP;
+  uniform mat4 MV;
+
+  layout (location = 0) in mediump vec3 vertPosition;
+  layout (location = 1) in mediump vec3 vertNormal;
+
+  smooth out mediump vec3 normal;
+
+  void main() {
+
+    gl_Position = MVP * vec4( vertPosition, 1.0 );
+    normal = vec3( MV * vec4( vertNormal, 0.0 ) );
+  }
+)";
+
+
+const char *TrackRenderer::fragShader = R"(
+
+  #version 330 es
+
+  uniform mediump vec3 lightDir;
+  uniform mediump vec3 colour;
+
+  smooth in mediump vec3 normal;
+  out mediump vec4 outputColour;
+
+  void main() {
+
+    mediump float NdotL = dot( normalize(normal), lightDir );
+
+    if (NdotL < 0.0)
+      NdotL = 0.1; // some ambient
+
+    outputColour = vec4( NdotL * colour, 1.0 );
+  }
+)";
@@ -0,0 +1,70 @@
+// trackRenderer.h
+//
+// Draws a TrackMesh, keeping a copy of it on the GPU.  After
+// mesh.update() returns true, call upload( mesh ) to copy over just the
+// parts that changed.
+
+
+#ifndef TRACK_RENDERER_H
+#define TRACK_RENDERER_H
+
+#include "headers.h"
+#include "gpuProgram.h"
+#include "trackMesh.h"
+
+
+class TrackRenderer {
+
+ public:
+
+  TrackRenderer() {
+    gpu.init( vertShader, fragShader, "in trackRenderer.cpp" );
+
+    MVUniform       = gpu.uniform<mat4>( "MV" );
+    MVPUniform      = gpu.uniform<mat4>( "MVP" );
+    colourUniform   = gpu.uniform<vec3>( "colour" );
+    lightDirUniform = gpu.uniform<vec3>( "lightDir" );
+
+    setupVAO();
+  }
+
+  ~TrackRenderer() {
+    glDeleteBuffers( 1, &positionBufferID );
+    glDeleteBuffers( 1, &normalBufferID );
+    glDeleteBuffers( 1, &indexBufferID );
+    glDeleteVertexArrays( 1, &VAO );
+  }
+
+  void upload( TrackMesh &mesh );
+
+  // Draw only the listed segments, which must be in increasing order.
+  // Each run of consecutive segments takes one draw call for its rails
+  // and one for its ties.
+
+  void draw( const mat4 &MV, const mat4 &MVP, vec3 lightDir, vec3 railColour, vec3 tieColour,
+             const seq<int> &segments );
+
+ private:
+
+  GLuint VAO;
+  GLuint positionBufferID;
+  GLuint normalBufferID;
+  GLuint indexBufferID;
+
+  int nRailIndices;
+  int nTieIndices;
+  int nRailIndicesPerSeg;
+  int nTieIndicesPerSeg;
+
+  GPUProgram gpu;
+
+  UniformHandle<mat4> MVUniform, MVPUniform;
+  UniformHandle<vec3> colourUniform, lightDirUniform;
+
+  static const char *vertShader;
+  static const char *fragShader;
+
+  void setupVAO();
+};
+
+#endif
@@ -8,7 +8,6 @@
 #define SPHERE_COLOUR 238/255.0, 106/255.0, 20/255.0
 #define CAR_COLOUR 2/255.0, 12/255.0, 63/255.0 // train colour
 #define CAR_DIMENSIONS vec3( 3.75, 5.0, 10.0 ) // for scaling cube
-#define GRAVITY vec3( 0, 0, -9.8 ) // for physics implementation
 
 // Draw the train.
 //
@@ -20,19 +19,35 @@ void Train::draw( mat4 &WCStoVCS, mat4 &WCStoCCS, vec3 lightDir, bool flag )
 {
 #if 1
 
-  // YOUR CODE HERE
+  if (carCubes == NULL)
+    carCubes = new InstancedCubes();
 
-	float t = spline->paramAtArcLength(pos);
+  // Frames of all the cars in one walk along the track
 
-	mat4 M = spline->findLocalTransform(t) * translate(0.0, 2.0, 0.0) * scale(CAR_DIMENSIONS.x, CAR_DIMENSIONS.y, CAR_DIMENSIONS.z); // translate to make train look like its on top of the tracks
-	mat4 MV = WCStoVCS * M;
-	mat4 MVP = WCStoCCS * M;
+  for (int i=0; i<nCars; i++)
+    carS[i] = drawPos - i * spacing;
 
-	cube->draw(MV, MVP, lightDir, vec3(CAR_COLOUR));
+  spline->findLocalTransforms( carS, nCars, carM );
+
+  mat4 carShape = translate( 0, 2, 0 ) * scale( CAR_DIMENSIONS.x, CAR_DIMENSIONS.y, CAR_DIMENSIONS.z ); // on top of the track
+
+  for (int i=0; i<nCars; i++)
+    carM[i] = carM[i] * carShape;
+
+  // The number of cars and their colours only change in setCars(), so
+  // most frames upload just the transforms
+
+  if (carsChanged) {
+    carCubes->setInstances( carM, carColours, nCars );
+    carsChanged = false;
+  } else
+    carCubes->setTransforms( carM, nCars );
+
+  carCubes->draw( WCStoVCS, WCStoCCS, lightDir );
 
 #else
 
-  float t = spline->paramAtArcLength( pos );
+  float t = spline->paramAtArcLength( drawPos );
 
   // Draw sphere
 
@@ -52,30 +67,179 @@ void Train::draw( mat4 &WCStoVCS, mat4 &WCStoCCS, vec3 lightDir, bool flag )
 void Train::advance( float elapsedSeconds )
 
 {
-#if 1
+  prevPos = pos;
 
-  // YOUR CODE HERE
-	float t = spline->paramAtArcLength(pos);
+  float length = spline->totalArcLength();
 
-	vec3 o, x, y, z;
-	spline->findLocalSystem(t, o, x, y, z);
-    #if 1 // normal gravity of -9.8m/s^2
-		velocity = speed * z + elapsedSeconds * (5 * GRAVITY * z) * z;
+  if (elapsedSeconds <= 0 || length <= 0)
+    return;
 
-    #else // increased gravity to better visualize effect of physics on train (doubled)
-		velocity = speed * z + elapsedSeconds * (2 * GRAVITY);
-    #endif
+  int n = (int) ceil( elapsedSeconds / TRAIN_SUBSTEP );
+  double h = elapsedSeconds / (double) n;
 
-	speed = velocity.length();
-	if (speed < 30.0) // minimum speed so train doesn't get stuck
-		speed = 30.0;
-	pos = pos + elapsedSeconds * speed;
+  for (int i=0; i<n; i++)
+    step( h );
 
-	if (pos >= spline->totalArcLength()) // so train does not stop after one loop of track
-		pos = 0;
-#else
+  // Wrap exactly, keeping the distance past the end
 
-  pos += 1;
+  if (pos >= length || pos < 0) {
+    pos = fmod( pos, length );
+    if (pos < 0)
+      pos += length;
+  }
+}
 
-#endif
+
+void Train::setCars( int n, float carSpacing )
+
+{
+  if (n < 1)
+    n = 1;
+  else if (n > TRAIN_MAX_CARS)
+    n = TRAIN_MAX_CARS;
+
+  nCars = n;
+  spacing = fmax( 0, carSpacing );
+
+  delete[] carS;
+  delete[] carM;
+  delete[] carColours;
+
+  carS = new float[ nCars ];
+  carM = new mat4[ nCars ];
+  carColours = new vec3[ nCars ];
+
+  for (int i=0; i<nCars; i++)
+    carColours[i] = vec3( CAR_COLOUR );
+
+  carsChanged = true;
+}
+
+
+// Slope of the train with its first car at s: the mean slope from
+// the last car to the first
+
+
+double Train::slopeAt( double s )
+
+{
+  float z, slope;
+  spline->heightAtArcLength( s, z, slope );
+
+  float length = (nCars-1) * spacing;
+
+  if (length <= 0)
+    return slope;
+
+  float zLast, slopeLast;
+  spline->heightAtArcLength( s - length, zLast, slopeLast );
+
+  return (z - (double) zLast) / length;
+}
+
+
+// One RK4 step of h seconds
+
+
+void Train::step( double h )
+
+{
+  double slope = slopeAt( pos );
+
+  // The lift only pulls a train that is going forwards, so one that is
+  // rolling back down a climb keeps rolling back
+
+  if (liftSpeed > 0 && slope > 0 && speed >= 0 && speed < liftSpeed)
+    speed = liftSpeed;
+
+  double v1 = speed;
+  double a1 = acceleration( slope, v1 );
+
+  double v2 = speed + 0.5*h * a1;
+  double a2 = acceleration( slopeAt( pos + 0.5*h * v1 ), v2 );
+
+  double v3 = speed + 0.5*h * a2;
+  double a3 = acceleration( slopeAt( pos + 0.5*h * v2 ), v3 );
+
+  double v4 = speed + h * a3;
+  double a4 = acceleration( slopeAt( pos + h * v3 ), v4 );
+
+  pos   += h/6 * (v1 + 2*v2 + 2*v3 + v4);
+  speed += h/6 * (a1 + 2*a2 + 2*a3 + a4);
+}
+
+
+// d speed / dt on a track of slope dz/ds at speed v
+
+
+double Train::acceleration( double slope, double v )
+
+{
+  double a = -gravity * slope;
+
+  if (friction > 0 && v != 0) {
+    double normal = gravity * sqrt( fmax( 0, 1 - slope*slope ) );
+    a -= (v > 0 ? 1 : -1) * friction * normal;
+  }
+
+  a -= drag * v * fabs(v);
+
+  return a;
+}
+
+
+// The potential energy is from the mean height of the chain of cars,
+// by Simpson's rule in steps of about ENERGY_STEP.  This is for
+// checking the integrator, so it is thorough rather than fast.
+
+
+#define ENERGY_STEP 0.25
+
+
+float Train::energy()
+
+{
+  float z, slope;
+  spline->heightAtArcLength( pos, z, slope );
+
+  float length = (nCars-1) * spacing;
+
+  if (length > 0) {
+
+    int n = 2 * (int) ceil( length / (2*ENERGY_STEP) );
+    double h = length / n;
+    double sum = 0;
+
+    for (int i=0; i<=n; i++) {
+      spline->heightAtArcLength( pos - i*h, z, slope );
+      sum += (i == 0 || i == n ? 1 : (i % 2 == 1 ? 4 : 2)) * z;
+    }
+
+    z = sum * h / 3 / length;
+  }
+
+  return 0.5f * speed*speed + gravity * z;
+}
+
+
+void Train::interpolate( float alpha )
+
+{
+  // The train moves much less than half the track in a step, so a
+  // longer jump is a wrap around the end of the track
+
+  float length = spline->totalArcLength();
+  float d = pos - prevPos;
+
+  if (d > length/2)
+    d -= length;
+  else if (d < -length/2)
+    d += length;
+
+  drawPos = prevPos + alpha * d;
+
+  if (drawPos >= length)
+    drawPos -= length;
+  else if (drawPos < 0)
+    drawPos += length;
 }
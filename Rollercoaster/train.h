@@ -5,39 +5,134 @@
 
 #include "headers.h"
 #include "spline.h"
+#include "instancedCubes.h"
 
 #define SPEED_INC 0.5
 
+#define TRAIN_GRAVITY   (5*9.8)  // world units/s^2 (5g, which looks right at the track's scale)
+#define TRAIN_SUBSTEP   0.001    // longest integration step, in seconds
+#define TRAIN_LIFT      30       // default chain-lift speed
+
+#define TRAIN_CARS      4        // default number of cars
+#define TRAIN_SPACING   12       // default arc length between the centres of neighbouring cars
+#define TRAIN_MAX_CARS  256
+
+
+// The train rolls along the track under gravity.  Its state is its arc
+// length 'pos' and its signed speed along the track, and each step of
+// advance() integrates
+//
+//    d pos / dt   = speed
+//    d speed / dt = -gravity * dz/ds                      (gravity along the track)
+//                   - friction * gravity * sqrt(1 - (dz/ds)^2) * sign(speed)
+//                   - drag * speed * |speed|
+//
+// by RK4 in substeps of at most TRAIN_SUBSTEP, with the height z and
+// slope dz/ds read from the spline's frame table.  With no friction
+// and no drag, speed^2/2 + gravity * z is conserved.
+//
+// Like a real coaster, the train is pulled up any climb that it would
+// take forwards slower than liftSpeed, so that it never stalls.  Set
+// liftSpeed to 0 for a train that only rolls.
+//
+// The train is nCars cars, the first at 'pos' and each of the others
+// 'spacing' behind the one before, along the track.  For the physics
+// the train is a uniform chain from the first car to the last, so
+// that its slope is the mean slope under it, (z(first) - z(last)) /
+// length, and its potential energy is from its mean height.  The cars
+// are drawn with one batched frame lookup and one instanced draw.
+
 class Train {
 
   Spline *spline;
 
   // state
 
-  float pos;                    // position on spline
-  float speed;
-  vec3 velocity;                // added for physics implementation
+  // pos and speed, and the RK4 stages in step(), are doubles because
+  // the steps are tiny next to a long track: in floats, their rounding
+  // adds up to 0.5% of the energy in ten minutes
+
+  double pos;                   // arc length along the spline, in [0,total length)
+  double prevPos;               // before the last advance()
+  float  drawPos;               // between the two, where the train is drawn
+  double speed;                 // d pos / dt, negative when rolling backwards
+
+  int   nCars;
+  float spacing;
 
-  float mass;
+  float *carS;                  // arc lengths of the cars being drawn
+  mat4  *carM;                  // and their transforms
+  vec3  *carColours;
+  InstancedCubes *carCubes;     // made on the first draw
+  bool carsChanged;             // since they were last uploaded to carCubes
+
+  double slopeAt( double s );
+  double acceleration( double slope, double v );
+  void   step( double h );
 
  public:
 
+  float gravity;
+  float friction;               // rolling resistance, as a fraction of the normal force
+  float drag;                   // deceleration per speed^2
+  float liftSpeed;              // 0 for no chain lift
+
   Train( Spline *spl ) {
     spline = spl;
-    pos = 0;
+    pos = prevPos = drawPos = 0;
     speed = 50;
-    mass = 1;
+    gravity = TRAIN_GRAVITY;
+    friction = 0;
+    drag = 0;
+    liftSpeed = TRAIN_LIFT;
+    carS = NULL;
+    carM = NULL;
+    carColours = NULL;
+    carCubes = NULL;
+    setCars( TRAIN_CARS, TRAIN_SPACING );
+  }
+
+  ~Train() {
+    delete[] carS;
+    delete[] carM;
+    delete[] carColours;
+    delete carCubes;
+  }
+
+  Train( const Train & ) = delete;
+  Train & operator = ( const Train & ) = delete;
+
+  // Make the train n cars (between 1 and TRAIN_MAX_CARS) with
+  // 'spacing' between their centres
+
+  void setCars( int n, float spacing );
+
+  int numCars() {
+    return nCars;
+  }
+
+  float carSpacing() {
+    return spacing;
   }
 
   void draw( mat4 &WCStoVCS, mat4 &WCStoCCS, vec3 lightDir, bool flag );
   void advance( float elapsedSeconds );
 
+  // Kinetic plus potential energy per unit mass (of the whole train)
+
+  float energy();
+
+  // Place the train for drawing 'alpha' of the way from its previous
+  // position to its current one
+
+  void interpolate( float alpha );
+
   float getSpeed() {
     return speed;
   }
 
   float getPos() { // for use in scene.cpp when creating train view V transform
-      return pos;
+      return drawPos;
   }
 
   void accelerate() {
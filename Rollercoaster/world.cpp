@@ -4,8 +4,10 @@
 #include "headers.h"
 #include "world.h"
 #include "shMem.h"
+#include "drawStats.h"
 
 #include <strstream>
+#include <chrono>
 #include <fstream>
 #include <iomanip>
 
@@ -13,33 +15,39 @@
 #define LIGHT_DIR 1,1,3
 
 World::World( GLFWwindow *w )
+  : sim( SIM_STEP, SIM_MAX_STEPS )
 
 {
   window = w;
 
-  glfwSetWindowUserPointer( window, this );
+  // No callbacks when headless (with no window)
 
-  // Key handler
+  if (window != NULL) {
 
-  auto static_keyCallback = [](GLFWwindow* ww, int key, int scancode, int action, int mods ) {
-    static_cast<World*>(glfwGetWindowUserPointer(ww))->keyCallback( ww, key, scancode, action, mods );
-  };
+    glfwSetWindowUserPointer( window, this );
 
-  glfwSetKeyCallback( window, static_keyCallback );
+    // Key handler
 
-  // Mouse callbacks
+    auto static_keyCallback = [](GLFWwindow* ww, int key, int scancode, int action, int mods ) {
+      static_cast<World*>(glfwGetWindowUserPointer(ww))->keyCallback( ww, key, scancode, action, mods );
+    };
+
+    glfwSetKeyCallback( window, static_keyCallback );
 
-  auto static_mouseButtonCallback = [](GLFWwindow* ww, int button, int action, int keyModifiers ) {
-    static_cast<World*>(glfwGetWindowUserPointer(ww))->mouseButtonCallback( ww, button, action, keyModifiers );
-  };
+    // Mouse callbacks
 
-  glfwSetMouseButtonCallback( window, static_mouseButtonCallback );
+    auto static_mouseButtonCallback = [](GLFWwindow* ww, int button, int action, int keyModifiers ) {
+      static_cast<World*>(glfwGetWindowUserPointer(ww))->mouseButtonCallback( ww, button, action, keyModifiers );
+    };
 
-  auto static_mouseScrollCallback = [](GLFWwindow* ww, double xoffset, double yoffset ) {
-    static_cast<World*>(glfwGetWindowUserPointer(ww))->mouseScrollCallback( ww, xoffset, yoffset );
-  };
+    glfwSetMouseButtonCallback( window, static_mouseButtonCallback );
 
-  glfwSetScrollCallback( window, static_mouseScrollCallback );
+    auto static_mouseScrollCallback = [](GLFWwindow* ww, double xoffset, double yoffset ) {
+      static_cast<World*>(glfwGetWindowUserPointer(ww))->mouseScrollCallback( ww, xoffset, yoffset );
+    };
+
+    glfwSetScrollCallback( window, static_mouseScrollCallback );
+  }
 
   // Set up arcball interface
 
@@ -56,6 +64,10 @@ World::World( GLFWwindow *w )
   train      = new Train( spline );
   terrain    = new Terrain( string("Rollercoaster/Textures/"), "hills-heights.png", "hills-texture.png" );
   cubemap    = new CubeMap();
+  trackCubes = new InstancedCubes();
+  trackVersion = -1;
+  trackMesh  = new TrackMesh();
+  trackRenderer = new TrackRenderer();
 
   // Miscellaneous stuff
 
@@ -64,6 +76,7 @@ World::World( GLFWwindow *w )
   arcballActive = false;
   drawTrack = true;
   drawCoaster = true;
+  useTrackMesh = true;
   drawUndersideOnly = false;
   useArcLength = false;
   showAxes = false;
@@ -78,6 +91,10 @@ World::World( GLFWwindow *w )
 void World::draw( bool useItemTags )
 
 {
+  drawStats.reset();
+
+  auto startTime = std::chrono::steady_clock::now();
+
   glClearColor( 0,0,0, 0 );
 
   glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
@@ -107,8 +124,7 @@ void World::draw( bool useItemTags )
 
       arcball->centreViewpoint();
 
-      float t = spline->paramAtArcLength(train->getPos());
-      spline->findLocalSystem(t, o, x, y, z);
+      spline->findLocalSystemAtArcLength(train->getPos(), o, x, y, z);
 
       M = translate(0, 0, -3) * identity4(); // moves viewpoint up a bit so it does not go through the tops of pillars
 
@@ -183,7 +199,31 @@ void World::draw( bool useItemTags )
 
   // Done
 
-  glfwSwapBuffers( window );
+  drawStats.frameDone( std::chrono::duration<double,std::milli>( std::chrono::steady_clock::now() - startTime ).count() );
+
+  if (window != NULL)
+    glfwSwapBuffers( window );
+}
+
+
+// A loop of control points around the middle of the terrain, for runs
+// without a mouse.  The bases are put on the ground.
+
+
+void World::addTestTrack( int numPoints )
+
+{
+  float w = terrain->heightfield->width;
+  float h = terrain->heightfield->height;
+
+  for (int i=0; i<numPoints; i++) {
+
+    float theta = 2 * M_PI * i / (float) numPoints;
+    float x = w/2 + 0.3 * w * cos( theta );
+    float y = h/2 + 0.3 * h * sin( theta );
+
+    ctrlPoints->addPointWithHeight( vec3( x, y, terrain->heightAt( x, y ) ), 30 + 15 * sin( 3 * theta ) );
+  }
 }
 
 
@@ -214,6 +254,10 @@ void World::keyCallback( GLFWwindow* window, int key, int scancode, int action,
       drawCoaster = !drawCoaster; // enable/disable coaster drawing
       break;
 
+    case 'G':
+      useTrackMesh = !useTrackMesh; // swept mesh or cubes for the track
+      break;
+
     case 'A':
       useArcLength = !useArcLength; // enable/disable arc-length drawing
       break;
@@ -222,6 +266,10 @@ void World::keyCallback( GLFWwindow* window, int key, int scancode, int action,
       drawUndersideOnly = !drawUndersideOnly; // enable/disable drawing of terrain
       break;
 
+    case 'L':                   // full detail or level of detail for the terrain
+      terrain->maxPixelError = (terrain->maxPixelError > 0 ? 0 : TERRAIN_MAX_PIXEL_ERROR);
+      break;
+
     case 'P':
       pause = !pause;
       break;
@@ -244,10 +292,23 @@ void World::keyCallback( GLFWwindow* window, int key, int scancode, int action,
       train->brake();
       break;
 
+    case '[':
+      train->setCars( train->numCars() - 1, train->carSpacing() );
+      break;
+
+    case ']':
+      train->setCars( train->numCars() + 1, train->carSpacing() );
+      break;
+
     case 'X':
       showAxes = !showAxes;
       break;
 
+    case 'S':
+      drawStats.print( cout ); // counters of the last frame, then restart the timing
+      drawStats.resetTiming();
+      break;
+
     case 'V':
       trainView = !trainView; // toggle train view
       if (trainView) {
@@ -264,12 +325,16 @@ void World::keyCallback( GLFWwindow* window, int key, int scancode, int action,
            << "Change a control point's height by dragging its top." << endl
            << endl
 	       << "-/+ change train speed" << endl
+           << "[/] remove/add a train car" << endl
            << "a - toggle arc length parameterization" << endl
            << "c - toggle coaster drawing" << endl
            << "d - toggle debug mode (shows local coordinate frame on track)" << endl
            << "f - toggle flag (useful for debugging)" << endl
+           << "g - toggle swept track mesh / cube track" << endl
+           << "l - toggle terrain level of detail" << endl
            << "m - cycle through CoB matrices" << endl
            << "p - toggle pause" << endl
+           << "s - print draw statistics and frame times" << endl
            << "t - toggle track drawing" << endl
            << "u - toggle underside of terrain" << endl
            << "w - write initial view (for use on next startup)" << endl
@@ -350,6 +415,7 @@ void World::mouseButtonCallback( GLFWwindow* window, int button, int action, int
         startMousePos = vec3( xpos, ypos, 0 );
 
         dragging = true;
+        spline->holdFrames( true ); // rebuild the frames once, on release
 
         selectedCtrlPoint = hitID / 2;
         movingSelectedBase = ((hitID % 2) == 0); // base names are even; top names are odd
@@ -365,6 +431,8 @@ void World::mouseButtonCallback( GLFWwindow* window, int button, int action, int
       mouseClick( vec3( xpos, ypos, 0 ), keyModifiers );
 
     glfwSetCursorPosCallback( window, NULL );
+    if (dragging)
+      spline->holdFrames( false );
     dragging = false;
     arcballActive = false;
   }
@@ -394,7 +462,6 @@ void World::mouseMovementCallback( GLFWwindow* window, double xpos, double ypos
   getMouseRay( xpos, ypos, start, dir ); // sets 'start' and 'dir'
 
   vec3 updir = arcball->upDirection();
-  vec3 n     = (dir ^ updir).normalize();
 
   mat4 M = translate( -1*(int)(terrain->texture->width)/2, -1*(int)(terrain->texture->height)/2, 0 );
 
@@ -405,7 +472,7 @@ void World::mouseMovementCallback( GLFWwindow* window, double xpos, double ypos
     // Moving the base along the terrain
 
     vec3 intPoint;
-    bool found = terrain->findIntPoint( start, dir, n, intPoint, M );
+    bool found = terrain->findIntPoint( start, dir, intPoint, M );
 
     if (found)
       ctrlPoints->moveBase( selectedCtrlPoint, intPoint );
@@ -458,9 +525,6 @@ void World::mouseClick( vec3 mousePosition, int keyModifiers )
   vec3 start,dir;
   getMouseRay( mousePosition.x, mousePosition.y, start, dir ); // sets 'start' and 'dir'
 
-  vec3 updir = arcball->upDirection();
-  vec3 n     = (dir ^ updir).normalize();
-
   if (keyModifiers & GLFW_MOD_CONTROL) {
 
     // CTRL is held down.  Delete the control point under the mouse
@@ -476,7 +540,7 @@ void World::mouseClick( vec3 mousePosition, int keyModifiers )
 
     vec3 intPoint;
 
-    if (terrain->findIntPoint( start, dir, n, intPoint, M ))
+    if (terrain->findIntPoint( start, dir, intPoint, M ))
       ctrlPoints->addPoint( intPoint );
   }
 }
@@ -490,19 +554,94 @@ void World::mouseClick( vec3 mousePosition, int keyModifiers )
 
 void World::drawAllTrack( const mat4 &MV, const mat4 &MVP, vec3 lightDir )
 {
-    float totalLength = spline->totalArcLength();
+    ViewFrustum frustum(MVP);
+
+    if (useTrackMesh) {
+        if (trackMesh->update(spline))
+            trackRenderer->upload(*trackMesh);
+        frustum.cullBoxes(trackMesh->boxMins, trackMesh->boxMaxs, visibleTrack);
+        drawStats.objectsCulled += trackMesh->numSegments() - visibleTrack.size();
+        trackRenderer->draw(MV, MVP, lightDir, RAIL_COLOUR, TIE_COLOUR, visibleTrack);
+        return;
+    }
+
+    // rebuild the track pieces only when the spline has changed
+
+    if (spline->version() != trackVersion) {
+
+        trackVersion = spline->version();
+
+        float totalLength = spline->totalArcLength();
+        int nPieces = spline->data.size() * TRACK_PIECES_PER_SEG;
+
+        if (nPieces == 0) {
+            trackCubes->setInstances(NULL, NULL, 0);
+            trackBoxMins.resize(0);
+            trackBoxMaxs.resize(0);
+            return;
+        }
+
+        float ds = totalLength / (float) nPieces;
 
-    for (float s = 0; s < totalLength; s += totalLength / (float)(spline->data.size() * 20)) {
-        float t = spline->paramAtArcLength(s + 2); // s + 2 makes linear interpolation especially connect better
+        // look up all the track frames at once
 
-        // set modelling transform for the 3 pieces of track (both rails and wood)
-        mat4 M1 = spline->findLocalTransform(t) * translate(1.5, -1, 0) * scale(0.5, 0.75, totalLength / (float)(spline->data.size() * 20) + 0.5);
-        mat4 M2 = spline->findLocalTransform(t) * translate(-1.5, -1, 0) * scale(0.5, 0.75, totalLength / (float)(spline->data.size() * 20) + 0.5);
-        mat4 M3 = spline->findLocalTransform(t) * translate(0.0, -1.5, 0.0) * scale(4.0, 0.25, 1.0) * rotate(90 * M_PI / 180, vec3(1, 0, 0));
+        float *s = new float[nPieces];
+        mat4 *F = new mat4[nPieces];
 
-        // draw 3 pieces of track
-        cube->draw(MV * M1, MVP * M1, lightDir, vec3(135 / 255.0, 135 / 255.0, 135 / 255.0));
-        cube->draw(MV * M2, MVP * M2, lightDir, vec3(135 / 255.0, 135 / 255.0, 135 / 255.0));
-        cube->draw(MV * M3, MVP * M3, lightDir, vec3(164 / 255.0, 116 / 255.0, 73 / 255.0));
+        for (int i = 0; i < nPieces; i++)
+            s[i] = i * ds + 2; // + 2 makes linear interpolation especially connect better
+
+        spline->findLocalTransforms(s, nPieces, F);
+
+        // 3 pieces of track (both rails and wood) per frame
+
+        mat4 *M = new mat4[3 * nPieces];
+        vec3 *colours = new vec3[3 * nPieces];
+
+        mat4 rail1 = translate(1.5, -1, 0) * scale(0.5, 0.75, ds + 0.5);
+        mat4 rail2 = translate(-1.5, -1, 0) * scale(0.5, 0.75, ds + 0.5);
+        mat4 tie = translate(0.0, -1.5, 0.0) * scale(4.0, 0.25, 1.0) * rotate(90 * M_PI / 180, vec3(1, 0, 0));
+
+        for (int i = 0; i < nPieces; i++) {
+            M[3*i]   = F[i] * rail1;
+            M[3*i+1] = F[i] * rail2;
+            M[3*i+2] = F[i] * tie;
+            colours[3*i]   = RAIL_COLOUR;
+            colours[3*i+1] = RAIL_COLOUR;
+            colours[3*i+2] = TIE_COLOUR;
+        }
+
+        trackCubes->setInstances(M, colours, 3 * nPieces);
+
+        // bounding box of each group of pieces, from the frames'
+        // origins and the farthest a piece reaches from its origin
+
+        int nGroups = nPieces / TRACK_PIECES_PER_SEG;
+        float reach = vec3(2, 2, (ds + 0.5) / 2).length();
+
+        trackBoxMins.resize(nGroups);
+        trackBoxMaxs.resize(nGroups);
+
+        for (int g = 0; g < nGroups; g++) {
+            vec3 lo(MAXFLOAT, MAXFLOAT, MAXFLOAT);
+            vec3 hi(-MAXFLOAT, -MAXFLOAT, -MAXFLOAT);
+            for (int i = g * TRACK_PIECES_PER_SEG; i < (g+1) * TRACK_PIECES_PER_SEG; i++) {
+                vec3 o(F[i][0][3], F[i][1][3], F[i][2][3]);
+                lo = vec3(fmin(lo.x, o.x), fmin(lo.y, o.y), fmin(lo.z, o.z));
+                hi = vec3(fmax(hi.x, o.x), fmax(hi.y, o.y), fmax(hi.z, o.z));
+            }
+            trackBoxMins.set(g, lo - vec3(reach, reach, reach));
+            trackBoxMaxs.set(g, hi + vec3(reach, reach, reach));
+        }
+
+        delete[] s;
+        delete[] F;
+        delete[] M;
+        delete[] colours;
     }
+
+    frustum.cullBoxes(trackBoxMins, trackBoxMaxs, visibleTrack);
+    drawStats.objectsCulled += trackBoxMins.size() - visibleTrack.size();
+
+    trackCubes->draw(MV, MVP, lightDir, visibleTrack, 3 * TRACK_PIECES_PER_SEG);
 }
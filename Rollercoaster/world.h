@@ -8,21 +8,33 @@
 #include "spline.h"
 #include "train.h"
 #include "cubeMap.h"
+#include "instancedCubes.h"
+#include "trackMesh.h"
+#include "trackRenderer.h"
+#include "fixedStep.h"
 
 #define TRACK_PIECES_PER_SEG  20
 
+#define SIM_STEP       (1/120.0) // seconds per simulation step
+#define SIM_MAX_STEPS  8         // per frame, after which time is dropped
+
 #define POST_COLOUR vec3(0.8,0.9,0.5)
+#define RAIL_COLOUR vec3(135/255.0,135/255.0,135/255.0)
+#define TIE_COLOUR  vec3(164/255.0,116/255.0,73/255.0)
 
 
 class World {
 public:
-    World( GLFWwindow *w );
+    World( GLFWwindow *w );     // w is NULL when headless
 
     ~World() {
         delete terrain;
         delete spline;
         delete ctrlPoints;
         delete cubemap;
+        delete trackCubes;
+        delete trackMesh;
+        delete trackRenderer;
         delete train;
         delete arcball;
         delete gpu;
@@ -41,9 +53,26 @@ public:
 
     void drawAllTrack( const mat4 &MV, const mat4 &MVP, vec3 lightDir );
 
+    void addTestTrack( int numPoints );
+
+    // Step the simulation in fixed steps of SIM_STEP (see fixedStep.h),
+    // and place the train between its last two steps for drawing.
+    // Time passed while paused is dropped.
+
     void update( float elapsedSeconds ) {
-        if (ctrlPoints->count() > 1 && !pause)
-            train->advance( elapsedSeconds );
+        int n = sim.advance( elapsedSeconds );
+        if (ctrlPoints->count() > 1 && !pause) {
+            for (int i=0; i<n; i++)
+                train->advance( sim.step );
+            train->interpolate( sim.alpha() );
+        }
+    }
+
+    // 0 for no limit, so that every step of a long frame is taken (for
+    // batch runs)
+
+    void setMaxStepsPerFrame( int n ) {
+        sim.maxSteps = n;
     }
 
 private:
@@ -51,8 +80,15 @@ private:
     Spline     *spline;
     CtrlPoints *ctrlPoints;
     Train      *train;
+    FixedStep  sim;
     Arcball    *arcball;
     CubeMap    *cubemap;
+    InstancedCubes *trackCubes;
+    int        trackVersion; // spline version that trackCubes was built from
+    vec3SoA    trackBoxMins, trackBoxMaxs; // bounds of each group of TRACK_PIECES_PER_SEG pieces
+    seq<int>   visibleTrack; // groups (or mesh segments) that pass culling
+    TrackMesh  *trackMesh;
+    TrackRenderer *trackRenderer;
     GPUProgram *gpu;
 
     GLFWwindow *window;
@@ -64,6 +100,7 @@ private:
 
     bool       drawTrack;
     bool       drawCoaster;
+    bool       useTrackMesh; // swept mesh instead of cubes
     bool       useArcLength;
     bool       showAxes;
     bool       drawUndersideOnly;
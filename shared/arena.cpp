@@ -0,0 +1,88 @@
+// arena.cpp
+
+
+#include "arena.h"
+
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+
+// The block header is padded so that the first byte after it is
+// aligned for any fundamental type.
+
+static const size_t headerSize = (sizeof(void*) + 2*sizeof(size_t) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+
+Arena::Block *Arena::newBlock( size_t minSize )
+
+{
+  size_t size = (minSize > blockSize ? minSize : blockSize);
+
+  Block *b = (Block *) malloc( headerSize + size );
+  if (b == NULL)
+    throw std::bad_alloc();
+
+  b->next = blocks;
+  b->size = size;
+  b->used = 0;
+
+  blocks = b;
+
+  return b;
+}
+
+
+Arena::~Arena()
+
+{
+  while (blocks != NULL) {
+    Block *next = blocks->next;
+    free( blocks );
+    blocks = next;
+  }
+}
+
+
+void *Arena::alloc( size_t bytes, size_t align )
+
+{
+  Block *b = blocks;
+
+  if (b != NULL) {
+    uintptr_t base = (uintptr_t) b + headerSize;
+    uintptr_t p = (base + b->used + align - 1) & ~(uintptr_t) (align - 1);
+    if (p + bytes <= base + b->size) {
+      b->used = p + bytes - base;
+      return (void *) p;
+    }
+  }
+
+  // Doesn't fit: start a new block with room for any alignment padding
+
+  b = newBlock( bytes + align );
+
+  uintptr_t base = (uintptr_t) b + headerSize;
+  uintptr_t p = (base + align - 1) & ~(uintptr_t) (align - 1);
+  b->used = p + bytes - base;
+
+  return (void *) p;
+}
+
+
+void Arena::reset()
+
+{
+  if (blocks == NULL)
+    return;
+
+  // keep the oldest block (the one at the end of the list)
+
+  while (blocks->next != NULL) {
+    Block *next = blocks->next;
+    free( blocks );
+    blocks = next;
+  }
+
+  blocks->used = 0;
+}
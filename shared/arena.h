@@ -0,0 +1,52 @@
+// arena.h
+//
+// A bump allocator for short-lived bulk allocations.
+//
+// Memory is handed out from large blocks and is only returned when the
+// arena is reset or destroyed, so individual allocations are never
+// freed.  Anything allocated from an arena (such as a seq<T> created
+// with an Arena *) must not outlive it.
+//
+//   Arena arena;                    // default block size
+//   seq<vec3> verts( &arena );      // storage comes from 'arena'
+//   ...
+//   arena.reset();                  // all allocations are now invalid
+
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+
+
+class Arena {
+
+  struct Block {
+    Block  *next;
+    size_t  size;               // usable bytes after the header
+    size_t  used;
+  };
+
+  Block  *blocks;               // most recent block first
+  size_t  blockSize;
+
+  Block *newBlock( size_t minSize );
+
+ public:
+
+  Arena( size_t bytesPerBlock = 1 << 16 ) {
+    blocks = NULL;
+    blockSize = bytesPerBlock;
+  }
+
+  ~Arena();
+
+  Arena( const Arena & ) = delete;
+  Arena & operator = ( const Arena & ) = delete;
+
+  void *alloc( size_t bytes, size_t align );
+
+  void reset();                 // release everything but the first block
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "headers.h"
 #include "axes.h"
+#include "drawStats.h"
 
 
 Axes::Axes()
@@ -94,6 +95,7 @@ void Axes::draw( mat4 &MVP_transform )
 
   glBindVertexArray( VAO );
   glDrawArrays( GL_LINES, 0, 6 );
+  drawStats.drawCalls++;
 
 #ifndef __APPLE__
   glLineWidth( 1.0 );
@@ -3,6 +3,7 @@
 
 #include "headers.h"
 #include "axis.h"
+#include "drawStats.h"
 
 
 Axis::Axis(vec3 verts)
@@ -90,6 +91,7 @@ void Axis::draw( mat4 &MVP_transform )
 
   glBindVertexArray( VAO );
   glDrawArrays( GL_LINES, 0, 2 );
+  drawStats.drawCalls++;
 
 #ifndef __APPLE__
   glLineWidth( 1.0 );
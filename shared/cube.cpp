@@ -1,6 +1,7 @@
 // cube.cpp
 
 #include "cube.h"
+#include "drawStats.h"
 
 
 void Cube::setupVAO()
@@ -69,20 +70,33 @@ void Cube::draw(const mat4& MV, const mat4& MVP, vec3 lightDir, vec3 colour)
 {
     gpu.activate();
 
-    gpu.setMat4("MV", MV);
-    gpu.setMat4("MVP", MVP);
-    gpu.setVec3("colour", colour);
-    gpu.setVec3("lightDir", lightDir);
+    MVUniform.set(MV);
+    MVPUniform.set(MVP);
+    colourUniform.set(colour);
+    lightDirUniform.set(lightDir);
 
     // Draw using element array
 
     glBindVertexArray(VAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4 * 6); // used GL_TRIANGLE_STRIP so that only 4 verticies needed to be defined per face instead of 6 (GL_TRIANGLE_STRIP draws triangles using v0, v1, v2 and v2, v1, v3)
+    drawStats.drawCalls++;
     glBindVertexArray(0);
 
     gpu.deactivate();
 }
 
+void Cube::drawSoft(SoftRaster& raster, const mat4& MV, const mat4& MVP, vec3 lightDir, vec3 /* colour */)
+
+{
+    // The same strip as draw(), and white, as the fragment shader draws
+
+    seq<unsigned int> indices;
+    SoftRaster::stripIndices(0, verts.size(), indices);
+
+    raster.drawTriangles(&verts[0].x, NULL, NULL, 3, verts.size(),
+                         indices.array(), indices.size(), MV, MVP, lightDir, vec3(1, 1, 1), false);
+}
+
 const char* Cube::vertShader = R"(
 
   #version 330 es
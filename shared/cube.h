@@ -10,12 +10,16 @@
 #include "linalg.h"
 #include "seq.h"
 #include "gpuProgram.h"
+#include "softRaster.h"
 
 class Cube {
 
 public:
 
-    Cube() {
+    // With useGL false, no OpenGL calls are made and the cube can only
+    // be drawn with drawSoft().
+
+    Cube(bool useGL = true) {
 
         // Verticies
         // Top Face
@@ -91,8 +95,16 @@ public:
         normals.add(vec3(1, 0, 0));
         normals.add(vec3(1, 0, 0));
 
+        if (!useGL)
+            return;
+
         gpu.init(vertShader, fragShader, "in cube.cpp");
 
+        MVUniform       = gpu.uniform<mat4>("MV");
+        MVPUniform      = gpu.uniform<mat4>("MVP");
+        colourUniform   = gpu.uniform<vec3>("colour");
+        lightDirUniform = gpu.uniform<vec3>("lightDir");
+
         setupVAO();
     };
 
@@ -108,6 +120,10 @@ public:
 
     void draw(const mat4& MV, const mat4& MVP, vec3 lightDir, vec3 colour);
 
+    // The same, in software (see softRaster.h)
+
+    void drawSoft(SoftRaster& raster, const mat4& MV, const mat4& MVP, vec3 lightDir, vec3 colour);
+
 private:
 
     seq<vec3>         verts;
@@ -116,6 +132,9 @@ private:
 
     GPUProgram        gpu;
 
+    UniformHandle<mat4> MVUniform, MVPUniform;
+    UniformHandle<vec3> colourUniform, lightDirUniform;
+
     static const char* vertShader;
     static const char* fragShader;
 
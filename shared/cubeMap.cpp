@@ -3,6 +3,7 @@
 #ifndef STBI_INCLUDE_STB_IMAGE_H
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include "drawStats.h"
 #endif
 
 // above ensures the header is only included once to avoid errors
@@ -69,6 +70,7 @@ void CubeMap::draw(mat4& V, mat4& P)
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
     glDrawArrays(GL_TRIANGLES, 0, 6 * 6);
+    drawStats.drawCalls++;
     glBindVertexArray(0);
     glDepthFunc(GL_LESS);
 
@@ -0,0 +1,26 @@
+// drawStats.cpp
+
+
+#include "headers.h"
+#include "drawStats.h"
+
+
+DrawStats drawStats;
+
+
+// Print the counters of the last frame and the average and worst frame
+// times
+
+void DrawStats::print( std::ostream &out )
+
+{
+  out << "draw calls " << drawCalls << " (" << instances << " instances)" << endl
+      << "uniform calls " << uniformCalls << ", GL calls saved " << glCallsSaved << endl
+      << "GL objects created " << glObjectsCreated << ", bytes streamed " << streamedBytes
+      << ", buffer orphans " << bufferOrphans << endl
+      << "terrain triangles " << terrainTriangles << ", objects culled " << objectsCulled << endl;
+
+  if (frames > 0)
+    out << "frame time " << totalFrameMs / frames << " ms average, "
+        << maxFrameMs << " ms worst, over " << frames << " frames" << endl;
+}
@@ -0,0 +1,74 @@
+// drawStats.h
+//
+// Counters of GL work, for checking how well drawing is batched (for
+// example in a headless run, where there is nothing to look at).
+// Every draw function counts its glDraw* calls here, and GPUProgram
+// counts the glUniform* calls that it makes and the GL calls that its
+// uniform cache avoids.  Call drawStats.reset() at the start of each
+// frame.
+//
+// Frame times are accumulated separately, over many frames, with
+// frameDone() and cleared with resetTiming().
+
+
+#ifndef DRAWSTATS_H
+#define DRAWSTATS_H
+
+#include <iostream>
+
+
+class DrawStats {
+
+ public:
+
+  int drawCalls;                // glDraw* calls
+  int instances;                // instances drawn by instanced calls
+  int uniformCalls;             // glUniform* calls
+  int glCallsSaved;             // glGetUniformLocation and repeated glUniform* calls avoided
+  int glObjectsCreated;         // VAOs and buffers created
+  int streamedBytes;            // vertex data written to streaming buffers
+  int bufferOrphans;            // streaming buffers orphaned when full
+  int terrainTriangles;         // terrain triangles drawn, after level of detail
+  int objectsCulled;            // objects (or groups of them) skipped as outside the view
+
+  int    frames;                // frames timed since resetTiming()
+  double totalFrameMs;
+  double maxFrameMs;
+
+  DrawStats() {
+    reset();
+    resetTiming();
+  }
+
+  void reset() {
+    drawCalls = 0;
+    instances = 0;
+    uniformCalls = 0;
+    glCallsSaved = 0;
+    glObjectsCreated = 0;
+    streamedBytes = 0;
+    bufferOrphans = 0;
+    terrainTriangles = 0;
+    objectsCulled = 0;
+  }
+
+  void resetTiming() {
+    frames = 0;
+    totalFrameMs = 0;
+    maxFrameMs = 0;
+  }
+
+  void frameDone( double ms ) {
+    frames++;
+    totalFrameMs += ms;
+    if (ms > maxFrameMs)
+      maxFrameMs = ms;
+  }
+
+  void print( std::ostream &out );
+};
+
+
+extern DrawStats drawStats;
+
+#endif
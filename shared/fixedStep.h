@@ -0,0 +1,90 @@
+// fixedStep.h
+//
+// A fixed-timestep accumulator, so that a simulation advances the same
+// way at any frame rate and a run can be replayed exactly.
+//
+// Each frame's elapsed time is added to an accumulator, which is then
+// spent in steps of exactly 'step' seconds.  What is left over, as a
+// fraction of a step, is alpha(): the renderer draws the state that far
+// between the last two steps.  At most maxSteps are taken in a frame,
+// and the rest of the time is dropped, so that a slow frame doesn't
+// make the next one slower still.  maxSteps of 0 means no limit, for
+// batch runs that pass in long frames to simulate faster than real
+// time.
+//
+//    FixedStep sim( 1/120.0, 8 );
+//
+//    each frame:
+//      int n = sim.advance( elapsedSeconds );
+//      for (int i=0; i<n; i++)
+//        ... step the state by sim.step ...
+//      ... draw, interpolating by sim.alpha() ...
+
+
+#ifndef FIXED_STEP_H
+#define FIXED_STEP_H
+
+#include <cmath>
+
+
+class FixedStep {
+
+ public:
+
+  double step;                  // seconds per step
+  int    maxSteps;              // per frame, or 0 for no limit
+
+  long long totalSteps;         // since reset()
+  double    droppedSeconds;     // by the maxSteps guard, since reset()
+
+  FixedStep( double stepSeconds, int maxStepsPerFrame ) {
+    step = stepSeconds;
+    maxSteps = maxStepsPerFrame;
+    reset();
+  }
+
+  void reset() {
+    accumulator = 0;
+    totalSteps = 0;
+    droppedSeconds = 0;
+  }
+
+  // Add a frame's elapsed seconds and return the number of steps to take
+
+  int advance( double elapsedSeconds ) {
+
+    if (elapsedSeconds > 0)
+      accumulator += elapsedSeconds;
+
+    // A frame that is a whole number of steps long shouldn't come out
+    // a hair short of it
+
+    long long n = (long long) (accumulator / step + 1e-6);
+
+    if (maxSteps > 0 && n > maxSteps) {
+      droppedSeconds += (n - maxSteps) * step;
+      n = maxSteps;
+      accumulator = fmod( accumulator, step );
+    } else
+      accumulator -= n * step;
+
+    if (accumulator < 0)        // from rounding
+      accumulator = 0;
+
+    totalSteps += n;
+    return (int) n;
+  }
+
+  // How far the time is past the last step, in [0,1)
+
+  float alpha() {
+    float a = accumulator / step;
+    return (a < 1 ? a : 0.99999f);
+  }
+
+ private:
+
+  double accumulator;           // seconds not yet stepped
+};
+
+#endif
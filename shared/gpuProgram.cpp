@@ -93,30 +93,34 @@ void GPUProgram::init( const char *vsTextIn, const char *fsTextIn, const char* s
   char *vsText = strdup(vsTextIn);
   char *fsText = strdup(fsTextIn);
 
-#ifdef __APPLE__
-  // On MacOS, replace "#version 330 es" with "#version 330   " in each shader
+  // Desktop OpenGL (on MacOS, or in a headless context) doesn't take
+  // "#version 330 es", so replace it with "#version 330   " in each
+  // shader
 
-  char *p;
+  const char *version = (const char *) glGetString( GL_VERSION );
 
-  p = strstr( vsText, "#version 330 es" );
-  if (p == NULL) {
-    cerr << "No \"#version 330 es\" was found in vertex shader." << endl;
-    exit(1);
+  if (version != NULL && strncmp( version, "OpenGL ES", 9 ) != 0) {
 
-  }
-  p[12] = '\n';
-  p[13] = '\n';
-  p[14] = '\n';
+    char *p;
 
-  p = strstr( fsText, "#version 330 es" );
-  if (p == NULL) {
-    cerr << "No \"#version 330 es\" was found in fragment shader." << endl;
-    exit(1);
+    p = strstr( vsText, "#version 330 es" );
+    if (p == NULL) {
+      cerr << "No \"#version 330 es\" was found in vertex shader." << endl;
+      exit(1);
+    }
+    p[12] = '\n';
+    p[13] = '\n';
+    p[14] = '\n';
+
+    p = strstr( fsText, "#version 330 es" );
+    if (p == NULL) {
+      cerr << "No \"#version 330 es\" was found in fragment shader." << endl;
+      exit(1);
+    }
+    p[12] = '\n';
+    p[13] = '\n';
+    p[14] = '\n';
   }
-  p[12] = '\n';
-  p[13] = '\n';
-  p[14] = '\n';
-#endif
 
   glErrorReport( "before GPUProgram::init" );
 
@@ -156,6 +160,8 @@ void GPUProgram::init( const char *vsTextIn, const char *fsTextIn, const char* s
   glUseProgram( program_id );
   glUseProgram( 0 );
 
+  findUniforms();
+
   glErrorReport( "after GPUProgram::init" );
 
 #ifdef __APPLE__
@@ -165,6 +171,50 @@ void GPUProgram::init( const char *vsTextIn, const char *fsTextIn, const char* s
 }
 
 
+// Record the location and type of each active uniform.  Array
+// uniforms are listed by GL as "name[0]" and are recorded as "name".
+
+
+void GPUProgram::findUniforms()
+
+{
+  uniforms.clear();
+
+  GLint count;
+  glGetProgramiv( program_id, GL_ACTIVE_UNIFORMS, &count );
+
+  for (int i=0; i<count; i++) {
+
+    Uniform u;
+    GLint size;
+    GLsizei length;
+
+    glGetActiveUniform( program_id, i, MAX_UNIFORM_NAME, &length, &size, &u.type, u.name );
+
+    char *bracket = strchr( u.name, '[' );
+    if (bracket != NULL)
+      *bracket = '\0';
+
+    u.location = glGetUniformLocation( program_id, u.name );
+    u.known = false;
+
+    if (u.location >= 0)        // (uniforms in blocks have no location)
+      uniforms.add( u );
+  }
+}
+
+
+int GPUProgram::uniformIndex( const char *name )
+
+{
+  for (int i=0; i<uniforms.size(); i++)
+    if (strcmp( uniforms[i].name, name ) == 0)
+      return i;
+
+  return -1;
+}
+
+
 void GPUProgram::initFromFile( const char *vsFile, const char *fsFile, const char* shaderName )
 {
   char* vsText = textFileRead(vsFile);
@@ -5,6 +5,39 @@
 
 
 #include "headers.h"
+#include "seq.h"
+#include "drawStats.h"
+
+
+#define MAX_UNIFORM_NAME 64
+
+
+class GPUProgram;
+
+
+// A handle to a uniform of type T (mat4, vec2, vec3, vec4, float or
+// int) in a GPUProgram, from GPUProgram::uniform<T>( name ).  Setting
+// it needs no name lookup.
+
+template<class T> class UniformHandle {
+
+  GPUProgram *program;
+  int index;
+
+ public:
+
+  UniformHandle() {
+    program = NULL;
+    index = -1;
+  }
+
+  UniformHandle( GPUProgram *p, int i ) {
+    program = p;
+    index = i;
+  }
+
+  void set( const T &v );
+};
 
 
 class GPUProgram {
@@ -13,6 +46,57 @@ class GPUProgram {
   unsigned int shader_vp;
   unsigned int shader_fp;
 
+  // Active uniforms, found when the program is linked.  Each keeps the
+  // last value sent, so that sending the same value again is skipped.
+  // (Uniforms are per program, so this stays correct as long as they
+  // are only set through this class.)
+
+  struct Uniform {
+    char   name[MAX_UNIFORM_NAME];
+    GLint  location;
+    GLenum type;
+    bool   known;               // whether 'value' holds what GL has
+    float  value[16];
+  };
+
+  seq<Uniform> uniforms;
+
+  void findUniforms();
+
+  // Whether 'size' bytes at 'v' must be sent to uniform 'index', i.e.
+  // GL does not already have them.  Every call saves the
+  // glGetUniformLocation that a plain glUniform* call would need, and
+  // also the glUniform* itself if the result is false.
+
+  bool mustSend( int index, const void *v, int size ) {
+
+    drawStats.glCallsSaved++;
+
+    if (index < 0) {
+      drawStats.glCallsSaved++;
+      return false;
+    }
+
+    Uniform &u = uniforms[index];
+
+    if (u.known && memcmp( u.value, v, size ) == 0) {
+      drawStats.glCallsSaved++;
+      return false;
+    }
+
+    memcpy( u.value, v, size );
+    u.known = true;
+    drawStats.uniformCalls++;
+    return true;
+  }
+
+  static GLenum glType( const mat4 * ) { return GL_FLOAT_MAT4; }
+  static GLenum glType( const vec2 * ) { return GL_FLOAT_VEC2; }
+  static GLenum glType( const vec3 * ) { return GL_FLOAT_VEC3; }
+  static GLenum glType( const vec4 * ) { return GL_FLOAT_VEC4; }
+  static GLenum glType( const float * ) { return GL_FLOAT; }
+  static GLenum glType( const int * ) { return GL_INT; }
+
  public:
 
   GPUProgram() {};
@@ -47,28 +131,71 @@ class GPUProgram {
 
   char* textFileRead(const char *fileName);
 
+  // Index of the named uniform, or -1 if the program has no such
+  // active uniform (in which case setting it does nothing, as in GL)
+
+  int uniformIndex( const char *name );
+
+  template<class T> UniformHandle<T> uniform( const char *name );
+
+  // Set a uniform by index.  The program should be active.
+
+  void set( int index, const mat4 &M ) {
+    if (mustSend( index, &M[0][0], 16*sizeof(float) ))
+      glUniformMatrix4fv( uniforms[index].location, 1, GL_TRUE, &M[0][0] );
+  }
+
+  void set( int index, const vec2 &v ) {
+    if (mustSend( index, &v.x, 2*sizeof(float) ))
+      glUniform2fv( uniforms[index].location, 1, &v.x );
+  }
+
+  void set( int index, const vec3 &v ) {
+    if (mustSend( index, &v.x, 3*sizeof(float) ))
+      glUniform3fv( uniforms[index].location, 1, &v.x );
+  }
+
+  void set( int index, const vec4 &v ) {
+    if (mustSend( index, &v.x, 4*sizeof(float) ))
+      glUniform4fv( uniforms[index].location, 1, &v.x );
+  }
+
+  void set( int index, const float &f ) {
+    if (mustSend( index, &f, sizeof(float) ))
+      glUniform1f( uniforms[index].location, f );
+  }
+
+  void set( int index, const int &i ) {
+    if (mustSend( index, &i, sizeof(int) ))
+      glUniform1i( uniforms[index].location, i );
+  }
+
+  // Set a uniform by name.  The name is looked up in the table above
+  // rather than with glGetUniformLocation, but a handle (see uniform())
+  // avoids even that.
+
   void setMat4( const char *name, const mat4 &M ) {
-    glUniformMatrix4fv( glGetUniformLocation( program_id, name ), 1, GL_TRUE, &M[0][0] );
+    set( uniformIndex( name ), M );
   }
 
   void setVec3( const char *name, vec3 v ) {
-    glUniform3fv( glGetUniformLocation( program_id, name ), 1, &v[0] );
+    set( uniformIndex( name ), v );
   }
 
   void setVec2( const char *name, vec2 v ) {
-    glUniform2fv( glGetUniformLocation( program_id, name ), 1, &v[0] );
+    set( uniformIndex( name ), v );
   }
 
   void setVec4( const char *name, vec4 v ) {
-    glUniform4fv( glGetUniformLocation( program_id, name ), 1, &v[0] );
+    set( uniformIndex( name ), v );
   }
 
   void setFloat( const char *name, float f ) {
-    glUniform1f( glGetUniformLocation( program_id, name ), f );
+    set( uniformIndex( name ), f );
   }
 
   void setInt( const char *name, int i ) {
-    glUniform1i( glGetUniformLocation( program_id, name ), i );
+    set( uniformIndex( name ), i );
   }
 
   void glErrorReport( const char *where ) {
@@ -90,4 +217,36 @@ class GPUProgram {
   void validateProgram( const char* shaderName );
 };
 
+
+// A handle for the named uniform.  Exits if the uniform exists with a
+// type other than T.  Samplers and bools are set as ints.
+
+template<class T>
+UniformHandle<T> GPUProgram::uniform( const char *name )
+
+{
+  int index = uniformIndex( name );
+
+  if (index >= 0) {
+    GLenum type = uniforms[index].type;
+    GLenum want = glType( (const T *) NULL );
+    bool isSampler = (type == GL_SAMPLER_2D || type == GL_SAMPLER_CUBE || type == GL_SAMPLER_3D);
+    if (type != want && !(want == GL_INT && (isSampler || type == GL_BOOL))) {
+      cerr << "Uniform '" << name << "' has GL type " << type << " but was requested as type " << want << endl;
+      exit(1);
+    }
+  }
+
+  return UniformHandle<T>( this, index );
+}
+
+
+template<class T>
+void UniformHandle<T>::set( const T &v )
+
+{
+  if (program != NULL)
+    program->set( index, v );
+}
+
 #endif
@@ -0,0 +1,276 @@
+// headless.cpp
+
+
+#include "headless.h"
+#include "lodepng.h"
+
+#ifdef HEADLESS
+  #include <EGL/egl.h>
+  #include <EGL/eglext.h>
+#endif
+
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+
+static double nowMs()
+
+{
+  return std::chrono::duration<double,std::milli>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+static void usage( const char *program )
+
+{
+  cerr << "Usage: " << program << " [--headless [--size WxH] [--frames N] [--step seconds] [--png prefix]]" << endl;
+  exit(1);
+}
+
+
+bool Headless::parseArgs( int argc, char **argv )
+
+{
+  bool headless = false;
+
+  for (int i=1; i<argc; i++) {
+
+    bool hasValue = (i+1 < argc);
+
+    if (strcmp( argv[i], "--headless" ) == 0)
+      headless = true;
+
+    else if (strcmp( argv[i], "--size" ) == 0 && hasValue) {
+      if (sscanf( argv[++i], "%dx%d", &width, &height ) != 2 || width < 1 || height < 1)
+        usage( argv[0] );
+    }
+
+    else if (strcmp( argv[i], "--frames" ) == 0 && hasValue) {
+      numFrames = atoi( argv[++i] );
+      if (numFrames < 1)
+        usage( argv[0] );
+    }
+
+    else if (strcmp( argv[i], "--step" ) == 0 && hasValue)
+      timeStep = atof( argv[++i] );
+
+    else if (strcmp( argv[i], "--png" ) == 0 && hasValue)
+      pngPrefix = argv[++i];
+
+    else
+      usage( argv[0] );
+  }
+
+  return headless;
+}
+
+
+#ifdef HEADLESS
+
+
+void Headless::init()
+
+{
+  // Mesa's surfaceless platform needs no display server.  Otherwise
+  // try the default display.
+
+  EGLDisplay dpy = EGL_NO_DISPLAY;
+
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+  if (getPlatformDisplay != NULL)
+    dpy = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL );
+#endif
+
+  if (dpy == EGL_NO_DISPLAY)
+    dpy = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+  EGLint major, minor;
+
+  if (dpy == EGL_NO_DISPLAY || !eglInitialize( dpy, &major, &minor )) {
+    cerr << "Headless: no EGL display" << endl;
+    exit(1);
+  }
+
+  display = dpy;
+
+  // OpenGL 3.3 core, as on MacOS, or else OpenGL ES 3, as the windowed
+  // build asks for elsewhere
+
+  EGLint glAttribs[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+                         EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+  EGLint esAttribs[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_NONE };
+
+  EGLenum apis[2]         = { EGL_OPENGL_API, EGL_OPENGL_ES_API };
+  EGLint  renderables[2]  = { EGL_OPENGL_BIT, EGL_OPENGL_ES3_BIT };
+  EGLint *contextAttribs[2] = { glAttribs, esAttribs };
+
+  EGLContext ctx = EGL_NO_CONTEXT;
+
+  for (int i=0; i<2 && ctx == EGL_NO_CONTEXT; i++) {
+
+    EGLint configAttribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, renderables[i], EGL_NONE };
+
+    EGLConfig config;
+    EGLint numConfigs;
+
+    if (!eglBindAPI( apis[i] ) ||
+        !eglChooseConfig( dpy, configAttribs, &config, 1, &numConfigs ) || numConfigs < 1)
+      continue;
+
+    ctx = eglCreateContext( dpy, config, EGL_NO_CONTEXT, contextAttribs[i] );
+  }
+
+  // No surface is needed, since everything is drawn to the framebuffer
+  // object
+
+  if (ctx == EGL_NO_CONTEXT || !eglMakeCurrent( dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx )) {
+    cerr << "Headless: could not make an OpenGL 3.3 or OpenGL ES 3 context" << endl;
+    exit(1);
+  }
+
+  context = ctx;
+
+  gladLoadGLLoader( (GLADloadproc) eglGetProcAddress );
+
+  // The framebuffer
+
+  glGenFramebuffers( 1, &fbo );
+  glBindFramebuffer( GL_FRAMEBUFFER, fbo );
+
+  glGenRenderbuffers( 1, &colourBuffer );
+  glBindRenderbuffer( GL_RENDERBUFFER, colourBuffer );
+  glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width, height );
+  glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colourBuffer );
+
+  glGenRenderbuffers( 1, &depthBuffer );
+  glBindRenderbuffer( GL_RENDERBUFFER, depthBuffer );
+  glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height );
+  glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer );
+
+  if (glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE) {
+    cerr << "Headless: could not make a " << width << "x" << height << " framebuffer" << endl;
+    exit(1);
+  }
+
+  glViewport( 0, 0, width, height );
+
+  cout << "Headless: " << glGetString( GL_RENDERER ) << ", " << glGetString( GL_VERSION )
+       << ", " << width << "x" << height << endl;
+}
+
+
+Headless::~Headless()
+
+{
+  if (context == NULL)
+    return;
+
+  glDeleteRenderbuffers( 1, &colourBuffer );
+  glDeleteRenderbuffers( 1, &depthBuffer );
+  glDeleteFramebuffers( 1, &fbo );
+
+  eglMakeCurrent( (EGLDisplay) display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+  eglDestroyContext( (EGLDisplay) display, (EGLContext) context );
+  eglTerminate( (EGLDisplay) display );
+}
+
+
+#else
+
+
+void Headless::init()
+
+{
+  cerr << "Headless mode was not built.  Rebuild with 'make HEADLESS=1', which needs libEGL." << endl;
+  exit(1);
+}
+
+
+Headless::~Headless()
+
+{
+}
+
+
+#endif
+
+
+// Frame timings are printed one line per frame, then summarized
+
+
+void Headless::replay( const std::function<void(float)> &update, const std::function<void()> &draw )
+
+{
+  std::vector<double> updateMs( numFrames ), drawMs( numFrames );
+
+  printf( "%6s %10s %10s\n", "frame", "update ms", "draw ms" );
+
+  for (int f=0; f<numFrames; f++) {
+
+    double t0 = nowMs();
+    update( timeStep );
+
+    double t1 = nowMs();
+    draw();
+    glFinish();                 // so that the GPU's work is timed, too
+
+    double t2 = nowMs();
+
+    updateMs[f] = t1 - t0;
+    drawMs[f]   = t2 - t1;
+
+    printf( "%6d %10.3f %10.3f\n", f, updateMs[f], drawMs[f] );
+
+    if (pngPrefix != NULL) {
+      char filename[1000];
+      snprintf( filename, sizeof(filename), "%s%04d.png", pngPrefix, f );
+      writePNG( filename );
+    }
+  }
+
+  // Mean, median, 95th percentile and maximum
+
+  const char *names[2] = { "update", "draw" };
+  std::vector<double> *times[2] = { &updateMs, &drawMs };
+
+  printf( "\n%d frames of %g s at %dx%d\n", numFrames, timeStep, width, height );
+
+  for (int k=0; k<2; k++) {
+
+    std::vector<double> sorted = *times[k];
+    std::sort( sorted.begin(), sorted.end() );
+
+    double sum = 0;
+    for (unsigned int i=0; i<sorted.size(); i++)
+      sum += sorted[i];
+
+    printf( "%-7s mean %.3f ms, median %.3f ms, 95%% %.3f ms, max %.3f ms\n", names[k],
+            sum / numFrames, sorted[ numFrames/2 ], sorted[ (int) (0.95 * (numFrames-1)) ], sorted[ numFrames-1 ] );
+  }
+}
+
+
+void Headless::writePNG( const char *filename )
+
+{
+  std::vector<unsigned char> pixels( width * height * 4 ), image( width * height * 4 );
+
+  glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+  glReadPixels( 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data() );
+
+  // GL's rows go bottom to top, and PNG's top to bottom
+
+  for (int y=0; y<height; y++)
+    memcpy( &image[ y*width*4 ], &pixels[ (height-1-y)*width*4 ], width*4 );
+
+  // The alpha that the scene leaves behind isn't meant to be seen
+
+  for (int i=3; i<width*height*4; i+=4)
+    image[i] = 255;
+
+  unsigned error = lodepng::encode( filename, image, width, height );
+  if (error)
+    cerr << "Error writing '" << filename << "': " << lodepng_error_text(error) << endl;
+}
@@ -0,0 +1,84 @@
+// headless.h
+//
+// Rendering without a window, for regression and performance runs on
+// machines with no display or GPU (such as Mesa's llvmpipe).
+//
+// An EGL context is made without a surface, and everything is drawn
+// into a framebuffer object of the requested size.  replay() then runs
+// a fixed number of frames with a fixed time step, so that runs are
+// repeatable, prints the time of each frame's update and draw, and can
+// write each frame to a PNG file.
+//
+//    Headless headless;
+//
+//    if (headless.parseArgs( argc, argv )) {
+//      headless.init();
+//      ... set up the scene ...
+//      headless.replay( [&]( float dt ) { ... }, [&]() { ... } );
+//    }
+//
+// The options are
+//
+//    --headless  [--size WxH]  [--frames N]  [--step seconds]  [--png prefix]
+//
+// with PNG frames written to prefix0000.png, prefix0001.png, ...
+//
+// EGL is needed, so this is only built with 'make HEADLESS=1', which
+// defines HEADLESS and links libEGL.  Otherwise --headless reports
+// that and exits.
+
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "headers.h"
+
+#include <functional>
+
+
+class Headless {
+
+ public:
+
+  int   width, height;          // of the framebuffer
+  int   numFrames;
+  float timeStep;               // seconds passed to the update of each frame
+  const char *pngPrefix;        // NULL for no PNG frames
+
+  Headless() {
+    width = 800;
+    height = 600;
+    numFrames = 300;
+    timeStep = 1/60.0;
+    pngPrefix = NULL;
+    display = NULL;
+    context = NULL;
+    fbo = colourBuffer = depthBuffer = 0;
+  }
+
+  ~Headless();
+
+  // Returns true if --headless was given.  Exits on a bad option.
+
+  bool parseArgs( int argc, char **argv );
+
+  // Make the GL context current, with the framebuffer bound and the
+  // viewport covering it.  Exits on failure.
+
+  void init();
+
+  // Run numFrames frames, each of update( timeStep ) then draw(), and
+  // print their timings to cout
+
+  void replay( const std::function<void(float)> &update, const std::function<void()> &draw );
+
+  void writePNG( const char *filename );
+
+ private:
+
+  void  *display;               // EGLDisplay and EGLContext
+  void  *context;
+  GLuint fbo, colourBuffer, depthBuffer;
+};
+
+#endif
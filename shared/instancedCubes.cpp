@@ -0,0 +1,299 @@
+// instancedCubes.cpp
+
+
+#include "instancedCubes.h"
+#include "drawStats.h"
+
+
+// The instance buffer holds the transforms of all the instances, each
+// a mat4 as four columns, and then their colours, so that the
+// transforms can be uploaded on their own
+
+#define FLOATS_PER_TRANSFORM 16
+#define FLOATS_PER_COLOUR    3
+
+
+// Each face of the cube as its normal and the two in-face axes, so
+// that the corners are normal/2 +- u/2 +- v/2.
+
+static const float faceAxes[6][3][3] = {
+  { {  0, 1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } }, // top
+  { {  0,-1, 0 }, { 1, 0, 0 }, { 0, 0,  1 } }, // bottom
+  { {  0, 0, 1 }, { 1, 0, 0 }, { 0, 1,  0 } }, // front
+  { {  0, 0,-1 }, {-1, 0, 0 }, { 0, 1,  0 } }, // back
+  { { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1,  0 } }, // left
+  { {  1, 0, 0 }, { 0, 0,-1 }, { 0, 1,  0 } }  // right
+};
+
+
+void InstancedCubes::setupVAO()
+
+{
+  // Two counterclockwise triangles per face, with interleaved
+  // position and normal
+
+  nVerts = 6 * 6;
+
+  GLfloat *vertexBuffer = new GLfloat[ nVerts * 6 ];
+
+  static const float corner[6][2] = { {-1,-1}, {1,-1}, {1,1}, {-1,-1}, {1,1}, {-1,1} };
+
+  int k = 0;
+  for (int f=0; f<6; f++) {
+
+    vec3 n( faceAxes[f][0][0], faceAxes[f][0][1], faceAxes[f][0][2] );
+    vec3 u( faceAxes[f][1][0], faceAxes[f][1][1], faceAxes[f][1][2] );
+    vec3 v( faceAxes[f][2][0], faceAxes[f][2][1], faceAxes[f][2][2] );
+
+    for (int c=0; c<6; c++) {
+      vec3 p = 0.5 * (n + corner[c][0] * u + corner[c][1] * v);
+      vertexBuffer[k++] = p.x;
+      vertexBuffer[k++] = p.y;
+      vertexBuffer[k++] = p.z;
+      vertexBuffer[k++] = n.x;
+      vertexBuffer[k++] = n.y;
+      vertexBuffer[k++] = n.z;
+    }
+  }
+
+  // Create a VAO
+
+  glGenVertexArrays( 1, &VAO );
+  glBindVertexArray( VAO );
+
+  // attribute 0 = position, attribute 1 = normal
+
+  glGenBuffers( 1, &vertexBufferID );
+  glBindBuffer( GL_ARRAY_BUFFER, vertexBufferID );
+  glBufferData( GL_ARRAY_BUFFER, nVerts * 6 * sizeof(GLfloat), vertexBuffer, GL_STATIC_DRAW );
+
+  glEnableVertexAttribArray( 0 );
+  glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void *) 0 );
+
+  glEnableVertexAttribArray( 1 );
+  glVertexAttribPointer( 1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void *) (3 * sizeof(GLfloat)) );
+
+  // attributes 2-5 = columns of the instance transform, attribute 6 =
+  // instance colour, all advancing once per instance
+
+  glGenBuffers( 1, &instanceBufferID );
+  glBindBuffer( GL_ARRAY_BUFFER, instanceBufferID );
+
+  for (int i=0; i<5; i++) {
+    glEnableVertexAttribArray( 2+i );
+    glVertexAttribDivisor( 2+i, 1 );
+  }
+
+  nInstances = 0;
+  instanceCapacity = 0;
+
+  setInstanceAttribs( 0 );
+
+  glBindVertexArray( 0 );
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+  delete[] vertexBuffer;
+}
+
+
+// Point the instance attributes at instance 'first' and on.  The VAO
+// and the instance buffer must be bound.
+
+
+void InstancedCubes::setInstanceAttribs( int first )
+
+{
+  GLsizei  MStride = FLOATS_PER_TRANSFORM * sizeof(GLfloat);
+  GLintptr MBase   = (GLintptr) first * MStride;
+
+  for (int i=0; i<4; i++)
+    glVertexAttribPointer( 2+i, 4, GL_FLOAT, GL_FALSE, MStride, (void *) (MBase + 4*i * sizeof(GLfloat)) );
+
+  GLsizei  colourStride = FLOATS_PER_COLOUR * sizeof(GLfloat);
+  GLintptr colourBase   = (GLintptr) instanceCapacity * MStride + (GLintptr) first * colourStride;
+
+  glVertexAttribPointer( 6, 3, GL_FLOAT, GL_FALSE, colourStride, (void *) colourBase );
+}
+
+
+// Upload the transforms of instances [0,n) to the instance buffer,
+// which must be bound.  mat4 is row-major and GLSL is column-major, so
+// the columns are stored.
+
+
+void InstancedCubes::uploadTransforms( const mat4 *M, int n )
+
+{
+  GLfloat *buffer = new GLfloat[ n * FLOATS_PER_TRANSFORM ];
+
+  GLfloat *p = buffer;
+  for (int i=0; i<n; i++)
+    for (int c=0; c<4; c++)
+      for (int r=0; r<4; r++)
+        *p++ = M[i][r][c];
+
+  glBufferSubData( GL_ARRAY_BUFFER, 0, n * FLOATS_PER_TRANSFORM * sizeof(GLfloat), buffer );
+
+  delete[] buffer;
+}
+
+
+void InstancedCubes::setInstances( const mat4 *M, const vec3 *colours, int n )
+
+{
+  glBindBuffer( GL_ARRAY_BUFFER, instanceBufferID );
+
+  // Reuse the buffer if the instances fit.  Otherwise make it bigger,
+  // which moves the colours, so point the colour attribute at them.
+
+  if (n > instanceCapacity) {
+
+    instanceCapacity = n;
+    glBufferData( GL_ARRAY_BUFFER, n * (FLOATS_PER_TRANSFORM + FLOATS_PER_COLOUR) * sizeof(GLfloat), NULL, GL_STATIC_DRAW );
+
+    glBindVertexArray( VAO );
+    setInstanceAttribs( 0 );
+    glBindVertexArray( 0 );
+  }
+
+  if (n > 0) {
+    uploadTransforms( M, n );
+    glBufferSubData( GL_ARRAY_BUFFER, instanceCapacity * FLOATS_PER_TRANSFORM * sizeof(GLfloat),
+                     n * FLOATS_PER_COLOUR * sizeof(GLfloat), &colours[0].x );
+  }
+
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+  nInstances = n;
+}
+
+
+void InstancedCubes::setTransforms( const mat4 *M, int n )
+
+{
+  if (n > nInstances)
+    n = nInstances;
+
+  if (n <= 0)
+    return;
+
+  glBindBuffer( GL_ARRAY_BUFFER, instanceBufferID );
+  uploadTransforms( M, n );
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+
+void InstancedCubes::draw( const mat4 &MV, const mat4 &MVP, vec3 lightDir )
+
+{
+  if (nInstances == 0)
+    return;
+
+  gpu.activate();
+
+  MVUniform.set( MV );
+  MVPUniform.set( MVP );
+  lightDirUniform.set( lightDir );
+
+  glBindVertexArray( VAO );
+  glDrawArraysInstanced( GL_TRIANGLES, 0, nVerts, nInstances );
+  glBindVertexArray( 0 );
+
+  drawStats.drawCalls++;
+  drawStats.instances += nInstances;
+
+  gpu.deactivate();
+}
+
+
+void InstancedCubes::draw( const mat4 &MV, const mat4 &MVP, vec3 lightDir, const seq<int> &groups, int groupSize )
+
+{
+  if (nInstances == 0 || groups.size() == 0)
+    return;
+
+  gpu.activate();
+
+  MVUniform.set( MV );
+  MVPUniform.set( MVP );
+  lightDirUniform.set( lightDir );
+
+  glBindVertexArray( VAO );
+  glBindBuffer( GL_ARRAY_BUFFER, instanceBufferID );
+
+  int i = 0;
+
+  while (i < groups.size()) {
+
+    int j = i+1;
+    while (j < groups.size() && groups[j] == groups[j-1]+1)
+      j++;
+
+    int first = groups[i] * groupSize;
+    int count = (j-i) * groupSize;
+
+    if (first + count > nInstances)
+      count = nInstances - first;
+
+    setInstanceAttribs( first );
+    glDrawArraysInstanced( GL_TRIANGLES, 0, nVerts, count );
+
+    drawStats.drawCalls++;
+    drawStats.instances += count;
+
+    i = j;
+  }
+
+  setInstanceAttribs( 0 );
+
+  glBindVertexArray( 0 );
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+  gpu.deactivate();
+}
+
+
+const char *InstancedCubes::vertShader = R"(
+
+  #version 330 es
+
+  uniform mat4 MVP;
+  uniform mat4 MV;
+
+  layout (location = 0) in mediump vec3 vertPosition;
+  layout (location = 1) in mediump vec3 vertNormal;
+  layout (location = 2) in mediump mat4 instanceM;
+  layout (location = 6) in mediump vec3 instanceColour;
+
+  smooth out mediump vec3 normal;
+  flat out mediump vec3 colour;
+
+  void main() {
+
+    gl_Position = MVP * instanceM * vec4( vertPosition, 1.0 );
+    normal = vec3( MV * instanceM * vec4( vertNormal, 0.0 ) );
+    colour = instanceColour;
+  }
+)";
+
+
+const char *InstancedCubes::fragShader = R"(
+
+  #version 330 es
+
+  uniform mediump vec3 lightDir;
+
+  smooth in mediump vec3 normal;
+  flat in mediump vec3 colour;
+  out mediump vec4 outputColour;
+
+  void main() {
+
+    mediump float NdotL = dot( normalize(normal), lightDir );
+
+    if (NdotL < 0.0)
+      NdotL = 0.1; // some ambient
+
+    outputColour = vec4( NdotL * colour, 1.0 );
+  }
+)";
@@ -0,0 +1,90 @@
+// instancedCubes.h
+//
+// Many unit cubes (side 1, centred at the origin), each with its own
+// OCS-to-WCS transform and colour, drawn with a single instanced draw
+// call.
+//
+// The instances are uploaded by setInstances() and stay on the GPU
+// until the next upload, so callers should upload only when the
+// instances change.  An upload of no more instances than the largest
+// so far reuses the GPU buffer.  Instances that only move, keeping
+// their number and colours, need only setTransforms().
+
+
+#ifndef INSTANCED_CUBES_H
+#define INSTANCED_CUBES_H
+
+
+#include "linalg.h"
+#include "gpuProgram.h"
+#include "seq.h"
+
+
+class InstancedCubes {
+
+ public:
+
+  InstancedCubes() {
+    gpu.init( vertShader, fragShader, "in instancedCubes.cpp" );
+
+    MVUniform       = gpu.uniform<mat4>( "MV" );
+    MVPUniform      = gpu.uniform<mat4>( "MVP" );
+    lightDirUniform = gpu.uniform<vec3>( "lightDir" );
+
+    setupVAO();
+  }
+
+  ~InstancedCubes() {
+    glDeleteBuffers( 1, &vertexBufferID );
+    glDeleteBuffers( 1, &instanceBufferID );
+    glDeleteVertexArrays( 1, &VAO );
+  }
+
+  // Upload n instances with transforms M[i] and colours colours[i]
+
+  void setInstances( const mat4 *M, const vec3 *colours, int n );
+
+  // Replace the transforms of instances [0,n), keeping their colours.
+  // n must be at most count().
+
+  void setTransforms( const mat4 *M, int n );
+
+  // Draw all instances.  MV and MVP are applied after each instance's
+  // own transform.
+
+  void draw( const mat4 &MV, const mat4 &MVP, vec3 lightDir );
+
+  // Draw only the listed groups of instances, where group g is
+  // instances [g*groupSize, (g+1)*groupSize).  The groups must be in
+  // increasing order.  Each run of consecutive groups takes one draw
+  // call.
+
+  void draw( const mat4 &MV, const mat4 &MVP, vec3 lightDir, const seq<int> &groups, int groupSize );
+
+  int count() {
+    return nInstances;
+  }
+
+ private:
+
+  GLuint     VAO;
+  GLuint     vertexBufferID;
+  GLuint     instanceBufferID;
+  int        nVerts;
+  int        nInstances;
+  int        instanceCapacity;  // of instanceBufferID
+
+  GPUProgram gpu;
+
+  UniformHandle<mat4> MVUniform, MVPUniform;
+  UniformHandle<vec3> lightDirUniform;
+
+  static const char *vertShader;
+  static const char *fragShader;
+
+  void setupVAO();
+  void setInstanceAttribs( int first );
+  void uploadTransforms( const mat4 *M, int n );
+};
+
+#endif
@@ -2,6 +2,7 @@
 
 
 #include "linalg.h"
+#include "simd.h"
 
 
 // ---------------- vec2 ----------------
@@ -327,9 +328,20 @@ mat4 operator * ( float k, mat4 const& m )
   return out;
 }
 
+// Matrix/vector product.
+//
+// Each row is multiplied by v, then the four product vectors are
+// transposed and summed so that lane i holds row i's dot product.
+// The additions happen in the same order as vec4::operator*, so the
+// result matches the scalar code exactly.
+
 vec4 operator * ( mat4 const& m, vec4 const& v )
 
 {
+#ifdef LINALG_SCALAR
+
+  // the transpose costs more than it saves without SIMD registers
+
   vec4 out;
 
   out[0] = m.rows[0] * v;
@@ -338,23 +350,50 @@ vec4 operator * ( mat4 const& m, vec4 const& v )
   out[3] = m.rows[3] * v;
 
   return out;
+
+#else
+
+  f4 vv = f4load( &v.x );
+
+  f4 p0 = f4mul( f4load( &m.rows[0].x ), vv );
+  f4 p1 = f4mul( f4load( &m.rows[1].x ), vv );
+  f4 p2 = f4mul( f4load( &m.rows[2].x ), vv );
+  f4 p3 = f4mul( f4load( &m.rows[3].x ), vv );
+
+  f4transpose( p0, p1, p2, p3 );
+
+  vec4 out;
+  f4store( &out.x, f4add( f4add( f4add( p0, p1 ), p2 ), p3 ) );
+
+  return out;
+
+#endif
 }
 
-mat4 operator * ( mat4 const& m, mat4 const& n )
 
-{
-  mat4 out;
+// Matrix/matrix product.
+//
+// Row i of the result is sum_k m[i][k] * (row k of n), accumulated in
+// k order to match the original triple loop.
 
-  for (int i=0; i<4; i++)
-    for (int j=0; j<4; j++) {
+mat4 operator * ( mat4 const& m, mat4 const& n )
 
-      float sum=0;
+{
+  f4 n0 = f4load( &n.rows[0].x );
+  f4 n1 = f4load( &n.rows[1].x );
+  f4 n2 = f4load( &n.rows[2].x );
+  f4 n3 = f4load( &n.rows[3].x );
 
-      for (int k=0; k<4; k++)
-        sum += m[i][k] * n[k][j];
+  mat4 out;
 
-      out[i][j] = sum;
-    }
+  for (int i=0; i<4; i++) {
+    const vec4 &r = m.rows[i];
+    f4 sum = f4mul( f4splat( r.x ), n0 );
+    sum = f4add( sum, f4mul( f4splat( r.y ), n1 ) );
+    sum = f4add( sum, f4mul( f4splat( r.z ), n2 ) );
+    sum = f4add( sum, f4mul( f4splat( r.w ), n3 ) );
+    f4store( &out.rows[i].x, sum );
+  }
 
   return out;
 }
@@ -545,163 +584,296 @@ std::istream& operator >> ( std::istream& stream, mat4 & m )
 
 // 4x4 inverse
 //
-// Code from the Mesa OpenGL library
+// Block method: split the matrix into 2x2 blocks
+//
+//          | A  B |
+//      M = |      |
+//          | C  D |
+//
+// with each block held in one f4 as (m00 m01 m10 m11), and build the
+// adjugate from 2x2 adjugate products.  This is about a third of the
+// multiplies of the cofactor expansion that was used before (from the
+// Mesa library).  As before, a singular matrix is not detected.
+
+// 2x2 products on blocks packed as (a0 a1 a2 a3) = | a0 a1 |
+//                                                  | a2 a3 |
+
+static inline f4 mat2Mul( f4 a, f4 b )          // a * b
+
+{
+  return f4add( f4mul( a, f4shuffle<0,3,0,3>( b, b ) ),
+                f4mul( f4shuffle<1,0,3,2>( a, a ), f4shuffle<2,1,2,1>( b, b ) ) );
+}
+
+static inline f4 mat2AdjMul( f4 a, f4 b )       // adj(a) * b
+
+{
+  return f4sub( f4mul( f4shuffle<3,3,0,0>( a, a ), b ),
+                f4mul( f4shuffle<1,1,2,2>( a, a ), f4shuffle<2,3,0,1>( b, b ) ) );
+}
+
+static inline f4 mat2MulAdj( f4 a, f4 b )       // a * adj(b)
+
+{
+  return f4sub( f4mul( a, f4shuffle<3,0,3,0>( b, b ) ),
+                f4mul( f4shuffle<1,0,3,2>( a, a ), f4shuffle<2,1,2,1>( b, b ) ) );
+}
+
 
 mat4 mat4::inverse()
 
 {
-  float m[16], invOut[16];
-
-  m[ 0] = rows[0].x;
-  m[ 1] = rows[1].x;
-  m[ 2] = rows[2].x;
-  m[ 3] = rows[3].x;
-  m[ 4] = rows[0].y;
-  m[ 5] = rows[1].y;
-  m[ 6] = rows[2].y;
-  m[ 7] = rows[3].y;
-  m[ 8] = rows[0].z;
-  m[ 9] = rows[1].z;
-  m[10] = rows[2].z;
-  m[11] = rows[3].z;
-  m[12] = rows[0].w;
-  m[13] = rows[1].w;
-  m[14] = rows[2].w;
-  m[15] = rows[3].w;
-
-  float inv[16], det;
-  int i;
-
-  inv[0] = m[5]  * m[10] * m[15] -
-    m[5]  * m[11] * m[14] -
-    m[9]  * m[6]  * m[15] +
-    m[9]  * m[7]  * m[14] +
-    m[13] * m[6]  * m[11] -
-    m[13] * m[7]  * m[10];
-
-  inv[4] = -m[4]  * m[10] * m[15] +
-    m[4]  * m[11] * m[14] +
-    m[8]  * m[6]  * m[15] -
-    m[8]  * m[7]  * m[14] -
-    m[12] * m[6]  * m[11] +
-    m[12] * m[7]  * m[10];
-
-  inv[8] = m[4]  * m[9] * m[15] -
-    m[4]  * m[11] * m[13] -
-    m[8]  * m[5] * m[15] +
-    m[8]  * m[7] * m[13] +
-    m[12] * m[5] * m[11] -
-    m[12] * m[7] * m[9];
-
-  inv[12] = -m[4]  * m[9] * m[14] +
-    m[4]  * m[10] * m[13] +
-    m[8]  * m[5] * m[14] -
-    m[8]  * m[6] * m[13] -
-    m[12] * m[5] * m[10] +
-    m[12] * m[6] * m[9];
-
-  inv[1] = -m[1]  * m[10] * m[15] +
-    m[1]  * m[11] * m[14] +
-    m[9]  * m[2] * m[15] -
-    m[9]  * m[3] * m[14] -
-    m[13] * m[2] * m[11] +
-    m[13] * m[3] * m[10];
-
-  inv[5] = m[0]  * m[10] * m[15] -
-    m[0]  * m[11] * m[14] -
-    m[8]  * m[2] * m[15] +
-    m[8]  * m[3] * m[14] +
-    m[12] * m[2] * m[11] -
-    m[12] * m[3] * m[10];
-
-  inv[9] = -m[0]  * m[9] * m[15] +
-    m[0]  * m[11] * m[13] +
-    m[8]  * m[1] * m[15] -
-    m[8]  * m[3] * m[13] -
-    m[12] * m[1] * m[11] +
-    m[12] * m[3] * m[9];
-
-  inv[13] = m[0]  * m[9] * m[14] -
-    m[0]  * m[10] * m[13] -
-    m[8]  * m[1] * m[14] +
-    m[8]  * m[2] * m[13] +
-    m[12] * m[1] * m[10] -
-    m[12] * m[2] * m[9];
-
-  inv[2] = m[1]  * m[6] * m[15] -
-    m[1]  * m[7] * m[14] -
-    m[5]  * m[2] * m[15] +
-    m[5]  * m[3] * m[14] +
-    m[13] * m[2] * m[7] -
-    m[13] * m[3] * m[6];
-
-  inv[6] = -m[0]  * m[6] * m[15] +
-    m[0]  * m[7] * m[14] +
-    m[4]  * m[2] * m[15] -
-    m[4]  * m[3] * m[14] -
-    m[12] * m[2] * m[7] +
-    m[12] * m[3] * m[6];
-
-  inv[10] = m[0]  * m[5] * m[15] -
-    m[0]  * m[7] * m[13] -
-    m[4]  * m[1] * m[15] +
-    m[4]  * m[3] * m[13] +
-    m[12] * m[1] * m[7] -
-    m[12] * m[3] * m[5];
-
-  inv[14] = -m[0]  * m[5] * m[14] +
-    m[0]  * m[6] * m[13] +
-    m[4]  * m[1] * m[14] -
-    m[4]  * m[2] * m[13] -
-    m[12] * m[1] * m[6] +
-    m[12] * m[2] * m[5];
-
-  inv[3] = -m[1] * m[6] * m[11] +
-    m[1] * m[7] * m[10] +
-    m[5] * m[2] * m[11] -
-    m[5] * m[3] * m[10] -
-    m[9] * m[2] * m[7] +
-    m[9] * m[3] * m[6];
-
-  inv[7] = m[0] * m[6] * m[11] -
-    m[0] * m[7] * m[10] -
-    m[4] * m[2] * m[11] +
-    m[4] * m[3] * m[10] +
-    m[8] * m[2] * m[7] -
-    m[8] * m[3] * m[6];
-
-  inv[11] = -m[0] * m[5] * m[11] +
-    m[0] * m[7] * m[9] +
-    m[4] * m[1] * m[11] -
-    m[4] * m[3] * m[9] -
-    m[8] * m[1] * m[7] +
-    m[8] * m[3] * m[5];
-
-  inv[15] = m[0] * m[5] * m[10] -
-    m[0] * m[6] * m[9] -
-    m[4] * m[1] * m[10] +
-    m[4] * m[2] * m[9] +
-    m[8] * m[1] * m[6] -
-    m[8] * m[2] * m[5];
-
-  det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
-
-  // if (det == 0)
-  //     return false;
-
-  det = 1.0 / det;
-
-  for (i = 0; i < 16; i++)
-    invOut[i] = inv[i] * det;
+  f4 r0 = f4load( &rows[0].x );
+  f4 r1 = f4load( &rows[1].x );
+  f4 r2 = f4load( &rows[2].x );
+  f4 r3 = f4load( &rows[3].x );
+
+  // 2x2 blocks
+
+  f4 A = f4shuffle<0,1,0,1>( r0, r1 );
+  f4 B = f4shuffle<2,3,2,3>( r0, r1 );
+  f4 C = f4shuffle<0,1,0,1>( r2, r3 );
+  f4 D = f4shuffle<2,3,2,3>( r2, r3 );
+
+  // block determinants as (|A| |B| |C| |D|)
+
+  f4 detSub = f4sub( f4mul( f4shuffle<0,2,0,2>( r0, r2 ), f4shuffle<1,3,1,3>( r1, r3 ) ),
+                     f4mul( f4shuffle<1,3,1,3>( r0, r2 ), f4shuffle<0,2,0,2>( r1, r3 ) ) );
+
+  f4 detA = f4shuffle<0,0,0,0>( detSub, detSub );
+  f4 detB = f4shuffle<1,1,1,1>( detSub, detSub );
+  f4 detC = f4shuffle<2,2,2,2>( detSub, detSub );
+  f4 detD = f4shuffle<3,3,3,3>( detSub, detSub );
+
+  // The inverse is 1/|M| * | X Y |, computed here as adjugates X#, Y#, Z#, W#
+  //                        | Z W |
+
+  f4 D_C = mat2AdjMul( D, C );
+  f4 A_B = mat2AdjMul( A, B );
+
+  f4 X_ = f4sub( f4mul( detD, A ), mat2Mul( B, D_C ) );   // |D|A - B(D#C)
+  f4 W_ = f4sub( f4mul( detA, D ), mat2Mul( C, A_B ) );   // |A|D - C(A#B)
+  f4 Y_ = f4sub( f4mul( detB, C ), mat2MulAdj( D, A_B ) ); // |B|C - D(A#B)#
+  f4 Z_ = f4sub( f4mul( detC, B ), mat2MulAdj( A, D_C ) ); // |C|B - A(D#C)#
+
+  // |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+
+  float tr = f4hsum( f4mul( A_B, f4shuffle<0,2,1,3>( D_C, D_C ) ) );
+  float det = f4lane<0>( detSub ) * f4lane<3>( detSub )
+            + f4lane<1>( detSub ) * f4lane<2>( detSub )
+            - tr;
+
+  f4 rDet = f4div( f4set( 1, -1, -1, 1 ), f4splat( det ) );
+
+  X_ = f4mul( X_, rDet );
+  Y_ = f4mul( Y_, rDet );
+  Z_ = f4mul( Z_, rDet );
+  W_ = f4mul( W_, rDet );
+
+  // Apply the 2x2 adjugate swizzle while storing
 
   mat4 r;
 
-  r.rows[0] = vec4( invOut[0], invOut[4], invOut[ 8], invOut[12] );
-  r.rows[1] = vec4( invOut[1], invOut[5], invOut[ 9], invOut[13] );
-  r.rows[2] = vec4( invOut[2], invOut[6], invOut[10], invOut[14] );
-  r.rows[3] = vec4( invOut[3], invOut[7], invOut[11], invOut[15] );
+  f4store( &r.rows[0].x, f4shuffle<3,1,3,1>( X_, Y_ ) );
+  f4store( &r.rows[1].x, f4shuffle<2,0,2,0>( X_, Y_ ) );
+  f4store( &r.rows[2].x, f4shuffle<3,1,3,1>( Z_, W_ ) );
+  f4store( &r.rows[3].x, f4shuffle<2,0,2,0>( Z_, W_ ) );
 
   return r;
+}
+
+
+
+// ---------------- batched transforms ----------------
+
+
+void vec3SoA::resize( int size )
+
+{
+  if (size > capacity) {
+
+    delete [] x;
+    delete [] y;
+    delete [] z;
+
+    capacity = size;
+
+    x = new float[ capacity ];
+    y = new float[ capacity ];
+    z = new float[ capacity ];
+  }
+
+  n = size;
+}
+
+
+void vec3SoA::gather( const vec3 *src, int size )
+
+{
+  resize( size );
+
+  for (int i=0; i<n; i++) {
+    x[i] = src[i].x;
+    y[i] = src[i].y;
+    z[i] = src[i].z;
+  }
+}
+
+
+void vec3SoA::scatter( vec3 *dst ) const
+
+{
+  for (int i=0; i<n; i++)
+    dst[i] = vec3( x[i], y[i], z[i] );
+}
+
+
+// Four elements per iteration, with a scalar loop for the remainder.
+// Each output lane is computed as m[r][0]*x + m[r][1]*y + m[r][2]*z + m[r][3]
+// in that order, so the result matches 'M * vec4( v, 1 )' exactly.
+
+void transformPoints( mat4 const& M, int n,
+                      const float *x, const float *y, const float *z,
+                      float *outX, float *outY, float *outZ, float *outW )
+
+{
+  f4 m[4][4];
+
+  for (int r=0; r<4; r++)
+    for (int c=0; c<4; c++)
+      m[r][c] = f4splat( M[r][c] );
+
+  int i = 0;
+
+  for ( ; i+4<=n; i+=4) {
+
+    f4 vx = f4load( x+i );
+    f4 vy = f4load( y+i );
+    f4 vz = f4load( z+i );
+
+    f4 o[4];
+
+    for (int r=0; r<4; r++)
+      o[r] = f4add( f4add( f4add( f4mul( m[r][0], vx ), f4mul( m[r][1], vy ) ), f4mul( m[r][2], vz ) ), m[r][3] );
+
+    f4store( outX+i, o[0] );
+    f4store( outY+i, o[1] );
+    f4store( outZ+i, o[2] );
+    if (outW != NULL)
+      f4store( outW+i, o[3] );
+  }
+
+  for ( ; i<n; i++) {
+
+    vec4 v = M * vec4( x[i], y[i], z[i], 1 );
+
+    outX[i] = v.x;
+    outY[i] = v.y;
+    outZ[i] = v.z;
+    if (outW != NULL)
+      outW[i] = v.w;
+  }
+}
+
+
+void transformDirections( mat4 const& M, int n,
+                          const float *x, const float *y, const float *z,
+                          float *outX, float *outY, float *outZ )
+
+{
+  f4 m[3][3];
+
+  for (int r=0; r<3; r++)
+    for (int c=0; c<3; c++)
+      m[r][c] = f4splat( M[r][c] );
+
+  int i = 0;
+
+  for ( ; i+4<=n; i+=4) {
+
+    f4 vx = f4load( x+i );
+    f4 vy = f4load( y+i );
+    f4 vz = f4load( z+i );
+
+    f4 o[3];
+
+    for (int r=0; r<3; r++)
+      o[r] = f4add( f4add( f4mul( m[r][0], vx ), f4mul( m[r][1], vy ) ), f4mul( m[r][2], vz ) );
+
+    f4store( outX+i, o[0] );
+    f4store( outY+i, o[1] );
+    f4store( outZ+i, o[2] );
+  }
+
+  for ( ; i<n; i++) {
+
+    float vx = x[i], vy = y[i], vz = z[i];
+
+    outX[i] = M[0][0]*vx + M[0][1]*vy + M[0][2]*vz;
+    outY[i] = M[1][0]*vx + M[1][1]*vy + M[1][2]*vz;
+    outZ[i] = M[2][0]*vx + M[2][1]*vy + M[2][2]*vz;
+  }
+}
+
+
+void perspectiveDivide( int n, float *x, float *y, float *z, const float *w )
+
+{
+  const f4 zero = f4splat( 0 );
+  const f4 one  = f4splat( 1 );
+
+  int i = 0;
+
+  for ( ; i+4<=n; i+=4) {
+
+    f4 vw = f4load( w+i );
+    f4 isZero = f4cmpeq( vw, zero );
+    f4 d = f4select( isZero, one, vw ); // x/1 == x where w == 0
+
+    f4store( x+i, f4div( f4load( x+i ), d ) );
+    f4store( y+i, f4div( f4load( y+i ), d ) );
+    f4store( z+i, f4div( f4load( z+i ), d ) );
+  }
+
+  for ( ; i<n; i++)
+    if (w[i] != 0) {
+      x[i] /= w[i];
+      y[i] /= w[i];
+      z[i] /= w[i];
+    }
+}
+
+
+// The points go through in chunks, so that w fits in a buffer on the
+// stack and is still in the cache when it is divided by.  The chunk
+// size is a multiple of 4 so that every chunk but the last is whole
+// SIMD passes.
+
+
+#define SOA_CHUNK 256
+
+
+void transformPoints( mat4 const& M, vec3SoA const& in, vec3SoA &out )
+
+{
+  out.resize( in.n );
+
+  float w[ SOA_CHUNK ];
+
+  for (int i=0; i<in.n; i+=SOA_CHUNK) {
+
+    int m = (in.n - i < SOA_CHUNK ? in.n - i : SOA_CHUNK);
+
+    transformPoints( M, m, in.x+i, in.y+i, in.z+i, out.x+i, out.y+i, out.z+i, w );
+    perspectiveDivide( m, out.x+i, out.y+i, out.z+i, w );
+  }
+}
+
+
+void transformDirections( mat4 const& M, vec3SoA const& in, vec3SoA &out )
+
+{
+  out.resize( in.n );
 
-  // return true;
+  transformDirections( M, in.n, in.x, in.y, in.z, out.x, out.y, out.z );
 }
@@ -360,4 +360,84 @@ mat4 perspective( float fovy, float aspect, float n, float f );
 std::ostream& operator << ( std::ostream& stream, mat4 const& m );
 std::istream& operator >> ( std::istream& stream, mat4 & m );
 
+
+// ---------------- batched transforms ----------------
+//
+// Points and directions stored as separate x/y/z arrays
+// (structure-of-arrays) so that many of them can be transformed in one
+// vectorised pass instead of one 'M * vec4(...)' call per element.
+// Input and output arrays may be the same.
+
+
+class vec3SoA {
+public:
+
+  float *x, *y, *z;
+  int   n;
+
+  vec3SoA()
+    { x = y = z = NULL; n = 0; capacity = 0; }
+
+  vec3SoA( int size )
+    { x = y = z = NULL; n = 0; capacity = 0; resize( size ); }
+
+  ~vec3SoA()
+    { delete [] x; delete [] y; delete [] z; }
+
+  vec3SoA( const vec3SoA & ) = delete;
+  vec3SoA & operator = ( const vec3SoA & ) = delete;
+
+  int size() const
+    { return n; }
+
+  void resize( int size );      // contents are undefined after growing
+
+  vec3 operator[]( int i ) const
+    { return vec3( x[i], y[i], z[i] ); }
+
+  void set( int i, vec3 v )
+    { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+
+  // AoS -> SoA.  'src' is anything with size() and operator[] giving a
+  // vec3, such as seq<vec3>.
+
+  template<class S> void gather( S const& src ) {
+    resize( src.size() );
+    for (int i=0; i<n; i++) {
+      vec3 const& v = src[i];
+      x[i] = v.x; y[i] = v.y; z[i] = v.z;
+    }
+  }
+
+  void gather( const vec3 *src, int size );
+  void scatter( vec3 *dst ) const;  // SoA -> AoS
+
+private:
+
+  int capacity;
+};
+
+
+// (outX,outY,outZ,outW) = M * (x,y,z,1).  outW may be NULL.
+
+void transformPoints( mat4 const& M, int n,
+                      const float *x, const float *y, const float *z,
+                      float *outX, float *outY, float *outZ, float *outW );
+
+// (outX,outY,outZ) = upper 3x4 of M * (x,y,z,0)
+
+void transformDirections( mat4 const& M, int n,
+                          const float *x, const float *y, const float *z,
+                          float *outX, float *outY, float *outZ );
+
+// Batched vec4::toVec3(): divide x,y,z by w in place wherever w != 0
+
+void perspectiveDivide( int n, float *x, float *y, float *z, const float *w );
+
+// SoA conveniences.  transformPoints() includes the perspective divide,
+// so out[i] == (M * vec4( in[i], 1 )).toVec3().
+
+void transformPoints( mat4 const& M, vec3SoA const& in, vec3SoA &out );
+void transformDirections( mat4 const& M, vec3SoA const& in, vec3SoA &out );
+
 #endif
@@ -3,6 +3,7 @@
 
 #include "headers.h"
 #include "plane.h"
+#include "drawStats.h"
 
 
 Plane::Plane(vec3 b1, vec3 b2)
@@ -93,6 +94,7 @@ void Plane::draw( mat4 &MVP_transform )
 
   glBindVertexArray( VAO );
   glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+  drawStats.drawCalls++;
 
 #ifndef __APPLE__
   glLineWidth( 1.0 );
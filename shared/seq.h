@@ -1,251 +1,394 @@
-//verbatim copy of seq.h
-
-/* seq.h
- *
- * A structure to hold a sequence of elements.
- *
- *   PUBLIC VARIABLES
- *
- *     none!
- *
- *   CONSTRUCTORS
- *
- *     seq()               Create an empty sequence
- *
- *   PUBLIC FUNCTIONS
- *
- *     add( x )            Add x to the end of the sequence
- *     remove()            Remove the last element of the sequence
- *     remove( i )         Remove the i^{th} element of the sequence (expensive)
- *     shift( i )          Shift right everything starting at position i
- *     operator [i]        Returns the i^{th} element (starting from 0)
- *     exists( x )         Return true if x exists in sequence, false otherwise
- *     clear()             Deletes the whole sequence
- *     findIndex( x )      Find the index of element x, or -1 if it doesn't exist
- */
-
-
-#ifndef SEQ_H
-#define SEQ_H
-
-#include "headers.h"
-
-#include <iostream>
-#include <stdlib.h>
-
-using namespace std;
-
-
-template<class T> class seq {
-
-  int storageSize;
-  int numElements;
-  T  *data;
-
-public:
-
-  seq() {                       // constructor
-    storageSize = 2;
-    numElements = 0;
-    data = new T[ storageSize ];
-  }
-
-  seq( int n ) {                // constructor
-    storageSize = n;
-    numElements = 0;
-    data = new T[ storageSize ];
-  }
-
-  ~seq() {                      // destructor
-    delete [] data;
-  }
-
-  seq( const seq<T> & source ) { // copy constructor
-
-    storageSize = source.storageSize;
-    numElements = source.numElements;
-    data = new T[ storageSize ];
-    for (int i=0; i<numElements; i++)
-      data[i] = source.data[i];
-  }
-
-  void remove() {
-    if (numElements == 0) {
-      cerr << "remove: Tried to remove element from empty sequence\n";
-      exit(-1);
-    }
-
-    numElements = numElements - 1;
-  }
-
-  void remove( int i );
-  void shift( int i );
-  void compress();
-
-  int size() const {
-    return numElements;
-  }
-
-  T & operator [] ( int i ) const {
-    if (i >= numElements || i < 0) {
-      cerr << "element: Tried to access an element beyond the range of the sequence: "
-           << i << "(numElements = " << numElements << ")\n";
-      exit(-1);
-    }
-    return data[ i ];
-  }
-
-  void clear() {
-    delete [] data;
-    storageSize = 1;
-    numElements = 0;
-    data = new T[ storageSize ];
-  }
-
-  seq<T> & operator = (const seq<T> &source) { // assignment operator
-    storageSize = source.storageSize;
-    numElements = source.numElements;
-    delete [] data;
-    data = new T[ storageSize ];
-    for (int i=0; i<numElements; i++)
-      data[i] = source.data[i];
-    return *this;
-  }
-
-  void add( const T &x );
-  int findIndex( const T &x );
-  bool exists( const T &x );
-};
-
-
-// Add an element to the end of the sequence
-
-template<class T>
-void
-seq<T>::add( const T &x )
-
-{
-  // No storage left?  If so, double the storage
-
-  if (numElements == storageSize) {
-    T *newData;
-
-    newData = new T[ storageSize * 2 ];
-    for (int i=0; i<storageSize; i++)
-      newData[i] = data[i];
-    storageSize = storageSize * 2;
-    delete [] data;
-    data = newData;
-  }
-
-  // Store the element in the next available position
-
-  data[ numElements ] = x;
-  numElements++;
-}
-
-
-// Compress the array
-
-template<class T>
-void
-seq<T>::compress()
-
-{
-  T *newData;
-
-  if (numElements == storageSize)
-    return;
-
-  newData = new T[ numElements ];
-  for (int i=0; i<numElements; i++)
-    newData[i] = data[i];
-  storageSize = numElements;
-  delete [] data;
-  data = newData;
-}
-
-
-// Find and return an element
-
-template<class T>
-bool
-seq<T>::exists( const T &x )
-
-{
-  for (int i=0; i<numElements; i++)
-    if (data[i] == x)
-      return true;
-
-  return false;
-}
-
-
-// Find and return the *index* of an element
-
-template<class T>
-int
-seq<T>::findIndex( const T &x )
-
-{
-  for (int i=0; i<numElements; i++)
-    if (data[i] == x)
-      return i;
-
-  return -1;
-}
-
-
-// Shift a suffix of the sequence to the right by one
-
-template<class T>
-void
-seq<T>::shift( int i )
-
-{
-  if (i < 0 || i >= numElements) {
-    cerr << "remove: Tried to shift element " << i
-         << " from a sequence of " << numElements << " elements \n";
-    exit(-1);
-  }
-
-  if (numElements == storageSize) {
-    T *newData;
-
-    newData = new T[ storageSize * 2 ];
-    for (int i=0; i<storageSize; i++)
-      newData[i] = data[i];
-    storageSize = storageSize * 2;
-    delete [] data;
-    data = newData;
-  }
-
-  for (int j=numElements; j>i; j--)
-    data[j] = data[j-1];
-
-  numElements++;
-}
-
-
-// Shift a suffix of the sequence to the left by one
-
-template<class T>
-void
-seq<T>::remove( int i )
-
-{
-  if (i < 0 || i >= numElements) {
-    cerr << "remove: Tried to remove element " << i
-         << " from a sequence of " << numElements << " elements \n";
-    exit(-1);
-  }
-
-  for (int j=i; j<numElements-1; j++)
-    data[j] = data[j+1];
-
-  numElements--;
-}
-
-
-
-#endif
+/* seq.h
+ *
+ * A structure to hold a sequence of elements.
+ *
+ * Storage is allocated uninitialised and elements are constructed in
+ * place, so growing the sequence moves (rather than copies) elements
+ * and nothing is default-constructed beyond size().  Storage can
+ * optionally come from an Arena (see arena.h), in which case it is
+ * never freed by the sequence.
+ *
+ *   PUBLIC VARIABLES
+ *
+ *     none!
+ *
+ *   CONSTRUCTORS
+ *
+ *     seq()               Create an empty sequence
+ *     seq( n )            Create an empty sequence with room for n elements
+ *     seq( arena )        Create an empty sequence that allocates from 'arena'
+ *     seq( n, arena )
+ *
+ *   PUBLIC FUNCTIONS
+ *
+ *     add( x )            Add x to the end of the sequence (copied or moved)
+ *     emplace( args... )  Construct a new element at the end from 'args'
+ *     reserve( n )        Make room for at least n elements
+ *     remove()            Remove the last element of the sequence
+ *     remove( i )         Remove the i^{th} element of the sequence (expensive)
+ *     shift( i )          Shift right everything starting at position i
+ *     operator [i]        Returns the i^{th} element (starting from 0)
+ *     array()             Returns a pointer to the contiguous elements
+ *     exists( x )         Return true if x exists in sequence, false otherwise
+ *     clear()             Removes all elements, keeping the storage
+ *     compress()          Shrink the storage to fit the elements
+ *     findIndex( x )      Find the index of element x, or -1 if it doesn't exist
+ *
+ * Index checks in operator[] are done only in debug builds (when NDEBUG
+ * is not defined) unless SEQ_NO_BOUNDS_CHECK is defined.
+ */
+
+
+#ifndef SEQ_H
+#define SEQ_H
+
+#include "headers.h"
+#include "arena.h"
+
+#include <iostream>
+#include <stdlib.h>
+#include <new>
+#include <utility>
+
+using namespace std;
+
+
+#if !defined(NDEBUG) && !defined(SEQ_NO_BOUNDS_CHECK)
+  #define SEQ_BOUNDS_CHECK
+#endif
+
+
+template<class T> class seq {
+
+  int    storageSize;
+  int    numElements;
+  T     *data;
+  Arena *arena;
+
+  T *allocate( int n ) {
+    if (n == 0)
+      return NULL;
+    if (arena != NULL)
+      return (T *) arena->alloc( n * sizeof(T), alignof(T) );
+    return (T *) ::operator new( n * sizeof(T) );
+  }
+
+  void deallocate( T *p ) {
+    if (arena == NULL)
+      ::operator delete( p );
+  }
+
+  void destroyAll() {
+    for (int i=0; i<numElements; i++)
+      data[i].~T();
+  }
+
+  void relocate( T *newData, int newSize ); // move elements into newData
+
+  template<class... Args> void growEmplace( Args&&... args ); // add() when full
+
+  int grownSize() const {
+    return (storageSize < 1 ? 2 : storageSize * 2);
+  }
+
+public:
+
+  seq() {                       // constructor
+    storageSize = 0;
+    numElements = 0;
+    data = NULL;
+    arena = NULL;
+  }
+
+  seq( int n ) {                // constructor
+    storageSize = n;
+    numElements = 0;
+    arena = NULL;
+    data = allocate( storageSize );
+  }
+
+  seq( Arena *a ) {             // constructor
+    storageSize = 0;
+    numElements = 0;
+    data = NULL;
+    arena = a;
+  }
+
+  seq( int n, Arena *a ) {      // constructor
+    storageSize = n;
+    numElements = 0;
+    arena = a;
+    data = allocate( storageSize );
+  }
+
+  ~seq() {                      // destructor
+    destroyAll();
+    deallocate( data );
+  }
+
+  seq( const seq<T> & source ) { // copy constructor
+
+    storageSize = source.numElements;
+    numElements = source.numElements;
+    arena = source.arena;
+    data = allocate( storageSize );
+    for (int i=0; i<numElements; i++)
+      new (data+i) T( source.data[i] );
+  }
+
+  seq( seq<T> && source ) {     // move constructor
+
+    storageSize = source.storageSize;
+    numElements = source.numElements;
+    data = source.data;
+    arena = source.arena;
+
+    source.storageSize = 0;
+    source.numElements = 0;
+    source.data = NULL;
+  }
+
+  void remove() {
+    if (numElements == 0) {
+      cerr << "remove: Tried to remove element from empty sequence\n";
+      exit(-1);
+    }
+
+    numElements = numElements - 1;
+    data[numElements].~T();
+  }
+
+  void remove( int i );
+  void shift( int i );
+  void compress();
+  void reserve( int n );
+
+  int size() const {
+    return numElements;
+  }
+
+  T & operator [] ( int i ) const {
+#ifdef SEQ_BOUNDS_CHECK
+    if (i >= numElements || i < 0) {
+      cerr << "element: Tried to access an element beyond the range of the sequence: "
+           << i << "(numElements = " << numElements << ")\n";
+      exit(-1);
+    }
+#endif
+    return data[ i ];
+  }
+
+  T *array() const {
+    return data;
+  }
+
+  void clear() {
+    destroyAll();
+    numElements = 0;
+  }
+
+  seq<T> & operator = (const seq<T> &source) { // assignment operator
+
+    if (&source == this)
+      return *this;
+
+    clear();
+    reserve( source.numElements );
+    for (int i=0; i<source.numElements; i++)
+      new (data+i) T( source.data[i] );
+    numElements = source.numElements;
+    return *this;
+  }
+
+  seq<T> & operator = (seq<T> &&source) { // move assignment operator
+
+    if (&source == this)
+      return *this;
+
+    destroyAll();
+    deallocate( data );
+
+    storageSize = source.storageSize;
+    numElements = source.numElements;
+    data = source.data;
+    arena = source.arena;
+
+    source.storageSize = 0;
+    source.numElements = 0;
+    source.data = NULL;
+    return *this;
+  }
+
+  void add( const T &x ) {
+    if (numElements == storageSize)
+      growEmplace( x );
+    else
+      new (data + numElements++) T( x );
+  }
+
+  void add( T &&x ) {
+    if (numElements == storageSize)
+      growEmplace( std::move( x ) );
+    else
+      new (data + numElements++) T( std::move( x ) );
+  }
+
+  template<class... Args> T & emplace( Args&&... args ) {
+    if (numElements == storageSize)
+      growEmplace( std::forward<Args>( args )... );
+    else
+      new (data + numElements++) T( std::forward<Args>( args )... );
+    return data[ numElements-1 ];
+  }
+
+  int findIndex( const T &x );
+  bool exists( const T &x );
+};
+
+
+// Move the elements into 'newData' (of size 'newSize') and release
+// the old storage
+
+template<class T>
+void
+seq<T>::relocate( T *newData, int newSize )
+
+{
+  for (int i=0; i<numElements; i++) {
+    new (newData+i) T( std::move( data[i] ) );
+    data[i].~T();
+  }
+
+  deallocate( data );
+  data = newData;
+  storageSize = newSize;
+}
+
+
+// Make room for at least n elements
+
+template<class T>
+void
+seq<T>::reserve( int n )
+
+{
+  if (n > storageSize)
+    relocate( allocate( n ), n );
+}
+
+
+// Grow the storage and construct a new element at the end from 'args'
+//
+// The new element is constructed in the new storage *before* the old
+// storage is released, since 'args' might refer to an element of this
+// sequence.  This is kept out of add() and emplace() so that they stay
+// small enough to be inlined.
+
+template<class T>
+template<class... Args>
+void
+seq<T>::growEmplace( Args&&... args )
+
+{
+  int newSize = grownSize();
+  T *newData = allocate( newSize );
+  new (newData + numElements) T( std::forward<Args>( args )... );
+  relocate( newData, newSize );
+  numElements++;
+}
+
+
+// Compress the array
+
+template<class T>
+void
+seq<T>::compress()
+
+{
+  if (numElements == storageSize)
+    return;
+
+  relocate( allocate( numElements ), numElements );
+}
+
+
+// Find and return an element
+
+template<class T>
+bool
+seq<T>::exists( const T &x )
+
+{
+  for (int i=0; i<numElements; i++)
+    if (data[i] == x)
+      return true;
+
+  return false;
+}
+
+
+// Find and return the *index* of an element
+
+template<class T>
+int
+seq<T>::findIndex( const T &x )
+
+{
+  for (int i=0; i<numElements; i++)
+    if (data[i] == x)
+      return i;
+
+  return -1;
+}
+
+
+// Shift a suffix of the sequence to the right by one
+//
+// Element i is left in place (moved-from) for the caller to overwrite.
+
+template<class T>
+void
+seq<T>::shift( int i )
+
+{
+  if (i < 0 || i >= numElements) {
+    cerr << "remove: Tried to shift element " << i
+         << " from a sequence of " << numElements << " elements \n";
+    exit(-1);
+  }
+
+  if (numElements == storageSize)
+    reserve( grownSize() );
+
+  new (data + numElements) T( std::move( data[numElements-1] ) );
+
+  for (int j=numElements-1; j>i; j--)
+    data[j] = std::move( data[j-1] );
+
+  numElements++;
+}
+
+
+// Shift a suffix of the sequence to the left by one
+
+template<class T>
+void
+seq<T>::remove( int i )
+
+{
+  if (i < 0 || i >= numElements) {
+    cerr << "remove: Tried to remove element " << i
+         << " from a sequence of " << numElements << " elements \n";
+    exit(-1);
+  }
+
+  for (int j=i; j<numElements-1; j++)
+    data[j] = std::move( data[j+1] );
+
+  numElements--;
+  data[numElements].~T();
+}
+
+
+
+#endif
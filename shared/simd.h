@@ -0,0 +1,288 @@
+// simd.h
+//
+// A thin 4-wide float abstraction used by the linalg kernels.
+//
+// The backend is chosen at compile time:
+//
+//    SSE     x86 / x86-64 (SSE2 is part of the x86-64 baseline)
+//    NEON    ARMv7 with NEON, AArch64
+//    scalar  everything else, or when LINALG_NO_SIMD is defined
+//
+// All loads and stores are unaligned, since vec4 and mat4 are plain
+// float structs with no alignment guarantee.
+//
+//   f4load( p )              load p[0..3]
+//   f4store( p, a )          store a into p[0..3]
+//   f4set( x, y, z, w )      build (x,y,z,w)
+//   f4splat( x )             build (x,x,x,x)
+//   f4add/sub/mul/div        lane-wise arithmetic
+//   f4madd( a, b, c )        a*b + c
+//   f4min/max                lane-wise min/max
+//   f4sqrt                   lane-wise square root
+//   f4floor                  lane-wise floor (for |a| < 2^31)
+//   f4cmpeq/lt/le            lane-wise compare, giving a mask
+//   f4select( m, a, b )      m ? a : b per lane
+//   f4and/or/andnot( m, n )  mask logic (andnot = m & ~n)
+//   f4movemask( m )          mask lanes as the low 4 bits of an int
+//   f4shuffle<i,j,k,l>(a,b)  (a[i], a[j], b[k], b[l])
+//   f4lane<i>( a )           a[i]
+//   f4hsum( a )              (a[0]+a[2]) + (a[1]+a[3]), in that order on every backend
+//   f4transpose( r0..r3 )    transpose four rows in place
+
+
+#ifndef SIMD_H
+#define SIMD_H
+
+
+#if !defined(LINALG_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+  #define LINALG_SSE
+  #include <xmmintrin.h>
+  #include <emmintrin.h>
+#elif !defined(LINALG_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+  #define LINALG_NEON
+  #include <arm_neon.h>
+#else
+  #define LINALG_SCALAR
+#endif
+
+#include <cmath>
+
+
+#if defined(LINALG_SSE)
+
+
+// ---------------- SSE ----------------
+
+
+typedef __m128 f4;
+
+#define LINALG_SIMD_NAME "SSE"
+
+inline f4 f4load( const float *p )             { return _mm_loadu_ps( p ); }
+inline void f4store( float *p, f4 a )          { _mm_storeu_ps( p, a ); }
+inline f4 f4set( float x, float y, float z, float w ) { return _mm_setr_ps( x, y, z, w ); }
+inline f4 f4splat( float x )                   { return _mm_set1_ps( x ); }
+
+inline f4 f4add( f4 a, f4 b )                  { return _mm_add_ps( a, b ); }
+inline f4 f4sub( f4 a, f4 b )                  { return _mm_sub_ps( a, b ); }
+inline f4 f4mul( f4 a, f4 b )                  { return _mm_mul_ps( a, b ); }
+inline f4 f4div( f4 a, f4 b )                  { return _mm_div_ps( a, b ); }
+inline f4 f4madd( f4 a, f4 b, f4 c )           { return _mm_add_ps( _mm_mul_ps( a, b ), c ); }
+inline f4 f4min( f4 a, f4 b )                  { return _mm_min_ps( a, b ); }
+inline f4 f4max( f4 a, f4 b )                  { return _mm_max_ps( a, b ); }
+inline f4 f4sqrt( f4 a )                       { return _mm_sqrt_ps( a ); }
+
+inline f4 f4floor( f4 a )
+
+{
+  // truncate, then step down where that rounded up (negative a)
+
+  f4 t = _mm_cvtepi32_ps( _mm_cvttps_epi32( a ) );
+  return _mm_sub_ps( t, _mm_and_ps( _mm_cmpgt_ps( t, a ), _mm_set1_ps( 1 ) ) );
+}
+
+inline f4 f4cmpeq( f4 a, f4 b )                { return _mm_cmpeq_ps( a, b ); }
+inline f4 f4cmplt( f4 a, f4 b )                { return _mm_cmplt_ps( a, b ); }
+inline f4 f4cmple( f4 a, f4 b )                { return _mm_cmple_ps( a, b ); }
+inline f4 f4and( f4 m, f4 n )                  { return _mm_and_ps( m, n ); }
+inline f4 f4or( f4 m, f4 n )                   { return _mm_or_ps( m, n ); }
+inline f4 f4andnot( f4 m, f4 n )               { return _mm_andnot_ps( n, m ); }
+inline f4 f4select( f4 m, f4 a, f4 b )         { return _mm_or_ps( _mm_and_ps( m, a ), _mm_andnot_ps( m, b ) ); }
+inline int f4movemask( f4 m )                  { return _mm_movemask_ps( m ); }
+
+template<int i, int j, int k, int l>
+inline f4 f4shuffle( f4 a, f4 b )              { return _mm_shuffle_ps( a, b, _MM_SHUFFLE( l, k, j, i ) ); }
+
+template<int i>
+inline float f4lane( f4 a )                    { return _mm_cvtss_f32( _mm_shuffle_ps( a, a, _MM_SHUFFLE( i, i, i, i ) ) ); }
+
+inline float f4hsum( f4 a )
+
+{
+  f4 s = _mm_add_ps( a, _mm_movehl_ps( a, a ) );                   // (a0+a2, a1+a3, ...)
+  s = _mm_add_ss( s, _mm_shuffle_ps( s, s, _MM_SHUFFLE(1,1,1,1) ) );
+  return _mm_cvtss_f32( s );
+}
+
+inline void f4transpose( f4 &r0, f4 &r1, f4 &r2, f4 &r3 )
+
+{
+  _MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+}
+
+
+#elif defined(LINALG_NEON)
+
+
+// ---------------- NEON ----------------
+
+
+typedef float32x4_t f4;
+
+#define LINALG_SIMD_NAME "NEON"
+
+inline f4 f4load( const float *p )             { return vld1q_f32( p ); }
+inline void f4store( float *p, f4 a )          { vst1q_f32( p, a ); }
+inline f4 f4set( float x, float y, float z, float w ) { float v[4] = { x, y, z, w }; return vld1q_f32( v ); }
+inline f4 f4splat( float x )                   { return vdupq_n_f32( x ); }
+
+inline f4 f4add( f4 a, f4 b )                  { return vaddq_f32( a, b ); }
+inline f4 f4sub( f4 a, f4 b )                  { return vsubq_f32( a, b ); }
+inline f4 f4mul( f4 a, f4 b )                  { return vmulq_f32( a, b ); }
+inline f4 f4madd( f4 a, f4 b, f4 c )           { return vmlaq_f32( c, a, b ); }
+inline f4 f4min( f4 a, f4 b )                  { return vminq_f32( a, b ); }
+inline f4 f4max( f4 a, f4 b )                  { return vmaxq_f32( a, b ); }
+
+#if defined(__aarch64__)
+inline f4 f4div( f4 a, f4 b )                  { return vdivq_f32( a, b ); }
+inline f4 f4sqrt( f4 a )                       { return vsqrtq_f32( a ); }
+inline f4 f4floor( f4 a )                      { return vrndmq_f32( a ); }
+#else
+inline f4 f4div( f4 a, f4 b )
+
+{
+  // reciprocal estimate plus two Newton steps
+
+  f4 r = vrecpeq_f32( b );
+  r = vmulq_f32( vrecpsq_f32( b, r ), r );
+  r = vmulq_f32( vrecpsq_f32( b, r ), r );
+  return vmulq_f32( a, r );
+}
+
+inline f4 f4sqrt( f4 a )
+
+{
+  float v[4];
+  vst1q_f32( v, a );
+  for (int i=0; i<4; i++)
+    v[i] = sqrtf( v[i] );
+  return vld1q_f32( v );
+}
+
+inline f4 f4floor( f4 a )
+
+{
+  f4 t = vcvtq_f32_s32( vcvtq_s32_f32( a ) );
+  return vsubq_f32( t, vreinterpretq_f32_u32( vandq_u32( vcgtq_f32( t, a ), vreinterpretq_u32_f32( vdupq_n_f32( 1 ) ) ) ) );
+}
+#endif
+
+inline f4 f4cmpeq( f4 a, f4 b )                { return vreinterpretq_f32_u32( vceqq_f32( a, b ) ); }
+inline f4 f4cmplt( f4 a, f4 b )                { return vreinterpretq_f32_u32( vcltq_f32( a, b ) ); }
+inline f4 f4cmple( f4 a, f4 b )                { return vreinterpretq_f32_u32( vcleq_f32( a, b ) ); }
+inline f4 f4and( f4 m, f4 n )                  { return vreinterpretq_f32_u32( vandq_u32( vreinterpretq_u32_f32( m ), vreinterpretq_u32_f32( n ) ) ); }
+inline f4 f4or( f4 m, f4 n )                   { return vreinterpretq_f32_u32( vorrq_u32( vreinterpretq_u32_f32( m ), vreinterpretq_u32_f32( n ) ) ); }
+inline f4 f4andnot( f4 m, f4 n )               { return vreinterpretq_f32_u32( vbicq_u32( vreinterpretq_u32_f32( m ), vreinterpretq_u32_f32( n ) ) ); }
+inline f4 f4select( f4 m, f4 a, f4 b )         { return vbslq_f32( vreinterpretq_u32_f32( m ), a, b ); }
+
+inline int f4movemask( f4 m )
+
+{
+  uint32x4_t u = vshrq_n_u32( vreinterpretq_u32_f32( m ), 31 );
+  return vgetq_lane_u32( u, 0 ) | (vgetq_lane_u32( u, 1 ) << 1) | (vgetq_lane_u32( u, 2 ) << 2) | (vgetq_lane_u32( u, 3 ) << 3);
+}
+
+template<int i>
+inline float f4lane( f4 a )                    { return vgetq_lane_f32( a, i ); }
+
+template<int i, int j, int k, int l>
+inline f4 f4shuffle( f4 a, f4 b )
+
+{
+  f4 r = vdupq_n_f32( vgetq_lane_f32( a, i ) );
+  r = vsetq_lane_f32( vgetq_lane_f32( a, j ), r, 1 );
+  r = vsetq_lane_f32( vgetq_lane_f32( b, k ), r, 2 );
+  r = vsetq_lane_f32( vgetq_lane_f32( b, l ), r, 3 );
+  return r;
+}
+
+inline float f4hsum( f4 a )
+
+{
+  float32x2_t s = vadd_f32( vget_low_f32( a ), vget_high_f32( a ) );
+  return vget_lane_f32( vpadd_f32( s, s ), 0 );
+}
+
+inline void f4transpose( f4 &r0, f4 &r1, f4 &r2, f4 &r3 )
+
+{
+  float32x4x2_t t01 = vtrnq_f32( r0, r1 );
+  float32x4x2_t t23 = vtrnq_f32( r2, r3 );
+  r0 = vcombine_f32( vget_low_f32( t01.val[0] ), vget_low_f32( t23.val[0] ) );
+  r1 = vcombine_f32( vget_low_f32( t01.val[1] ), vget_low_f32( t23.val[1] ) );
+  r2 = vcombine_f32( vget_high_f32( t01.val[0] ), vget_high_f32( t23.val[0] ) );
+  r3 = vcombine_f32( vget_high_f32( t01.val[1] ), vget_high_f32( t23.val[1] ) );
+}
+
+
+#else
+
+
+// ---------------- scalar fallback ----------------
+
+
+struct f4 {
+  float v[4];
+};
+
+#define LINALG_SIMD_NAME "scalar"
+
+#define F4_LANEWISE(expr) { f4 r; for (int i=0; i<4; i++) r.v[i] = (expr); return r; }
+
+inline f4 f4load( const float *p )             F4_LANEWISE( p[i] )
+inline void f4store( float *p, f4 a )          { for (int i=0; i<4; i++) p[i] = a.v[i]; }
+inline f4 f4set( float x, float y, float z, float w ) { f4 r = { { x, y, z, w } }; return r; }
+inline f4 f4splat( float x )                   F4_LANEWISE( x )
+
+inline f4 f4add( f4 a, f4 b )                  F4_LANEWISE( a.v[i] + b.v[i] )
+inline f4 f4sub( f4 a, f4 b )                  F4_LANEWISE( a.v[i] - b.v[i] )
+inline f4 f4mul( f4 a, f4 b )                  F4_LANEWISE( a.v[i] * b.v[i] )
+inline f4 f4div( f4 a, f4 b )                  F4_LANEWISE( a.v[i] / b.v[i] )
+inline f4 f4madd( f4 a, f4 b, f4 c )           F4_LANEWISE( a.v[i] * b.v[i] + c.v[i] )
+inline f4 f4min( f4 a, f4 b )                  F4_LANEWISE( a.v[i] < b.v[i] ? a.v[i] : b.v[i] )
+inline f4 f4max( f4 a, f4 b )                  F4_LANEWISE( a.v[i] > b.v[i] ? a.v[i] : b.v[i] )
+inline f4 f4sqrt( f4 a )                       F4_LANEWISE( sqrtf( a.v[i] ) )
+inline f4 f4floor( f4 a )                      F4_LANEWISE( floorf( a.v[i] ) )
+
+// Masks are stored as 0.0 / non-zero floats, which is all f4select and
+// f4movemask need.
+
+inline f4 f4cmpeq( f4 a, f4 b )                F4_LANEWISE( a.v[i] == b.v[i] ? 1.0f : 0.0f )
+inline f4 f4cmplt( f4 a, f4 b )                F4_LANEWISE( a.v[i] <  b.v[i] ? 1.0f : 0.0f )
+inline f4 f4cmple( f4 a, f4 b )                F4_LANEWISE( a.v[i] <= b.v[i] ? 1.0f : 0.0f )
+inline f4 f4and( f4 m, f4 n )                  F4_LANEWISE( (m.v[i] != 0 && n.v[i] != 0) ? 1.0f : 0.0f )
+inline f4 f4or( f4 m, f4 n )                   F4_LANEWISE( (m.v[i] != 0 || n.v[i] != 0) ? 1.0f : 0.0f )
+inline f4 f4andnot( f4 m, f4 n )               F4_LANEWISE( (m.v[i] != 0 && n.v[i] == 0) ? 1.0f : 0.0f )
+inline f4 f4select( f4 m, f4 a, f4 b )         F4_LANEWISE( m.v[i] != 0 ? a.v[i] : b.v[i] )
+
+inline int f4movemask( f4 m )
+
+{
+  return (m.v[0] != 0) | ((m.v[1] != 0) << 1) | ((m.v[2] != 0) << 2) | ((m.v[3] != 0) << 3);
+}
+
+template<int i, int j, int k, int l>
+inline f4 f4shuffle( f4 a, f4 b )              { f4 r = { { a.v[i], a.v[j], b.v[k], b.v[l] } }; return r; }
+
+template<int i>
+inline float f4lane( f4 a )                    { return a.v[i]; }
+
+inline float f4hsum( f4 a )                    { return (a.v[0] + a.v[2]) + (a.v[1] + a.v[3]); }
+
+inline void f4transpose( f4 &r0, f4 &r1, f4 &r2, f4 &r3 )
+
+{
+  f4 t0 = r0, t1 = r1, t2 = r2, t3 = r3;
+
+  r0 = f4set( t0.v[0], t1.v[0], t2.v[0], t3.v[0] );
+  r1 = f4set( t0.v[1], t1.v[1], t2.v[1], t3.v[1] );
+  r2 = f4set( t0.v[2], t1.v[2], t2.v[2], t3.v[2] );
+  r3 = f4set( t0.v[3], t1.v[3], t2.v[3], t3.v[3] );
+}
+
+#undef F4_LANEWISE
+
+#endif
+
+
+#endif
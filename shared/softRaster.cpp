@@ -0,0 +1,571 @@
+// softRaster.cpp
+
+
+#include "softRaster.h"
+#include "simd.h"
+#include "lodepng.h"
+
+#include <vector>
+#include <algorithm>
+
+
+SoftRaster::SoftRaster( int w, int h, ThreadPool &p )
+  : pool( p )
+
+{
+  width  = w;
+  height = h;
+  pitch  = (w + 3) & ~3;
+
+  tilesX = (w + SOFT_TILE_SIZE-1) / SOFT_TILE_SIZE;
+  tilesY = (h + SOFT_TILE_SIZE-1) / SOFT_TILE_SIZE;
+
+  // A few tasks per thread, so that the setup balances
+
+  maxTasks = 4 * pool.size();
+
+  colourBuffer = new unsigned char[ w * h * 4 ];
+  depthBuffer  = new float[ pitch * h ];
+
+  vertices = NULL;
+  vertexCapacity = 0;
+
+  taskTriangles = new seq<Triangle>[ maxTasks ];
+  bins = new seq<int>[ maxTasks * tilesX * tilesY ];
+
+  clear( vec3(0,0,0) );
+}
+
+
+SoftRaster::~SoftRaster()
+
+{
+  delete[] colourBuffer;
+  delete[] depthBuffer;
+  delete[] vertices;
+  delete[] taskTriangles;
+  delete[] bins;
+}
+
+
+void SoftRaster::clear( vec3 colour )
+
+{
+  unsigned char rgba[4] = { (unsigned char) (fmin( fmax( colour.x, 0 ), 1 ) * 255 + 0.5),
+                            (unsigned char) (fmin( fmax( colour.y, 0 ), 1 ) * 255 + 0.5),
+                            (unsigned char) (fmin( fmax( colour.z, 0 ), 1 ) * 255 + 0.5),
+                            255 };
+
+  pool.parallelFor( 0, height, 16, [&]( int y0, int y1 ) {
+    for (int y=y0; y<y1; y++) {
+      for (int x=0; x<width; x++)
+        memcpy( colourBuffer + 4*(y*width + x), rgba, 4 );
+      for (int x=0; x<pitch; x++)
+        depthBuffer[ y*pitch + x ] = 1;
+    }
+  } );
+}
+
+
+void SoftRaster::stripIndices( int first, int count, seq<unsigned int> &indices )
+
+{
+  // Every other triangle is reversed, so that they all wind the same
+  // way
+
+  for (int i=0; i+2<count; i++)
+    if (i % 2 == 0) {
+      indices.add( first+i );
+      indices.add( first+i+1 );
+      indices.add( first+i+2 );
+    } else {
+      indices.add( first+i+1 );
+      indices.add( first+i );
+      indices.add( first+i+2 );
+    }
+}
+
+
+void SoftRaster::fanIndices( int first, int count, seq<unsigned int> &indices )
+
+{
+  for (int i=0; i+2<count; i++) {
+    indices.add( first );
+    indices.add( first+i+1 );
+    indices.add( first+i+2 );
+  }
+}
+
+
+void SoftRaster::drawTriangles( const float *positions, const float *normals, const float *texCoords, int stride, int nVerts,
+                                const unsigned int *indices, int nIndices,
+                                const mat4 &MV, const mat4 &MVP, vec3 lightDir, vec3 colour,
+                                bool lit, const SoftTexture *texture )
+
+{
+  int nTris = nIndices / 3;
+
+  if (nTris == 0 || nVerts == 0)
+    return;
+
+  drawIndices  = indices;
+  drawLightDir = lightDir;
+  drawColour   = colour;
+  drawLit      = lit;
+  drawTexture  = texture;
+
+  // Vertices
+
+  if (nVerts > vertexCapacity) {
+    delete[] vertices;
+    vertexCapacity = nVerts;
+    vertices = new Vertex[ vertexCapacity ];
+  }
+
+  pool.parallelFor( 0, nVerts, 1024, [&]( int begin, int end ) {
+    transformVertices( positions, (lit ? normals : NULL), (texture != NULL ? texCoords : NULL), stride, begin, end, MV, MVP );
+  } );
+
+  // Triangles, into bins
+
+  int nTasks = (nTris + SOFT_TRIS_PER_TASK-1) / SOFT_TRIS_PER_TASK;
+  if (nTasks > maxTasks)
+    nTasks = maxTasks;
+
+  pool.parallelFor( 0, nTasks, 1, [&]( int t0, int t1 ) {
+    for (int t=t0; t<t1; t++)
+      setupTriangles( t, (long long) nTris * t / nTasks, (long long) nTris * (t+1) / nTasks );
+  } );
+
+  // Tiles
+
+  pool.parallelFor( 0, tilesX * tilesY, 1, [&]( int begin, int end ) {
+    for (int tile=begin; tile<end; tile++)
+      rasterizeTile( tile, nTasks );
+  } );
+}
+
+
+// Transform vertices begin..end-1, four components at once: a vector
+// is the sum of the matrix's columns scaled by its coordinates
+
+
+void SoftRaster::transformVertices( const float *positions, const float *normals, const float *texCoords, int stride,
+                                    int begin, int end, const mat4 &MV, const mat4 &MVP )
+
+{
+  f4 P[4], N[3];
+
+  for (int j=0; j<4; j++)
+    P[j] = f4set( MVP[0][j], MVP[1][j], MVP[2][j], MVP[3][j] );
+
+  for (int j=0; j<3; j++)
+    N[j] = f4set( MV[0][j], MV[1][j], MV[2][j], MV[3][j] );
+
+  for (int i=begin; i<end; i++) {
+
+    Vertex &v = vertices[i];
+
+    const float *p = positions + (long long) i * stride;
+    f4store( v.clip, f4madd( P[0], f4splat( p[0] ), f4madd( P[1], f4splat( p[1] ), f4madd( P[2], f4splat( p[2] ), P[3] ) ) ) );
+
+    if (normals != NULL) {
+      const float *n = normals + (long long) i * stride;
+      f4store( v.attr, f4madd( N[0], f4splat( n[0] ), f4madd( N[1], f4splat( n[1] ), f4mul( N[2], f4splat( n[2] ) ) ) ) );
+    } else
+      v.attr[0] = v.attr[1] = v.attr[2] = 0;
+
+    if (texCoords != NULL) {
+      const float *t = texCoords + (long long) i * stride;
+      v.attr[3] = t[0];
+      v.attr[4] = t[1];
+    } else
+      v.attr[3] = v.attr[4] = 0;
+  }
+}
+
+
+// Clipping against the near plane (z >= -w) and far plane (z <= w)
+
+#define OUT_NEAR   1
+#define OUT_FAR    2
+#define OUT_LEFT   4
+#define OUT_RIGHT  8
+#define OUT_BOTTOM 16
+#define OUT_TOP    32
+
+
+static int outcode( const float *c )
+
+{
+  return (c[2] < -c[3] ? OUT_NEAR   : 0) | (c[2] > c[3] ? OUT_FAR   : 0) |
+         (c[0] < -c[3] ? OUT_LEFT   : 0) | (c[0] > c[3] ? OUT_RIGHT : 0) |
+         (c[1] < -c[3] ? OUT_BOTTOM : 0) | (c[1] > c[3] ? OUT_TOP   : 0);
+}
+
+
+// Keep the part of the polygon in[0..n-1] on which w + side*z >= 0,
+// interpolating the attributes along the cut edges
+
+template<class V> static int clipPolygon( const V *in, int n, V *out, float side )
+
+{
+  int m = 0;
+
+  for (int i=0; i<n; i++) {
+
+    const V &p = in[i];
+    const V &q = in[(i+1) % n];
+
+    float dp = p.clip[3] + side * p.clip[2];
+    float dq = q.clip[3] + side * q.clip[2];
+
+    if (dp >= 0)
+      out[m++] = p;
+
+    if ((dp >= 0) != (dq >= 0)) {
+
+      float t = dp / (dp - dq);
+      V &v = out[m++];
+
+      for (int k=0; k<4; k++)
+        v.clip[k] = p.clip[k] + t * (q.clip[k] - p.clip[k]);
+      for (int k=0; k<5; k++)
+        v.attr[k] = p.attr[k] + t * (q.attr[k] - p.attr[k]);
+    }
+  }
+
+  return m;
+}
+
+
+void SoftRaster::setupTriangles( int task, int begin, int end )
+
+{
+  taskTriangles[task].clear();
+
+  for (int t=begin; t<end; t++) {
+
+    const Vertex &a = vertices[ drawIndices[3*t]   ];
+    const Vertex &b = vertices[ drawIndices[3*t+1] ];
+    const Vertex &c = vertices[ drawIndices[3*t+2] ];
+
+    int oa = outcode( a.clip );
+    int ob = outcode( b.clip );
+    int oc = outcode( c.clip );
+
+    if (oa & ob & oc)           // all outside the same plane
+      continue;
+
+    if (((oa | ob | oc) & (OUT_NEAR | OUT_FAR)) == 0) {
+      setupTriangle( task, a, b, c );
+      continue;
+    }
+
+    // Each plane adds at most one vertex
+
+    Vertex poly[5], clipped[5];
+
+    poly[0] = a;
+    poly[1] = b;
+    poly[2] = c;
+
+    int n = clipPolygon( poly, 3, clipped, 1 );
+    n = clipPolygon( clipped, n, poly, -1 );
+
+    for (int i=1; i+1<n; i++)
+      setupTriangle( task, poly[0], poly[i], poly[i+1] );
+  }
+}
+
+
+void SoftRaster::setupTriangle( int task, const Vertex &v0, const Vertex &v1, const Vertex &v2 )
+
+{
+  const Vertex *v[3] = { &v0, &v1, &v2 };
+
+  // Window coordinates, with y up and pixel centres at +0.5, snapped
+  // to the subpixel grid
+
+  const float snap = 1 << SOFT_SUBPIXEL_BITS;
+
+  float x[3], y[3], z[3], invW[3];
+
+  for (int i=0; i<3; i++) {
+
+    if (v[i]->clip[3] <= 0)
+      return;
+
+    invW[i] = 1 / v[i]->clip[3];
+
+    x[i] = rint( (v[i]->clip[0] * invW[i] + 1) * 0.5f * width  * snap ) / snap;
+    y[i] = rint( (v[i]->clip[1] * invW[i] + 1) * 0.5f * height * snap ) / snap;
+    z[i] = v[i]->clip[2] * invW[i] * 0.5f + 0.5f;
+  }
+
+  // Twice the signed area.  Clockwise triangles are turned around, as
+  // there's no culling.
+
+  float area = (x[2]-x[1]) * (y[0]-y[1]) - (y[2]-y[1]) * (x[0]-x[1]);
+
+  if (!(area != 0))             // degenerate, or NaN
+    return;
+
+  int order[3] = { 0, 1, 2 };
+
+  if (area < 0) {
+    order[1] = 2;
+    order[2] = 1;
+    area = -area;
+  }
+
+  // Bounding box of the pixel centres inside
+
+  float xLo = fmin( x[0], fmin( x[1], x[2] ) );
+  float xHi = fmax( x[0], fmax( x[1], x[2] ) );
+  float yLo = fmin( y[0], fmin( y[1], y[2] ) );
+  float yHi = fmax( y[0], fmax( y[1], y[2] ) );
+
+  int xMin = (int) fmax( ceil( xLo - 0.5f ), 0 );
+  int yMin = (int) fmax( ceil( yLo - 0.5f ), 0 );
+  int xMax = (int) fmin( floor( xHi - 0.5f ), width-1 );
+  int yMax = (int) fmin( floor( yHi - 0.5f ), height-1 );
+
+  if (xMin > xMax || yMin > yMax)
+    return;
+
+  Triangle tri;
+
+  tri.x0 = x[ order[0] ];
+  tri.y0 = y[ order[0] ];
+
+  for (int i=0; i<3; i++) {
+
+    int a = order[(i+1) % 3];
+    int b = order[(i+2) % 3];
+
+    float dx = x[b] - x[a];
+    float dy = y[b] - y[a];
+
+    tri.A[i]  = -dy;
+    tri.B[i]  = dx;
+    tri.E0[i] = (i == 0 ? area : 0);   // vertex 0 is on edges 1 and 2
+
+    // Counterclockwise, a left edge goes down and a top edge goes left
+
+    tri.topLeft[i] = (dy < 0 || (dy == 0 && dx < 0));
+
+    int k = order[i];
+
+    tri.z[i]    = z[k];
+    tri.invW[i] = invW[k];
+
+    for (int j=0; j<5; j++)
+      tri.attr[j][i] = v[k]->attr[j] * invW[k];
+  }
+
+  tri.invArea = 1 / area;
+
+  tri.xMin = xMin;
+  tri.yMin = yMin;
+  tri.xMax = xMax;
+  tri.yMax = yMax;
+
+  // Into the bins of the tiles that it overlaps
+
+  seq<Triangle> &tris = taskTriangles[task];
+
+  int index = tris.size();
+  tris.add( tri );
+
+  seq<int> *taskBins = bins + task * tilesX * tilesY;
+
+  for (int ty=yMin/SOFT_TILE_SIZE; ty<=yMax/SOFT_TILE_SIZE; ty++)
+    for (int tx=xMin/SOFT_TILE_SIZE; tx<=xMax/SOFT_TILE_SIZE; tx++)
+      taskBins[ ty*tilesX + tx ].add( index );
+}
+
+
+void SoftRaster::rasterizeTile( int tile, int nTasks )
+
+{
+  int tx0 = (tile % tilesX) * SOFT_TILE_SIZE;
+  int ty0 = (tile / tilesX) * SOFT_TILE_SIZE;
+  int tx1 = std::min( tx0 + SOFT_TILE_SIZE, width ) - 1;
+  int ty1 = std::min( ty0 + SOFT_TILE_SIZE, height ) - 1;
+
+  // Tasks in order, and each task's triangles in order
+
+  for (int t=0; t<nTasks; t++) {
+
+    seq<int> &bin = bins[ t * tilesX * tilesY + tile ];
+    seq<Triangle> &tris = taskTriangles[t];
+
+    for (int i=0; i<bin.size(); i++) {
+      const Triangle &tri = tris[ bin[i] ];
+      rasterizeTriangle( tri, std::max( tri.xMin, tx0 ), std::max( tri.yMin, ty0 ),
+                              std::min( tri.xMax, tx1 ), std::min( tri.yMax, ty1 ) );
+    }
+
+    bin.clear();
+  }
+}
+
+
+// Pixels x0..x1 of rows y0..y1, in groups of four.  The groups start at
+// multiples of 4, so the lanes left of x0 are outside the triangle's
+// bounding box, and so outside the triangle, and the lanes right of the
+// image are masked off.
+
+
+void SoftRaster::rasterizeTriangle( const Triangle &tri, int x0, int y0, int x1, int y1 )
+
+{
+  const f4 zero = f4splat( 0 );
+  const f4 laneOffsets = f4set( 0.5f, 1.5f, 2.5f, 3.5f );
+  const f4 imageWidth = f4splat( width );
+
+  f4 A[3], B[3], E0[3], Z[3], invW[3], attr[5][3];
+
+  for (int i=0; i<3; i++) {
+    A[i]    = f4splat( tri.A[i] );
+    B[i]    = f4splat( tri.B[i] );
+    E0[i]   = f4splat( tri.E0[i] );
+    Z[i]    = f4splat( tri.z[i] );
+    invW[i] = f4splat( tri.invW[i] );
+    for (int j=0; j<5; j++)
+      attr[j][i] = f4splat( tri.attr[j][i] );
+  }
+
+  f4 invArea = f4splat( tri.invArea );
+
+  int nAttr = (drawTexture != NULL ? 5 : (drawLit ? 3 : 0));
+
+  for (int y=y0; y<=y1; y++) {
+
+    f4 dy = f4splat( y + 0.5f - tri.y0 );
+
+    float *depthRow = depthBuffer + y * pitch;
+    unsigned char *colourRow = colourBuffer + y * width * 4;
+
+    for (int x=(x0 & ~3); x<=x1; x+=4) {
+
+      f4 X  = f4add( f4splat( x ), laneOffsets );
+      f4 dx = f4sub( X, f4splat( tri.x0 ) );
+
+      // Edge functions, with the top-left rule for pixel centres that
+      // are exactly on an edge
+
+      f4 E[3];
+      f4 inside = f4cmplt( X, imageWidth );
+
+      for (int i=0; i<3; i++) {
+        E[i] = f4madd( A[i], dx, f4madd( B[i], dy, E0[i] ) );
+        inside = f4and( inside, (tri.topLeft[i] ? f4cmple( zero, E[i] ) : f4cmplt( zero, E[i] )) );
+      }
+
+      if (f4movemask( inside ) == 0)
+        continue;
+
+      // Barycentric coordinates, then the depth test
+
+      f4 l0 = f4mul( E[0], invArea );
+      f4 l1 = f4mul( E[1], invArea );
+      f4 l2 = f4mul( E[2], invArea );
+
+      f4 z = f4madd( l0, Z[0], f4madd( l1, Z[1], f4mul( l2, Z[2] ) ) );
+      f4 depth = f4load( depthRow + x );
+
+      inside = f4and( inside, f4cmplt( z, depth ) );
+
+      int lanes = f4movemask( inside );
+      if (lanes == 0)
+        continue;
+
+      f4store( depthRow + x, f4select( inside, z, depth ) );
+
+      // Perspective-correct attributes
+
+      f4 a[5];
+
+      if (nAttr > 0) {
+
+        f4 w = f4div( f4splat( 1 ), f4madd( l0, invW[0], f4madd( l1, invW[1], f4mul( l2, invW[2] ) ) ) );
+
+        for (int j=0; j<nAttr; j++)
+          a[j] = f4mul( f4madd( l0, attr[j][0], f4madd( l1, attr[j][1], f4mul( l2, attr[j][2] ) ) ), w );
+      }
+
+      // NdotL, as in the shaders
+
+      f4 NdotL = f4splat( 1 );
+
+      if (drawLit) {
+
+        f4 len = f4sqrt( f4madd( a[0], a[0], f4madd( a[1], a[1], f4mul( a[2], a[2] ) ) ) );
+
+        NdotL = f4madd( f4div( a[0], len ), f4splat( drawLightDir.x ),
+                f4madd( f4div( a[1], len ), f4splat( drawLightDir.y ),
+                f4mul(  f4div( a[2], len ), f4splat( drawLightDir.z ) ) ) );
+
+        NdotL = f4select( f4cmplt( NdotL, zero ), f4splat( 0.1f ), NdotL );
+      }
+
+      float shade[4], u[4], v[4];
+
+      f4store( shade, NdotL );
+
+      if (drawTexture != NULL) {
+        f4store( u, a[3] );
+        f4store( v, a[4] );
+      }
+
+      for (int k=0; k<4; k++) {
+
+        if (!(lanes & (1 << k)))
+          continue;
+
+        vec3 base = drawColour;
+
+        if (drawTexture != NULL) {
+
+          const SoftTexture &tex = *drawTexture;
+
+          int s = (int) floor( u[k] * tex.width )  % tex.width;
+          int t = (int) floor( v[k] * tex.height ) % tex.height;
+
+          if (s < 0) s += tex.width;
+          if (t < 0) t += tex.height;
+
+          const unsigned char *texel = tex.texels + (t * tex.width + s) * tex.bytesPerTexel;
+          base = vec3( texel[0] / 255.0f, texel[1] / 255.0f, texel[2] / 255.0f );
+        }
+
+        vec3 c = shade[k] * base;
+
+        unsigned char *pixel = colourRow + 4*(x+k);
+
+        pixel[0] = (unsigned char) (fmin( fmax( c.x, 0 ), 1 ) * 255 + 0.5f);
+        pixel[1] = (unsigned char) (fmin( fmax( c.y, 0 ), 1 ) * 255 + 0.5f);
+        pixel[2] = (unsigned char) (fmin( fmax( c.z, 0 ), 1 ) * 255 + 0.5f);
+        pixel[3] = 255;
+      }
+    }
+  }
+}
+
+
+void SoftRaster::writePNG( const char *filename )
+
+{
+  std::vector<unsigned char> image( width * height * 4 );
+
+  // Rows go bottom to top here, and top to bottom in PNG
+
+  for (int y=0; y<height; y++)
+    memcpy( &image[ y*width*4 ], colourBuffer + (height-1-y)*width*4, width*4 );
+
+  unsigned error = lodepng::encode( filename, image, width, height );
+  if (error)
+    cerr << "Error writing '" << filename << "': " << lodepng_error_text(error) << endl;
+}
@@ -0,0 +1,158 @@
+// softRaster.h
+//
+// A software rasterizer, without any OpenGL, for reference images on
+// machines with no GPU and for checking the GPU's images against.
+//
+// It draws indexed triangles the way the shaders of the mesh classes
+// do: positions are transformed by MVP, normals by MV (as directions),
+// and each fragment is shaded with
+//
+//    NdotL = dot( normalize(normal), lightDir )     (0.1 if negative)
+//    colour = NdotL * (flat colour or texel)
+//
+// or, unlit, with the flat colour alone.  Attributes are interpolated
+// perspective-correctly, the depth test is GL_LESS and there is no
+// culling, as in the OpenGL paths.  Pixels are sampled at their centres
+// with the top-left fill rule, so that triangles that share an edge
+// never both draw a pixel on it.
+//
+//    SoftRaster raster( 800, 600 );
+//
+//    raster.clear( vec3(1,1,1) );
+//    cylinder->drawSoft( raster, MV, MVP, lightDir, colour );
+//    raster.writePNG( "frame.png" );
+//
+// Each draw is done in three passes over a ThreadPool (by default the
+// global one): the vertices are transformed, then the triangles are
+// clipped to the near and far planes, set up and put into the bins of
+// the SOFT_TILE_SIZE x SOFT_TILE_SIZE tiles that they overlap, and then
+// the tiles are rasterized, each by one task, four pixels at a time in
+// SIMD lanes.  Each tile draws its triangles in their order in the
+// index list, so the image does not depend on the number of threads.
+//
+// The colour buffer is RGBA with rows from the bottom up, as
+// glReadPixels() returns them.
+
+
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+#include "linalg.h"
+#include "seq.h"
+#include "threadPool.h"
+
+
+#define SOFT_TILE_SIZE      32          // pixels (a multiple of 4)
+#define SOFT_TRIS_PER_TASK  256         // triangles set up by each task
+#define SOFT_SUBPIXEL_BITS  8           // vertices are snapped to 1/256 pixel
+
+
+// Texels row by row, starting at t = 0, each of bytesPerTexel bytes
+// (red first).  Sampling wraps like GL_REPEAT and takes the nearest
+// texel, like GL_NEAREST.
+
+struct SoftTexture {
+  const unsigned char *texels;
+  int width, height;
+  int bytesPerTexel;
+};
+
+
+class SoftRaster {
+
+ public:
+
+  int width, height;
+
+  SoftRaster( int width, int height, ThreadPool &pool = ThreadPool::global() );
+  ~SoftRaster();
+
+  SoftRaster( const SoftRaster & ) = delete;
+  SoftRaster & operator = ( const SoftRaster & ) = delete;
+
+  // Set every pixel to 'colour' (with alpha 1) and every depth to the
+  // far plane
+
+  void clear( vec3 colour );
+
+  // Draw the nIndices/3 triangles of 'indices'.  Vertex i has its
+  // position at positions + i*stride, its normal at normals + i*stride
+  // and its texture coordinates at texCoords + i*stride (all in
+  // floats).  normals is only used if 'lit' and texCoords only if there
+  // is a 'texture'; either may then be NULL.
+
+  void drawTriangles( const float *positions, const float *normals, const float *texCoords, int stride, int nVerts,
+                      const unsigned int *indices, int nIndices,
+                      const mat4 &MV, const mat4 &MVP, vec3 lightDir, vec3 colour,
+                      bool lit = true, const SoftTexture *texture = NULL );
+
+  // Index lists of the triangles of GL_TRIANGLE_STRIP and
+  // GL_TRIANGLE_FAN, for vertices first ... first+count-1
+
+  static void stripIndices( int first, int count, seq<unsigned int> &indices );
+  static void fanIndices( int first, int count, seq<unsigned int> &indices );
+
+  // width*height RGBA pixels, bottom row first
+
+  const unsigned char *pixels() {
+    return colourBuffer;
+  }
+
+  void writePNG( const char *filename );
+
+ private:
+
+  // A vertex after MVP, with its attributes (the normal after MV and
+  // the texture coordinates)
+
+  struct Vertex {
+    float clip[4];
+    float attr[5];
+  };
+
+  // A triangle in window coordinates.  Edge i is opposite vertex i and
+  // E_i(x,y) = E0[i] + A[i]*(x-x0) + B[i]*(y-y0) is positive inside.
+  // z and the attributes are interpolated from the barycentric
+  // coordinates E_i * invArea, the attributes divided by w.
+
+  struct Triangle {
+    float x0, y0;
+    float A[3], B[3], E0[3];
+    bool  topLeft[3];
+    float invArea;
+    float z[3], invW[3];
+    float attr[5][3];
+    int   xMin, yMin, xMax, yMax;
+  };
+
+  ThreadPool &pool;
+
+  int pitch;                    // depths per row: width rounded up to a multiple of 4
+  int tilesX, tilesY;
+  int maxTasks;
+
+  unsigned char *colourBuffer;  // RGBA, width pixels per row
+  float         *depthBuffer;   // window z in [0,1], pitch per row
+
+  Vertex *vertices;
+  int     vertexCapacity;
+
+  seq<Triangle> *taskTriangles; // set up by each task
+  seq<int>      *bins;          // bins[task*tilesX*tilesY + tile] indexes taskTriangles[task]
+
+  // The draw in progress
+
+  const unsigned int *drawIndices;
+  vec3  drawLightDir, drawColour;
+  bool  drawLit;
+  const SoftTexture *drawTexture;
+
+  void transformVertices( const float *positions, const float *normals, const float *texCoords, int stride,
+                          int begin, int end, const mat4 &MV, const mat4 &MVP );
+  void setupTriangles( int task, int begin, int end );
+  void setupTriangle( int task, const Vertex &v0, const Vertex &v1, const Vertex &v2 );
+  void rasterizeTile( int tile, int nTasks );
+  void rasterizeTriangle( const Triangle &tri, int x0, int y0, int x1, int y1 );
+};
+
+#endif
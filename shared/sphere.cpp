@@ -3,6 +3,7 @@
 
 
 #include "sphere.h"
+#include "drawStats.h"
 
 
 // icosahedron vertices (taken from Jon Leech http://www.cs.unc.edu/~jon)
@@ -167,21 +168,33 @@ void Sphere::draw( mat4 &MV, mat4 &MVP, vec3 lightDir, vec3 colour )
 {
   gpu.activate();
 
-  gpu.setMat4( "MV", MV );
-  gpu.setMat4( "MVP", MVP );
-  gpu.setVec3( "colour", colour );
-  gpu.setVec3( "lightDir", lightDir );
+  MVUniform.set( MV );
+  MVPUniform.set( MVP );
+  colourUniform.set( colour );
+  lightDirUniform.set( lightDir );
 
   // Draw using element array
 
   glBindVertexArray( VAO );
   glDrawElements( GL_TRIANGLES, faces.size()*3, GL_UNSIGNED_INT, 0 );
+  drawStats.drawCalls++;
   glBindVertexArray( 0 );
 
   gpu.deactivate();
 }
 
 
+void Sphere::drawSoft( SoftRaster &raster, const mat4 &MV, const mat4 &MVP, vec3 lightDir, vec3 /* colour */ )
+
+{
+  // The fragment shader ignores the colour and the lighting and draws
+  // white, so this does too
+
+  raster.drawTriangles( &verts[0].x, NULL, NULL, 3, verts.size(),
+                        faces[0].v, faces.size()*3, MV, MVP, lightDir, vec3(1,1,1), false );
+}
+
+
 const char *Sphere::vertShader = R"(
 
   #version 330 es
@@ -9,6 +9,7 @@
 #include "linalg.h"
 #include "seq.h"
 #include "gpuProgram.h"
+#include "softRaster.h"
 
 
 // icosahedron vertices (taken from Jon Leech http://www.cs.unc.edu/~jon)
@@ -38,8 +39,19 @@ class Sphere {
   // additional level refines the previous level by converting each
   // triangular face into four triangular faces, placing all face
   // vertices at distance 1 from the origin.
+  //
+  // With useGL false, no OpenGL calls are made and the sphere can only
+  // be drawn with drawSoft().
   
-  Sphere( int numLevels ) {
+  Sphere( int numLevels, bool useGL = true ) {
+
+    // Each level quadruples the faces and adds three vertices per
+    // face, so the final sizes are known up front.
+
+    int finalFaces = NUM_FACES << (2*numLevels);
+
+    faces.reserve( finalFaces );
+    verts.reserve( NUM_VERTS + (finalFaces - NUM_FACES) );
 
     for (int i=0; i<NUM_VERTS; i++)
       verts.add( icosahedronVerts[i] );
@@ -55,8 +67,16 @@ class Sphere {
     for (int i=0; i<numLevels; i++)
       refine();
 
+    if (!useGL)
+      return;
+
     gpu.init( vertShader, fragShader, "in sphere.cpp" );
 
+    MVUniform       = gpu.uniform<mat4>( "MV" );
+    MVPUniform      = gpu.uniform<mat4>( "MVP" );
+    colourUniform   = gpu.uniform<vec3>( "colour" );
+    lightDirUniform = gpu.uniform<vec3>( "lightDir" );
+
     setupVAO();
   };
 
@@ -72,6 +92,10 @@ class Sphere {
   
   void draw( mat4 &MV, mat4 &MVP, vec3 lightDir, vec3 colour );
 
+  // The same, in software (see softRaster.h)
+
+  void drawSoft( SoftRaster &raster, const mat4 &MV, const mat4 &MVP, vec3 lightDir, vec3 colour );
+
  private:
 
   seq<vec3>       verts;
@@ -80,6 +104,9 @@ class Sphere {
 
   GPUProgram      gpu;
 
+  UniformHandle<mat4> MVUniform, MVPUniform;
+  UniformHandle<vec3> colourUniform, lightDirUniform;
+
   static const char *vertShader;
   static const char *fragShader;
 
@@ -0,0 +1,185 @@
+// threadPool.cpp
+
+
+#include "threadPool.h"
+
+
+// The pool and queue index of the current thread, if it is a worker
+
+static thread_local ThreadPool *currentPool = NULL;
+static thread_local int         currentIndex = -1;
+
+
+ThreadPool::ThreadPool( int nThreads )
+
+{
+  if (nThreads <= 0)
+    nThreads = std::thread::hardware_concurrency();
+
+  if (nThreads < 1)
+    nThreads = 1;
+
+  queued = 0;
+  stopping = false;
+
+  for (int i=0; i<nThreads; i++)  // nThreads-1 workers and the outside queue
+    queues.push_back( new Queue );
+
+  for (int i=0; i<nThreads-1; i++)
+    workers.push_back( std::thread( &ThreadPool::workerLoop, this, i ) );
+}
+
+
+ThreadPool::~ThreadPool()
+
+{
+  {
+    std::lock_guard<std::mutex> guard( sleepLock );
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for (unsigned int i=0; i<workers.size(); i++)
+    workers[i].join();
+
+  for (unsigned int i=0; i<queues.size(); i++)
+    delete queues[i];
+}
+
+
+ThreadPool &ThreadPool::global()
+
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+
+int ThreadPool::ownQueue()
+
+{
+  return (currentPool == this ? currentIndex : queues.size()-1);
+}
+
+
+void ThreadPool::push( Task task )
+
+{
+  Queue *q = queues[ ownQueue() ];
+
+  {
+    std::lock_guard<std::mutex> guard( q->lock );
+    q->tasks.push_back( std::move( task ) );
+  }
+
+  queued++;
+
+  // Taking the lock orders this with a worker about to sleep, so that
+  // the wake-up is not lost
+
+  { std::lock_guard<std::mutex> guard( sleepLock ); }
+  wake.notify_one();
+}
+
+
+// Run one task, taken from the back of our own queue or else stolen
+// from the front of another.  Returns false if there was none.
+
+
+bool ThreadPool::runOne( int self )
+
+{
+  Task task;
+  bool found = false;
+
+  int n = queues.size();
+
+  for (int k=0; k<n && !found; k++) {
+
+    Queue *q = queues[ (self+k) % n ];
+
+    std::lock_guard<std::mutex> guard( q->lock );
+
+    if (!q->tasks.empty()) {
+      if (k == 0) {
+        task = std::move( q->tasks.back() );
+        q->tasks.pop_back();
+      } else {
+        task = std::move( q->tasks.front() );
+        q->tasks.pop_front();
+      }
+      found = true;
+    }
+  }
+
+  if (!found)
+    return false;
+
+  queued--;
+
+  task.fn();
+  (*task.remaining)--;
+
+  return true;
+}
+
+
+void ThreadPool::workerLoop( int self )
+
+{
+  currentPool = this;
+  currentIndex = self;
+
+  while (true) {
+
+    if (runOne( self ))
+      continue;
+
+    std::unique_lock<std::mutex> lock( sleepLock );
+    wake.wait( lock, [this] { return stopping || queued > 0; } );
+
+    if (stopping)
+      return;
+  }
+}
+
+
+void ThreadPool::parallelFor( int begin, int end, int grain, const std::function<void(int,int)> &body )
+
+{
+  if (end <= begin)
+    return;
+
+  if (grain < 1)
+    grain = 1;
+
+  // Run small loops, or everything in a pool of one, directly
+
+  if (workers.size() == 0 || end - begin <= grain) {
+    body( begin, end );
+    return;
+  }
+
+  std::atomic<int> remaining( (end - begin + grain-1) / grain );
+
+  // Queue all but the first piece, which this thread runs
+
+  for (int b = begin+grain; b < end; b += grain) {
+    int e = (b+grain < end ? b+grain : end);
+    Task task;
+    task.fn = [&body,b,e] { body( b, e ); };
+    task.remaining = &remaining;
+    push( std::move( task ) );
+  }
+
+  body( begin, (begin+grain < end ? begin+grain : end) );
+  remaining--;
+
+  // Help until our pieces are done
+
+  int self = ownQueue();
+
+  while (remaining > 0)
+    if (!runOne( self ))
+      std::this_thread::yield();
+}
@@ -0,0 +1,84 @@
+// threadPool.h
+//
+// A small work-stealing thread pool.
+//
+// Each worker has its own queue of tasks.  A worker takes tasks from
+// the back of its own queue and, when that is empty, steals from the
+// front of the others'.  A thread that waits for its tasks (in
+// parallelFor) runs queued tasks meanwhile, so the calling thread also
+// does work, and parallelFor can be called from inside a task.
+//
+//    ThreadPool pool;                        // one thread per core
+//
+//    pool.parallelFor( 0, height, 16, [&]( int begin, int end ) {
+//      for (int y=begin; y<end; y++)
+//        ... row y ...
+//    } );
+//
+// ThreadPool::global() is a pool shared by the whole program, made on
+// first use.
+
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <functional>
+
+
+class ThreadPool {
+
+ public:
+
+  // nThreads counts the calling thread, so ThreadPool( 1 ) runs
+  // everything on the caller.  0 means one per core.
+
+  ThreadPool( int nThreads = 0 );
+  ~ThreadPool();
+
+  ThreadPool( const ThreadPool & ) = delete;
+  ThreadPool & operator = ( const ThreadPool & ) = delete;
+
+  int size() {
+    return workers.size() + 1;
+  }
+
+  // Call body( b, e ) over [begin,end) in pieces of at most 'grain'
+  // and return when all pieces are done
+
+  void parallelFor( int begin, int end, int grain, const std::function<void(int,int)> &body );
+
+  static ThreadPool &global();
+
+ private:
+
+  struct Task {
+    std::function<void()> fn;
+    std::atomic<int>     *remaining;  // of the task's parallelFor
+  };
+
+  struct Queue {
+    std::mutex       lock;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::thread> workers;
+  std::vector<Queue *>     queues;    // one per worker, then one for other threads
+
+  std::mutex              sleepLock;
+  std::condition_variable wake;
+  std::atomic<int>        queued;
+  bool                    stopping;
+
+  void push( Task task );
+  bool runOne( int self );
+  void workerLoop( int self );
+  int  ownQueue();
+};
+
+#endif
@@ -0,0 +1,155 @@
+// viewFrustum.cpp
+
+
+#include "viewFrustum.h"
+#include "simd.h"
+
+
+// The planes of the clip volume -w <= x,y,z <= w are the sums and
+// differences of the last row of M with the others
+
+
+ViewFrustum::ViewFrustum( mat4 const& M )
+
+{
+  planes[0] = M.rows[3] + M.rows[0];    // left
+  planes[1] = M.rows[3] - M.rows[0];    // right
+  planes[2] = M.rows[3] + M.rows[1];    // bottom
+  planes[3] = M.rows[3] - M.rows[1];    // top
+  planes[4] = M.rows[3] + M.rows[2];    // near
+  planes[5] = M.rows[3] - M.rows[2];    // far
+
+  for (int p=0; p<6; p++) {
+    float len = vec3( planes[p].x, planes[p].y, planes[p].z ).length();
+    if (len > 0)
+      planes[p] = (1/len) * planes[p];
+  }
+}
+
+
+bool ViewFrustum::sphereVisible( vec3 centre, float radius )
+
+{
+  for (int p=0; p<6; p++) {
+    vec4 &n = planes[p];
+    if (n.x*centre.x + n.y*centre.y + n.z*centre.z + n.w < -radius)
+      return false;
+  }
+
+  return true;
+}
+
+
+// For each plane, the box corner farthest along the plane's normal
+// decides whether the box is outside, and the corner farthest against
+// it whether the box is inside.
+
+
+int ViewFrustum::boxVisibility( vec3 boxMin, vec3 boxMax )
+
+{
+  int result = FRUSTUM_INSIDE;
+
+  for (int p=0; p<6; p++) {
+
+    vec4 &n = planes[p];
+
+    vec3 outer( n.x > 0 ? boxMax.x : boxMin.x, n.y > 0 ? boxMax.y : boxMin.y, n.z > 0 ? boxMax.z : boxMin.z );
+    vec3 inner( n.x > 0 ? boxMin.x : boxMax.x, n.y > 0 ? boxMin.y : boxMax.y, n.z > 0 ? boxMin.z : boxMax.z );
+
+    if (n.x*outer.x + n.y*outer.y + n.z*outer.z + n.w < 0)
+      return FRUSTUM_OUTSIDE;
+
+    if (n.x*inner.x + n.y*inner.y + n.z*inner.z + n.w < 0)
+      result = FRUSTUM_INTERSECTS;
+  }
+
+  return result;
+}
+
+
+// Add the index of each lane of 'outside' that is clear
+
+static inline void addVisible( int i, f4 outside, seq<int> &visible )
+
+{
+  int mask = f4movemask( outside );
+
+  for (int k=0; k<4; k++)
+    if (!(mask & (1 << k)))
+      visible.add( i+k );
+}
+
+
+void ViewFrustum::cullSpheres( vec3SoA const& centres, const float *radii, seq<int> &visible )
+
+{
+  visible.clear();
+
+  int n = centres.size();
+  int i = 0;
+
+  for ( ; i+4<=n; i+=4) {
+
+    f4 x = f4load( centres.x+i );
+    f4 y = f4load( centres.y+i );
+    f4 z = f4load( centres.z+i );
+    f4 negR = f4sub( f4splat( 0 ), f4load( radii+i ) );
+
+    f4 outside = f4splat( 0 );                  // no lanes set
+
+    for (int p=0; p<6; p++) {
+      vec4 &pl = planes[p];
+      f4 d = f4madd( f4splat( pl.x ), x,
+             f4madd( f4splat( pl.y ), y,
+             f4madd( f4splat( pl.z ), z, f4splat( pl.w ) ) ) );
+      outside = f4or( outside, f4cmplt( d, negR ) );
+    }
+
+    addVisible( i, outside, visible );
+  }
+
+  for ( ; i<n; i++)
+    if (sphereVisible( centres[i], radii[i] ))
+      visible.add( i );
+}
+
+
+void ViewFrustum::cullBoxes( vec3SoA const& mins, vec3SoA const& maxs, seq<int> &visible )
+
+{
+  visible.clear();
+
+  int n = mins.size();
+  int i = 0;
+
+  // The corner farthest along each plane's normal, as a choice of
+  // array per axis
+
+  const float *outer[6][3];
+
+  for (int p=0; p<6; p++) {
+    outer[p][0] = (planes[p].x > 0 ? maxs.x : mins.x);
+    outer[p][1] = (planes[p].y > 0 ? maxs.y : mins.y);
+    outer[p][2] = (planes[p].z > 0 ? maxs.z : mins.z);
+  }
+
+  for ( ; i+4<=n; i+=4) {
+
+    f4 outside = f4splat( 0 );
+
+    for (int p=0; p<6; p++) {
+      vec4 &pl = planes[p];
+      f4 d = f4madd( f4splat( pl.x ), f4load( outer[p][0]+i ),
+             f4madd( f4splat( pl.y ), f4load( outer[p][1]+i ),
+             f4madd( f4splat( pl.z ), f4load( outer[p][2]+i ), f4splat( pl.w ) ) ) );
+      outside = f4or( outside, f4cmplt( d, f4splat( 0 ) ) );
+    }
+
+    addVisible( i, outside, visible );
+  }
+
+  for ( ; i<n; i++)
+    if (boxVisibility( mins[i], maxs[i] ) != FRUSTUM_OUTSIDE)
+      visible.add( i );
+}
@@ -0,0 +1,52 @@
+// viewFrustum.h
+//
+// View frustum culling.  A ViewFrustum holds the six planes of the clip
+// volume of a transform M, in the coordinates that M is applied to.
+// For example, ViewFrustum( VCStoCCS * V ) has its planes in the WCS and
+// ViewFrustum( MVP ) has them in an object's OCS.
+//
+// Single objects are tested with sphereVisible() and boxVisibility().
+// Many objects, stored as vec3SoA, are tested four at a time with
+// cullSpheres() and cullBoxes(), which return the indices of the
+// objects that might be visible:
+//
+//    ViewFrustum frustum( MVP );
+//    frustum.cullSpheres( centres, radii, visible );
+//
+//    for (int i=0; i<visible.size(); i++)
+//      ... draw object visible[i] ...
+//
+// Tests are conservative: an object near a corner of the frustum may
+// be reported visible when it is not.
+
+
+#ifndef VIEW_FRUSTUM_H
+#define VIEW_FRUSTUM_H
+
+#include "linalg.h"
+#include "seq.h"
+
+
+#define FRUSTUM_OUTSIDE     0
+#define FRUSTUM_INTERSECTS  1
+#define FRUSTUM_INSIDE      2
+
+
+class ViewFrustum {
+
+ public:
+
+  vec4 planes[6];               // (a,b,c,d) with ax+by+cz+d >= 0 inside and |(a,b,c)| = 1
+
+  ViewFrustum() {}
+
+  ViewFrustum( mat4 const& M );
+
+  bool sphereVisible( vec3 centre, float radius );
+  int  boxVisibility( vec3 boxMin, vec3 boxMax );   // FRUSTUM_OUTSIDE, _INTERSECTS or _INSIDE
+
+  void cullSpheres( vec3SoA const& centres, const float *radii, seq<int> &visible );
+  void cullBoxes( vec3SoA const& mins, vec3SoA const& maxs, seq<int> &visible );
+};
+
+#endif